@@ -0,0 +1,88 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ActivityLED.h"
+
+ActivityLED::ActivityLED(uint8_t pin){
+	this->pin = pin;
+	idleLevel = LOW;
+	shownLevel = LOW;
+	head = 0;
+	count = 0;
+	stepStarted = false;
+	stepStart = 0;
+}
+
+void ActivityLED::begin(){
+	pinMode(pin, OUTPUT);
+	digitalWrite(pin, LOW);
+	shownLevel = LOW;
+}
+
+void ActivityLED::setIdle(uint8_t level){
+	idleLevel = level;
+}
+
+void ActivityLED::cancel(){
+	count = 0;
+	stepStarted = false;
+}
+
+boolean ActivityLED::queue(uint8_t level, uint16_t ms){
+	if(count >= ACT_QUEUE_LEN) return false;
+	uint8_t i = head + count;
+	if(i >= ACT_QUEUE_LEN) i -= ACT_QUEUE_LEN;
+	levels[i] = level;
+	durations[i] = ms;
+	count++;
+	return true;
+}
+
+void ActivityLED::blink(uint8_t n, uint8_t level, uint16_t ms){
+	for(uint8_t i=0; i<n; i++){
+		queue(level, ms);
+		queue(!level, ms);
+	}
+}
+
+boolean ActivityLED::busy(){
+	return count > 0;
+}
+
+void ActivityLED::update(){
+	unsigned long now = millis();
+	//retire finished steps. More than one can finish between calls if loop() was held up
+	while(count > 0){
+		if(!stepStarted){
+			stepStarted = true;
+			stepStart = now;
+		}
+		if((now - stepStart) < durations[head]) break;
+		stepStart += durations[head];
+		head++;
+		if(head >= ACT_QUEUE_LEN) head = 0;
+		count--;
+	}
+	if(count == 0){
+		stepStarted = false;
+		show(idleLevel);
+	}else{
+		show(levels[head]);
+	}
+}
+
+void ActivityLED::show(uint8_t level){
+	if(level != shownLevel){
+		digitalWrite(pin, level);
+		shownLevel = level;
+	}
+}
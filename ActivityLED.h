@@ -0,0 +1,56 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Non-blocking flash sequences for the "active" LED.
+ * Steps (a level held for a number of ms) are queued and played out by update(), which must be called on every pass of loop().
+ * When no steps are pending the LED shows the idle level. None of the methods wait, so feedback never stalls the tick.
+ */
+
+#ifndef ACTIVITYLED_H
+#define ACTIVITYLED_H
+
+#include <Arduino.h>
+
+//maximum number of queued steps. A 3-flash acknowledgement needs 6
+#define ACT_QUEUE_LEN 8
+
+class ActivityLED{
+	public:
+		ActivityLED(uint8_t pin);
+		//sets the pin as an output, showing the idle level (LOW)
+		void begin();
+		//the level shown when no sequence is playing
+		void setIdle(uint8_t level);
+		//drop any pending steps; the idle level is shown on the next update()
+		void cancel();
+		//append a step. Returns false, and does nothing, if the queue is full
+		boolean queue(uint8_t level, uint16_t ms);
+		//append count flashes: level for ms then the opposite level for ms
+		void blink(uint8_t count, uint8_t level, uint16_t ms);
+		//true while a sequence is playing
+		boolean busy();
+		//advance the sequence and drive the pin
+		void update();
+	private:
+		uint8_t pin;
+		uint8_t idleLevel;
+		uint8_t shownLevel;
+		uint8_t levels[ACT_QUEUE_LEN];
+		uint16_t durations[ACT_QUEUE_LEN];
+		uint8_t head;//index of the playing step
+		uint8_t count;//number of steps queued, including the playing one
+		boolean stepStarted;
+		unsigned long stepStart;
+		void show(uint8_t level);
+};
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AdcScanner.h"
+
+//order in which channels are converted. A0 (audio) gets every other slot
+static const uint8_t adcScanSeq[] PROGMEM = {0, 1, 0, 2, 0, 3};
+#define ADC_SEQ_LEN (sizeof(adcScanSeq)/sizeof(adcScanSeq[0]))
+
+static AdcScanner* activeScanner = 0;
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+ISR(ADC_vect){
+	activeScanner->conversionComplete(ADC);
+}
+#else
+//the simulator converts the current channel every ADC_CONVERSION_US, using the simulated analogRead()
+static void hostAdcHook(){
+	activeScanner->conversionComplete(analogRead(A0 + activeScanner->currentChannel()));
+}
+#endif
+
+AdcScanner::AdcScanner(){
+	seqIdx = 0;
+	hookChannel = 0;
+	sampleHook = 0;
+	for(uint8_t ch=0; ch<ADC_CHANNELS; ch++){
+		sum[ch] = 0;
+		samples[ch] = 0;
+		filtered[ch] = 0;
+		published[ch] = 0;
+		primed[ch] = false;
+	}
+}
+
+void AdcScanner::begin(){
+	activeScanner = this;
+	seqIdx = 0;
+	#ifdef __AVR__
+	DIDR0 |= (1<<ADC_CHANNELS) - 1;//digital input buffers off on the analog pins
+	//enabled, interrupt on completion, prescaler 128 (125kHz at 16MHz)
+	ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+	#else
+	hostAttachTimer(hostAdcHook, ADC_CONVERSION_US);
+	#endif
+	startConversion(pgm_read_byte(&adcScanSeq[0]));
+}
+
+void AdcScanner::startConversion(uint8_t channel){
+	#ifdef __AVR__
+	ADMUX = _BV(REFS0) | channel;//AVcc reference
+	ADCSRA |= _BV(ADSC);
+	#else
+	(void)channel;
+	#endif
+}
+
+uint8_t AdcScanner::currentChannel(){
+	return pgm_read_byte(&adcScanSeq[seqIdx]);
+}
+
+void AdcScanner::conversionComplete(uint16_t value){
+	uint8_t ch = pgm_read_byte(&adcScanSeq[seqIdx]);
+	//get the next conversion going straight away
+	uint8_t next = seqIdx + 1;
+	if(next >= ADC_SEQ_LEN) next = 0;
+	seqIdx = next;
+	startConversion(pgm_read_byte(&adcScanSeq[next]));
+
+	if(sampleHook && ch == hookChannel) sampleHook(value);
+
+	sum[ch] += value;
+	if(++samples[ch] < (1<<ADC_OVERSAMPLE_SHIFT)) return;
+	uint16_t avg = sum[ch] >> ADC_OVERSAMPLE_SHIFT;
+	sum[ch] = 0;
+	samples[ch] = 0;
+	if(primed[ch]){
+		//filtered += (avg - filtered) * 2^-ADC_FILTER_SHIFT, with filtered held scaled up by 2^ADC_FILTER_SHIFT
+		filtered[ch] = filtered[ch] - (filtered[ch] >> ADC_FILTER_SHIFT) + avg;
+	}else{
+		filtered[ch] = avg << ADC_FILTER_SHIFT;
+		primed[ch] = true;
+	}
+	published[ch] = (filtered[ch] + (1<<(ADC_FILTER_SHIFT-1))) >> ADC_FILTER_SHIFT;
+}
+
+void AdcScanner::setSampleHook(uint8_t channel, void (*hook)(uint16_t)){
+	sampleHook = 0;//so the interrupt never sees a half-changed channel/hook pair
+	hookChannel = channel;
+	sampleHook = hook;
+}
+
+uint16_t AdcScanner::read(uint8_t channel){
+	#ifdef __AVR__
+	uint8_t oldSREG = SREG;
+	cli();
+	uint16_t v = published[channel];
+	SREG = oldSREG;
+	return v;
+	#else
+	return published[channel];
+	#endif
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Background ADC scanning, so that loop() never waits for a conversion.
+ * The ADC-complete interrupt selects the next channel in the scan sequence and starts its conversion, then accumulates the result.
+ * Every 2^ADC_OVERSAMPLE_SHIFT samples of a channel are averaged (decimated) and fed through a first-order low-pass filter
+ * (coefficient 2^-ADC_FILTER_SHIFT) to give a steady 10-bit value, read with read().
+ * At the 125kHz ADC clock a conversion takes 104us. The audio input (A0) is converted every other time, about 4.8kHz,
+ * so that a sample hook can process it as audio; A1-A3 are each converted about 1.6kHz and decimated about 100 times a second.
+ * analogRead() must not be used while the scanner is running.
+ */
+
+#ifndef ADCSCANNER_H
+#define ADCSCANNER_H
+
+#include <Arduino.h>
+
+//ADC channels scanned, 0..ADC_CHANNELS-1 (A0..A3)
+#define ADC_CHANNELS 4
+#define ADC_OVERSAMPLE_SHIFT 4
+#define ADC_FILTER_SHIFT 2
+//conversion time at prescaler 128: 13 ADC clocks of 8us
+#define ADC_CONVERSION_US 104
+
+class AdcScanner{
+	public:
+		AdcScanner();
+		//configure the ADC and start the first conversion
+		void begin();
+		//latest filtered value (0-1023) for a channel
+		uint16_t read(uint8_t channel);
+		//called from the ADC interrupt with the result of the conversion in progress
+		void conversionComplete(uint16_t value);
+		//the channel being converted
+		uint8_t currentChannel();
+		//have every raw sample of a channel passed to hook, from the interrupt, as well as being filtered
+		void setSampleHook(uint8_t channel, void (*hook)(uint16_t));
+	private:
+		volatile uint8_t seqIdx;//index into the scan sequence of the conversion in progress
+		uint16_t sum[ADC_CHANNELS];
+		uint8_t samples[ADC_CHANNELS];
+		uint16_t filtered[ADC_CHANNELS];//filter state, scaled by 2^ADC_FILTER_SHIFT
+		volatile uint16_t published[ADC_CHANNELS];
+		boolean primed[ADC_CHANNELS];//the filter has been loaded with a first value
+		uint8_t hookChannel;
+		void (*volatile sampleHook)(uint16_t);
+		void startConversion(uint8_t channel);
+};
+
+#endif
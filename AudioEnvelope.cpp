@@ -0,0 +1,93 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "AudioEnvelope.h"
+
+AudioEnvelope::AudioEnvelope(){
+	dc = 512 << 6;
+	env = 0;
+	blockSum = 0;
+	blockSamples = 0;
+	avg = 0;
+	refractory = 0;
+	hold = 0;
+	published = 0;
+	beats = 0;
+}
+
+void AudioEnvelope::sample(uint16_t adc){
+	//DC tracking: dc/64 follows the input with a time constant of 256 samples
+	dc = dc - (dc >> 8) + (adc >> 2);
+	uint16_t bias = dc >> 6;
+	uint16_t rect = (adc > bias) ? (adc - bias) : (bias - adc);//0-1023, in practice <= 512
+
+	//envelope, held scaled by 64 (max 32767 for a full-scale input)
+	uint16_t target = (rect > 511 ? 511 : rect) << 6;
+	if(target > env){
+		env += (target - env) >> AUDIO_ATTACK_SHIFT;
+	}else if(env > 0){
+		//the +1 stops the release stalling once env >> AUDIO_RELEASE_SHIFT reaches 0
+		env -= (env >> AUDIO_RELEASE_SHIFT) + 1;
+		if(env < target) env = target;
+	}
+	published = env >> 4;//1023 for a swing of +/-256 counts; larger swings are clipped on read
+
+	blockSum += rect;//64 samples of <= 1023 fit in 16 bits
+	if(++blockSamples == (1 << AUDIO_BLOCK_SHIFT)){
+		endBlock(blockSum >> AUDIO_BLOCK_SHIFT);
+		blockSum = 0;
+		blockSamples = 0;
+	}
+}
+
+void AudioEnvelope::endBlock(uint16_t mean){
+	if(hold > 0) hold--;
+	uint16_t avgMean = avg >> 4;
+	//onset: block mean > 1.5 * long-term mean, i.e. 2*mean > 3*avg
+	if(refractory > 0){
+		refractory--;
+	}else if(mean >= AUDIO_BEAT_FLOOR && (mean << 1) > (avgMean << 1) + avgMean){
+		beats++;
+		hold = AUDIO_BEAT_HOLD;
+		refractory = AUDIO_REFRACTORY;
+	}
+	//long-term mean, scaled by 16
+	avg = avg - (avg >> AUDIO_AVG_SHIFT) + ((mean << 4) >> AUDIO_AVG_SHIFT);
+}
+
+uint16_t AudioEnvelope::level(){
+	#ifdef __AVR__
+	uint8_t oldSREG = SREG;
+	cli();
+	uint16_t v = published;
+	SREG = oldSREG;
+	#else
+	uint16_t v = published;
+	#endif
+	return v > 1023 ? 1023 : v;
+}
+
+boolean AudioEnvelope::beat(){
+	return hold > 0;
+}
+
+uint16_t AudioEnvelope::beatCount(){
+	#ifdef __AVR__
+	uint8_t oldSREG = SREG;
+	cli();
+	uint16_t v = beats;
+	SREG = oldSREG;
+	return v;
+	#else
+	return beats;
+	#endif
+}
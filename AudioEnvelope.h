@@ -0,0 +1,66 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Integer-only audio envelope follower and beat (onset) detector for the audio input on A0.
+ * sample() is called from the ADC interrupt for every audio conversion (about 4.8kHz with the AdcScanner sequence), so it
+ * uses only 8/16-bit arithmetic, shifts and compares: no multiply/divide beyond shifts.
+ *  - the DC bias of the input (nominally 512) is tracked with a very slow low-pass filter and subtracted;
+ *  - the rectified signal drives an envelope with a fast attack and a slow release -> level(), 0-1023;
+ *  - the mean rectified level over blocks of 2^AUDIO_BLOCK_SHIFT samples is compared with its long-term average.
+ *    A block louder than 1.5x the average (and above a noise floor) is an onset; after a refractory period another can occur.
+ *    beat() is true for AUDIO_BEAT_HOLD blocks after each onset.
+ */
+
+#ifndef AUDIOENVELOPE_H
+#define AUDIOENVELOPE_H
+
+#include <Arduino.h>
+
+//envelope attack and release, as shifts (time constant = 2^shift samples)
+#define AUDIO_ATTACK_SHIFT 2
+#define AUDIO_RELEASE_SHIFT 9
+//beat detection works on blocks of 64 samples (~13ms)
+#define AUDIO_BLOCK_SHIFT 6
+//long-term average time constant, as a shift, in blocks
+#define AUDIO_AVG_SHIFT 5
+//minimum block mean (rectified ADC counts) that can count as an onset
+#define AUDIO_BEAT_FLOOR 12
+//blocks after an onset before another is accepted (~270ms, so up to ~220bpm)
+#define AUDIO_REFRACTORY 20
+//blocks for which beat() stays true after an onset (~100ms, so a 16Hz tick always sees it)
+#define AUDIO_BEAT_HOLD 8
+
+class AudioEnvelope{
+	public:
+		AudioEnvelope();
+		//process one 10-bit ADC sample
+		void sample(uint16_t adc);
+		//envelope level 0-1023, reaching 1023 for an input swing of +/-256 counts
+		uint16_t level();
+		//true for a short while after an onset
+		boolean beat();
+		//number of onsets detected since start (wraps)
+		uint16_t beatCount();
+	private:
+		uint16_t dc;//DC bias, scaled by 64
+		uint16_t env;//envelope, scaled by 64
+		uint16_t blockSum;
+		uint8_t blockSamples;
+		uint16_t avg;//long-term block mean, scaled by 16
+		uint8_t refractory;
+		volatile uint8_t hold;
+		volatile uint16_t published;
+		volatile uint16_t beats;
+		void endBlock(uint16_t mean);
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "BcmOutput.h"
+
+static BcmOutput* activeBcm = 0;
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+ISR(TIMER1_COMPA_vect){
+	activeBcm->timerEvent();
+}
+
+//SPI master, MSB first, clock F_CPU/2 with SPI2X. Pin 10 (SS) is the IR receiver input, so a low on it can drop the SPI
+//out of master mode; SPCR is therefore set again in every interrupt
+#define BCM_SPCR (_BV(SPE) | _BV(MSTR))
+//pin 8 is PB0
+#define BCM_LATCH_PORT PORTB
+#define BCM_LATCH_BIT _BV(PB0)
+#else
+//the plane being shown still has this many LSB periods to run
+static uint16_t hostUnits = 1;
+
+static void hostBcmHook(){
+	if(--hostUnits == 0){
+		activeBcm->timerEvent();
+	}
+}
+#endif
+
+BcmOutput::BcmOutput(){
+	numRegisters = BCM_REGISTERS;
+	nextPlane = 0;
+	for(uint8_t k = 0; k < BCM_BITS; k++){
+		for(uint8_t r = 0; r < BCM_REGISTERS; r++){
+			planes[k][r] = 0;
+		}
+	}
+	#ifndef __AVR__
+	interrupts = 0;
+	bytesShifted = 0;
+	for(uint8_t r = 0; r < BCM_REGISTERS; r++){
+		shiftReg[r] = 0;
+		latched[r] = 0;
+	}
+	#endif
+}
+
+void BcmOutput::begin(uint8_t numChannels){
+	if(numChannels > BCM_MAX_CHANNELS) numChannels = BCM_MAX_CHANNELS;
+	numRegisters = (numChannels + 7) >> 3;
+	activeBcm = this;
+	nextPlane = 0;
+	#ifdef __AVR__
+	pinMode(BCM_LATCH_PIN, OUTPUT);
+	digitalWrite(BCM_LATCH_PIN, LOW);
+	pinMode(MOSI, OUTPUT);
+	pinMode(SCK, OUTPUT);
+	SPCR = BCM_SPCR;
+	SPSR = _BV(SPI2X);
+	#endif
+	shiftPlane(0);
+	#ifdef __AVR__
+	//CTC on OCR1A, prescaler 8
+	TCCR1A = 0;
+	TCCR1B = _BV(WGM12) | _BV(CS11);
+	TCNT1 = 0;
+	OCR1A = BCM_LSB_COUNTS - 1;
+	TIMSK1 = _BV(OCIE1A);
+	#else
+	hostUnits = 1;
+	hostAttachTimer(hostBcmHook, (BCM_LSB_COUNTS * 8 * 1000000UL / F_CPU) ? (BCM_LSB_COUNTS * 8 * 1000000UL / F_CPU) : 1);
+	#endif
+}
+
+void BcmOutput::set(uint8_t channel, uint16_t value){
+	uint8_t reg = channel >> 3;
+	uint8_t mask = 1 << (channel & 7);
+	//one byte per plane is changed, so the interrupt never sees a half-written byte
+	for(uint8_t k = 0; k < BCM_BITS; k++){
+		if(value & 1){
+			planes[k][reg] |= mask;
+		}else{
+			planes[k][reg] &= ~mask;
+		}
+		value >>= 1;
+	}
+}
+
+uint16_t BcmOutput::get(uint8_t channel){
+	uint8_t reg = channel >> 3;
+	uint8_t mask = 1 << (channel & 7);
+	uint16_t value = 0;
+	for(uint8_t k = BCM_BITS; k > 0; k--){
+		value <<= 1;
+		if(planes[k-1][reg] & mask) value |= 1;
+	}
+	return value;
+}
+
+void BcmOutput::timerEvent(){
+	//show the plane that the last interrupt shifted out
+	uint8_t shown = nextPlane;
+	#ifdef __AVR__
+	BCM_LATCH_PORT |= BCM_LATCH_BIT;
+	BCM_LATCH_PORT &= ~BCM_LATCH_BIT;
+	//the timer restarted from 0 at the compare match, a few cycles before the latch, so every plane is offset alike
+	OCR1A = (BCM_LSB_COUNTS << shown) - 1;
+	#else
+	interrupts++;
+	for(uint8_t r = 0; r < numRegisters; r++){
+		latched[r] = shiftReg[r];
+	}
+	hostUnits = 1 << shown;
+	#endif
+	uint8_t next = shown + 1;
+	if(next >= BCM_BITS) next = 0;
+	nextPlane = next;
+	shiftPlane(next);
+}
+
+//sends one plane, last register first, so that register 0 is the one nearest the end of the chain
+void BcmOutput::shiftPlane(uint8_t plane){
+	const uint8_t* p = planes[plane] + numRegisters;
+	#ifdef __AVR__
+	SPCR = BCM_SPCR;
+	for(uint8_t r = numRegisters; r > 0; r--){
+		SPDR = *--p;
+		while(!(SPSR & _BV(SPIF)));
+	}
+	#else
+	for(uint8_t r = numRegisters; r > 0; r--){
+		--p;
+		shiftReg[r-1] = *p;
+	}
+	bytesShifted += numRegisters;
+	#endif
+}
+
+unsigned long BcmOutput::getInterrupts(){
+	#ifdef __AVR__
+	return 0;
+	#else
+	return interrupts;
+	#endif
+}
+
+unsigned long BcmOutput::getBytesShifted(){
+	#ifdef __AVR__
+	return 0;
+	#else
+	return bytesShifted;
+	#endif
+}
+
+boolean BcmOutput::getLatched(uint8_t channel){
+	#ifdef __AVR__
+	(void)channel;
+	return false;
+	#else
+	return (latched[channel >> 3] >> (channel & 7)) & 1;
+	#endif
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Binary code modulation (BCM) output to a chain of 74HC595 shift registers on the hardware SPI pins (MOSI 11, SCK 13) with
+ * the latch on BCM_LATCH_PIN, i.e. the same wiring as ShiftPWM. An alternative to the ShiftPWM output of the Shaped Brightness
+ * Controller library; see SBC_OUTPUT_BCM in XmasConfig.h.
+ *
+ * PWM in the ShiftPWM style interrupts 2^bits times per frame and, each time, compares every channel with the counter.
+ * BCM instead holds the brightness values as BCM_BITS "bit planes" (bit k of every channel, packed 8 channels to a byte in
+ * shift register order) and shows plane k for 2^k time units. So there are only BCM_BITS interrupts per frame, and each just
+ * sends the bytes of one plane, which set() has already prepared. The interrupt rate no longer depends on the bit depth.
+ * Timer1 runs in CTC mode at F_CPU/8; each interrupt latches the plane shifted out in the previous one, then sets OCR1A to that
+ * plane's duration and shifts out the next plane, so the shifting is hidden behind the plane being shown.
+ *
+ * The shortest plane (BCM_LSB_COUNTS) must outlast one interrupt, i.e. the time to send BCM_MAX_CHANNELS/8 bytes at about
+ * 1.5us per byte (SPI clock F_CPU/2), so bit depth, frame rate and channel count trade off: 8 bits at 120Hz allows up to 136
+ * channels; 10 bits at 75Hz (ShiftPWM's usual rate) up to 32.
+ * On the host the simulator calls the interrupt code from a timer of period BCM_LSB_COUNTS, rounded to whole microseconds,
+ * and the shifted bytes and latches are counted (see host/bench_output.cpp).
+ */
+
+#ifndef BCMOUTPUT_H
+#define BCMOUTPUT_H
+
+#include <Arduino.h>
+
+#ifndef BCM_BITS
+#define BCM_BITS 8 //bit depth, 8..12. The interrupt rate is BCM_BITS * BCM_FRAME_HZ
+#endif
+#ifndef BCM_FRAME_HZ
+#define BCM_FRAME_HZ 120
+#endif
+//multiple of 8; RAM use is BCM_BITS * BCM_MAX_CHANNELS / 8 bytes, and the interrupt sends BCM_MAX_CHANNELS / 8 bytes.
+//By default just enough for NUM_LEDS, where that is defined first (as the sketch does)
+#ifndef BCM_MAX_CHANNELS
+#ifdef NUM_LEDS
+#define BCM_MAX_CHANNELS ((NUM_LEDS + 7) & ~7)
+#else
+#define BCM_MAX_CHANNELS 96
+#endif
+#endif
+#define BCM_LATCH_PIN 8
+#define BCM_MAX_VALUE ((1 << BCM_BITS) - 1)
+//timer counts (F_CPU/8) for the least significant plane
+#define BCM_LSB_COUNTS (F_CPU / 8 / BCM_FRAME_HZ / BCM_MAX_VALUE)
+#define BCM_REGISTERS (BCM_MAX_CHANNELS / 8)
+
+#if (BCM_BITS < 8) || (BCM_BITS > 12)
+#error BCM_BITS must be 8..12
+#endif
+#if (BCM_MAX_CHANNELS % 8) != 0
+#error BCM_MAX_CHANNELS must be a multiple of 8
+#endif
+//the longest plane must fit the 16 bit timer, and the shortest must outlast the interrupt: about 24 cycles per byte and 100 more
+#if (BCM_LSB_COUNTS << (BCM_BITS - 1)) > 65535
+#error BCM_FRAME_HZ is too low for the 16 bit timer
+#endif
+#if (BCM_LSB_COUNTS * 8) < (24 * BCM_REGISTERS + 100)
+#error BCM_FRAME_HZ and BCM_BITS give too short a plane to shift BCM_MAX_CHANNELS
+#endif
+
+class BcmOutput{
+	public:
+		BcmOutput();
+		//set up SPI, the latch pin and Timer1, with all channels off. numChannels may be less than BCM_MAX_CHANNELS
+		void begin(uint8_t numChannels);
+		//0..BCM_MAX_VALUE. Takes effect from the next plane shown, so a channel may show a mix of old and new bits for one frame
+		void set(uint8_t channel, uint16_t value);
+		uint16_t get(uint8_t channel);
+		//called from the timer interrupt
+		void timerEvent();
+		//host-only counts, for bench_output.cpp
+		unsigned long getInterrupts();
+		unsigned long getBytesShifted();
+		//the state of a channel's output as last latched
+		boolean getLatched(uint8_t channel);
+	private:
+		uint8_t numRegisters;
+		uint8_t planes[BCM_BITS][BCM_REGISTERS];//register 0 holds channels 0..7, bit 0 = channel 0
+		uint8_t nextPlane;//the plane that has been shifted out and is latched at the next interrupt
+		void shiftPlane(uint8_t plane);
+		#ifndef __AVR__
+		unsigned long interrupts;
+		unsigned long bytesShifted;
+		uint8_t shiftReg[BCM_REGISTERS];
+		uint8_t latched[BCM_REGISTERS];
+		#endif
+};
+
+#endif
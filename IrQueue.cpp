@@ -0,0 +1,49 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IrQueue.h"
+
+#define IR_QUEUE_MASK (IR_QUEUE_SIZE - 1)
+
+IrQueue::IrQueue(){
+	head = 0;
+	tail = 0;
+	dropped = 0;
+}
+
+boolean IrQueue::push(unsigned long code){
+	uint8_t h = head;
+	uint8_t next = (h + 1) & IR_QUEUE_MASK;
+	if(next == tail){
+		dropped++;
+		return false;
+	}
+	codes[h] = code;
+	head = next;//publish only once the slot is written
+	return true;
+}
+
+boolean IrQueue::pop(unsigned long* code){
+	uint8_t t = tail;
+	if(t == head) return false;
+	*code = codes[t];
+	tail = (t + 1) & IR_QUEUE_MASK;//the slot may be refilled from here on
+	return true;
+}
+
+uint8_t IrQueue::count(){
+	return (head - tail) & IR_QUEUE_MASK;
+}
+
+uint16_t IrQueue::getDropped(){
+	return dropped;
+}
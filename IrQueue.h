@@ -0,0 +1,42 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Queue of decoded IR codes, from the code that receives them to the tick that acts on them.
+ * Single producer, single consumer, without locking: only push() writes head and only pop() writes tail (each one byte, so
+ * read and written atomically), and a slot is filled before head is moved past it. The producer may therefore be an
+ * interrupt handler. When the queue is full a new code is dropped and counted.
+ */
+
+#ifndef IRQUEUE_H
+#define IRQUEUE_H
+
+#include <Arduino.h>
+
+#define IR_QUEUE_SIZE 8 //power of 2; holds IR_QUEUE_SIZE-1 codes
+
+class IrQueue{
+	public:
+		IrQueue();
+		//producer. Returns false if the queue was full
+		boolean push(unsigned long code);
+		//consumer. Returns false if the queue was empty
+		boolean pop(unsigned long* code);
+		uint8_t count();
+		uint16_t getDropped();
+	private:
+		volatile unsigned long codes[IR_QUEUE_SIZE];
+		volatile uint8_t head;//next slot to fill
+		volatile uint8_t tail;//next slot to empty
+		uint16_t dropped;//written by the producer only
+};
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Fixed-width bit set of BITS bits, one per LED, for the trigger/gate mask; also used for the set of changed srcVals.
+ * Replaces a plain integer so that the mask is not limited to 16 LEDs. Only the operations the mask sequencer (TgmSequencer.h)
+ * needs are provided; all of them are simple loops over (BITS+7)/8 bytes, so small sizes cost about the same as the integer did.
+ * Header-only because it is a template.
+ */
+
+#ifndef LEDBITS_H
+#define LEDBITS_H
+
+#include <Arduino.h>
+
+template <uint8_t BITS>
+class LedBits{
+	public:
+		enum {BYTES = (BITS + 7) / 8};
+
+		LedBits(){
+			clear();
+		}
+
+		void clear(){
+			for(uint8_t i=0; i<BYTES; i++) b[i] = 0;
+		}
+
+		//only bit n set
+		void setOnly(uint8_t n){
+			clear();
+			set(n);
+		}
+
+		//bits 0..n-1 set, the rest clear
+		void setLow(uint8_t n){
+			for(uint8_t i=0; i<BYTES; i++){
+				if(n >= 8){
+					b[i] = 0xFF;
+					n -= 8;
+				}else{
+					b[i] = (1 << n) - 1;
+					n = 0;
+				}
+			}
+		}
+
+		void set(uint8_t n){
+			b[n >> 3] |= (1 << (n & 7));
+		}
+
+		void toggle(uint8_t n){
+			b[n >> 3] ^= (1 << (n & 7));
+		}
+
+		boolean test(uint8_t n) const{
+			return (b[n >> 3] >> (n & 7)) & 1;
+		}
+
+		boolean isZero() const{
+			for(uint8_t i=0; i<BYTES; i++){
+				if(b[i]) return false;
+			}
+			return true;
+		}
+
+		//shift towards the MSB by one place; carryIn becomes bit 0. Bits shifted past BITS-1 are lost
+		void shiftUp(boolean carryIn){
+			uint8_t carry = carryIn ? 1 : 0;
+			for(uint8_t i=0; i<BYTES; i++){
+				uint8_t out = b[i] >> 7;
+				b[i] = (b[i] << 1) | carry;
+				carry = out;
+			}
+			trim();
+		}
+
+		//shift towards the LSB by one place
+		void shiftDown(){
+			uint8_t carry = 0;
+			for(uint8_t i=BYTES; i>0; i--){
+				uint8_t out = b[i-1] & 1;
+				b[i-1] = (b[i-1] >> 1) | (carry << 7);
+				carry = out;
+			}
+		}
+
+		void andWith(const LedBits& other){
+			for(uint8_t i=0; i<BYTES; i++) b[i] &= other.b[i];
+		}
+
+		void xorWith(const LedBits& other){
+			for(uint8_t i=0; i<BYTES; i++) b[i] ^= other.b[i];
+		}
+
+		boolean operator==(const LedBits& other) const{
+			for(uint8_t i=0; i<BYTES; i++){
+				if(b[i] != other.b[i]) return false;
+			}
+			return true;
+		}
+
+		boolean operator!=(const LedBits& other) const{
+			return !(*this == other);
+		}
+
+	private:
+		uint8_t b[BYTES];
+
+		//keep unused high bits of the last byte clear, so that comparisons work
+		void trim(){
+			if(BITS & 7) b[BYTES-1] &= (1 << (BITS & 7)) - 1;
+		}
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "MemoryMonitor.h"
+
+#ifdef __AVR__
+//symbols from the linker script and avr-libc's malloc
+extern uint8_t __data_start;
+extern uint8_t _end;//end of .bss, where the heap starts
+extern uint8_t __stack;//top of RAM
+extern char* __brkval;//end of the heap; 0 until malloc() is first used
+
+//runs in the start-up code, before the stack pointer is set up, so in assembler and without a call. Paints _end..__stack
+void memPaint(void) __attribute__((naked, used, section(".init1")));
+void memPaint(void){
+	__asm volatile(
+		"	ldi r30, lo8(_end)\n"
+		"	ldi r31, hi8(_end)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M" (MEM_PAINT));
+}
+
+static uint8_t* heapEnd(){
+	return __brkval ? (uint8_t*)__brkval : &_end;
+}
+#endif
+
+uint16_t MemoryMonitor::staticBytes(){
+	#ifdef __AVR__
+	return &_end - &__data_start;
+	#else
+	return 0;
+	#endif
+}
+
+uint16_t MemoryMonitor::heapBytes(){
+	#ifdef __AVR__
+	return heapEnd() - &_end;
+	#else
+	return 0;
+	#endif
+}
+
+uint16_t MemoryMonitor::freeBytes(){
+	#ifdef __AVR__
+	return SP - (uint16_t)heapEnd();
+	#else
+	return 0;
+	#endif
+}
+
+uint16_t MemoryMonitor::minFreeBytes(){
+	#ifdef __AVR__
+	const uint8_t* p = heapEnd();
+	uint16_t n = 0;
+	while((p <= &__stack) && (*p == MEM_PAINT)){
+		p++;
+		n++;
+	}
+	return n;
+	#else
+	return 0;
+	#endif
+}
+
+#ifndef TELEMETRY
+void MemoryMonitor::dump(){
+	Serial.print(F("MEM "));
+	Serial.print(staticBytes());
+	Serial.print(' ');
+	Serial.print(heapBytes());
+	Serial.print(' ');
+	Serial.print(freeBytes());
+	Serial.print(' ');
+	Serial.println(minFreeBytes());
+}
+#endif
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* SRAM use on the ATmega328P, which has 2KB: static data (.data and .bss), the heap, and how close the stack has come to them.
+ * Before main() (in .init1, before anything is on the stack), every byte from the end of .bss to the top of RAM is painted with
+ * MEM_PAINT. minFreeBytes() counts the painted bytes still intact above the heap: the stack's high-water mark, as headroom. It scans up
+ * to the whole gap (well under a millisecond at 16MHz), so is for the loop() background, not the tick. freeBytes() is the gap between
+ * the heap and the stack pointer now.
+ * The numbers are sent as TEL_MEMORY every TEL_MEMORY_TICKS with TELEMETRY, and printed by dump() (IR CH, or 'p' with PROFILE)
+ * otherwise. On the host there is no AVR memory map and all are 0; host/Makefile's "sram-report" lists the static data instead.
+ */
+
+#ifndef MEMORYMONITOR_H
+#define MEMORYMONITOR_H
+
+#include <Arduino.h>
+
+#define MEM_PAINT 0xC5
+
+class MemoryMonitor{
+	public:
+		//.data + .bss
+		uint16_t staticBytes();
+		uint16_t heapBytes();
+		//between the heap (or .bss) and the stack pointer, now
+		uint16_t freeBytes();
+		//the least there has been since start: painted bytes not yet touched by the stack
+		uint16_t minFreeBytes();
+		#ifndef TELEMETRY
+		//MEM static heap free minfree
+		void dump();
+		#endif
+};
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ModMatrix.h"
+
+ModMatrix::ModMatrix(){
+	for(uint8_t bus=0; bus<MOD_BUSES; bus++){
+		count[bus] = 0;
+	}
+}
+
+void ModMatrix::compile(const uint8_t defs[MOD_BUSES][MOD_BUS_BYTES], uint16_t* srcVals, uint8_t srcCount){
+	for(uint8_t bus=0; bus<MOD_BUSES; bus++){
+		const uint8_t* d = defs[bus];
+		uint8_t n = d[0] & MOD_COUNT_MASK;
+		if(n > MOD_TERMS) n = MOD_TERMS;
+		count[bus] = n | (d[0] & MOD_PRODUCT);
+		for(uint8_t i=0; i<n; i++){
+			uint8_t s = d[1 + 2*i];
+			depth[bus][i] = (signed char)d[2 + 2*i];
+			if(s & 0x80){//SRC_CONST
+				constVals[bus][i] = (s & 0x7F) << 3;
+				src[bus][i] = &constVals[bus][i];
+				srcIndex[bus][i] = MOD_NO_SRC;
+			}else if(s >= srcCount){
+				constVals[bus][i] = 0;
+				src[bus][i] = &constVals[bus][i];
+				srcIndex[bus][i] = MOD_NO_SRC;
+			}else{
+				src[bus][i] = &srcVals[s];
+				srcIndex[bus][i] = s;
+			}
+		}
+	}
+}
+
+uint16_t ModMatrix::evaluate(uint8_t bus) const{
+	uint8_t n = count[bus] & MOD_COUNT_MASK;
+	if(n == 0) return 0;
+	const uint16_t* const* s = src[bus];
+	const signed char* d = depth[bus];
+	if(count[bus] & MOD_PRODUCT){
+		uint32_t acc = 1024;
+		for(uint8_t i=0; i<n; i++){
+			long t = ((long)*s[i] * d[i]) >> 6;
+			if(t <= 0) return 0;
+			if(t > 1023) t = 1023;
+			acc = (acc * t) >> 10;
+		}
+		return acc > 1023 ? 1023 : acc;
+	}
+	long acc = 0;
+	for(uint8_t i=0; i<n; i++){
+		acc += (long)*s[i] * d[i];
+	}
+	acc >>= 6;
+	if(acc < 0) return 0;
+	if(acc > 1023) return 1023;
+	return acc;
+}
+
+uint8_t ModMatrix::terms(uint8_t bus) const{
+	return count[bus] & MOD_COUNT_MASK;
+}
+
+uint8_t ModMatrix::source(uint8_t bus, uint8_t term) const{
+	return srcIndex[bus][term];
+}
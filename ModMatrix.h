@@ -0,0 +1,71 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Modulation matrix: up to MOD_BUSES "mod buses", each a fixed-point sum or product of up to MOD_TERMS sources with signed
+ * 8-bit depths. A bus's output is a source like any other (SRC_MOD_BASE + bus in the sketch), so a patch selects it, and the
+ * rate factor, dirty tracking and so on apply as usual. e.g. "LFO scaled by the LDR" is a product bus of SRC_LFO and SRC_LEV3.
+ *
+ * A depth is in 64ths: 64 = 1.0, -128..127 = -2.0..+1.98. Each term is src * depth / 64.
+ *	sum:		the terms are added, then saturated to 0..1023
+ *	product:	each term is saturated to 0..1023 and the terms multiplied together, 1024 being 1.0
+ * A term's source may be a constant (SRC_CONST bit set), which in a sum is an offset.
+ *
+ * The definitions come from the program image (see PROG_OP_MOD in ProgramDecoder.h), in MOD_BUS_BYTES per bus: count of terms
+ * (0 = unused) | MOD_PRODUCT, then a src, depth pair per term. compile() resolves them to srcVals pointers (only MOD_BUSES * MOD_TERMS).
+ * evaluate() is then one multiply and add per term, in 32 bits; the cost is bounded by MOD_BUSES * MOD_TERMS and does not
+ * depend on the number of LEDs (see host/bench_mod.cpp).
+ */
+
+#ifndef MODMATRIX_H
+#define MODMATRIX_H
+
+#include <Arduino.h>
+
+#ifndef MOD_BUSES
+#define MOD_BUSES 4
+#endif
+#ifndef MOD_TERMS
+#define MOD_TERMS 4
+#endif
+#define MOD_BUS_BYTES (1 + 2*MOD_TERMS)
+#define MOD_PRODUCT 0x80 //flag in the first byte of a bus definition
+#define MOD_COUNT_MASK 0x0F
+#define MOD_NO_SRC 0xFF //source() of a constant term
+#define MOD_UNITY 64 //depth of 1.0
+
+#if (MOD_BUSES < 1) || (MOD_BUSES > 16)
+#error MOD_BUSES must be 1..16
+#endif
+#if (MOD_TERMS < 1) || (MOD_TERMS > MOD_COUNT_MASK)
+#error MOD_TERMS must be 1..15
+#endif
+
+class ModMatrix{
+	public:
+		ModMatrix();
+		//defs is MOD_BUSES definitions of MOD_BUS_BYTES. A term count over MOD_TERMS is cut to MOD_TERMS
+		void compile(const uint8_t defs[MOD_BUSES][MOD_BUS_BYTES], uint16_t* srcVals, uint8_t srcCount);
+		//the current value of a bus, 0..1023
+		uint16_t evaluate(uint8_t bus) const;
+		uint8_t terms(uint8_t bus) const;
+		//the srcVals index of a term, or MOD_NO_SRC if it is constant
+		uint8_t source(uint8_t bus, uint8_t term) const;
+	private:
+		const uint16_t* src[MOD_BUSES][MOD_TERMS];
+		signed char depth[MOD_BUSES][MOD_TERMS];
+		uint8_t srcIndex[MOD_BUSES][MOD_TERMS];
+		uint16_t constVals[MOD_BUSES][MOD_TERMS];
+		uint8_t count[MOD_BUSES];//terms | MOD_PRODUCT
+};
+
+#endif
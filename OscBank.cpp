@@ -0,0 +1,151 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "OscBank.h"
+
+//in mode[], with the wave in the low nibble
+#define OSC_WAVE_MASK 0x0F
+#define OSC_HOLD 0x40
+#define OSC_RESTART 0x80
+
+//511 * sin(i/64 * pi/2), i = 0..64
+static const uint16_t oscQuarterSine[65] PROGMEM = {
+	0, 13, 25, 38, 50, 63, 75, 87, 100, 112, 124, 136, 148, 160, 172, 184, 196, 207, 218, 230, 241, 252, 263, 273, 284, 294,
+	304, 314, 324, 334, 343, 352, 361, 370, 379, 387, 395, 403, 410, 418, 425, 432, 438, 445, 451, 456, 462, 467, 472, 477,
+	481, 485, 489, 492, 496, 499, 501, 503, 505, 507, 509, 510, 510, 511, 511
+};
+
+//the quarter wave at x/16384 of a quarter, x = 0..16384
+static uint16_t quarterSine(uint16_t x){
+	uint8_t i = x >> 8;
+	uint16_t a = pgm_read_word(&oscQuarterSine[i]);
+	if(i == 64) return a;
+	uint16_t b = pgm_read_word(&oscQuarterSine[i + 1]);
+	return a + (((b - a) * (uint8_t)x + 128) >> 8);
+}
+
+//1..1023 for the top 16 bits of phase
+static uint16_t sine(uint16_t p){
+	uint16_t x = p & 0x3FFF;
+	if(p & 0x4000) x = 0x4000 - x;//falling quarters are mirrored
+	uint16_t q = quarterSine(x);
+	return (p & 0x8000) ? 512 - q : 512 + q;
+}
+
+OscBank::OscBank(){
+	srcVals = 0;
+	srcCount = 0;
+	step = 0;
+	for(uint8_t osc=0; osc<OSC_BANK_SIZE; osc++){
+		phase[osc] = 0;
+		constRate[osc] = 0;
+		rateSrc[osc] = &constRate[osc];
+		shift[osc] = 0;
+		mode[osc] = OSC_SINE;
+		randFrom[osc] = 128;
+		randTo[osc] = 128;
+	}
+}
+
+void OscBank::begin(uint16_t* srcVals, uint8_t srcCount, uint32_t step){
+	this->srcVals = srcVals;
+	this->srcCount = srcCount;
+	this->step = step;
+}
+
+void OscBank::setRate(uint8_t osc, uint8_t src, uint8_t preShift, uint8_t postShift){
+	if(src & 0x80){//SRC_CONST
+		constRate[osc] = (src & 0x7F) << 3;
+		rateSrc[osc] = &constRate[osc];
+	}else if(src >= srcCount){
+		constRate[osc] = 0;
+		rateSrc[osc] = &constRate[osc];
+	}else{
+		rateSrc[osc] = &srcVals[src];
+	}
+	shift[osc] = preShift | (postShift << 4);
+}
+
+void OscBank::setWave(uint8_t osc, uint8_t wave){
+	mode[osc] = (mode[osc] & ~OSC_WAVE_MASK) | (wave < OSC_WAVES ? wave : OSC_SINE);
+}
+
+void OscBank::setHold(uint8_t osc, boolean hold){
+	if(hold){
+		mode[osc] |= OSC_HOLD;
+	}else{
+		mode[osc] &= ~OSC_HOLD;
+	}
+}
+
+void OscBank::setRestart(uint8_t osc, boolean restart){
+	if(restart){
+		mode[osc] |= OSC_RESTART;
+	}else{
+		mode[osc] &= ~OSC_RESTART;
+	}
+}
+
+uint16_t OscBank::update(){
+	uint16_t wrapped = 0;
+	uint16_t bit = 1;
+	for(uint8_t osc=0; osc<OSC_BANK_SIZE; osc++, bit <<= 1){
+		uint8_t m = mode[osc];
+		if(m & OSC_HOLD) continue;
+		uint8_t s = shift[osc];
+		uint32_t p = phase[osc];
+		//10 bit rate times a step of at most 2^21 (16Hz) fits 32 bits; the post shift comes after, to keep the step's precision
+		uint32_t next = p + (((uint32_t)(*rateSrc[osc] >> (s & 0x0F)) * step) >> (s >> 4));
+		if(next < p){
+			wrapped |= bit;
+			if(m & OSC_RESTART) next = 0;
+			if((m & OSC_WAVE_MASK) == OSC_RANDOM){
+				randFrom[osc] = randTo[osc];
+				randTo[osc] = random(256);
+			}
+		}
+		phase[osc] = next;
+	}
+	return wrapped;
+}
+
+uint16_t OscBank::value(uint8_t osc) const{
+	uint32_t p = phase[osc];
+	switch(mode[osc] & OSC_WAVE_MASK){
+		case OSC_TRIANGLE:{
+			uint16_t p11 = p >> 21;
+			return (p11 < 1024) ? p11 : 2048 - p11;
+		}
+		case OSC_SAW:
+			return p >> 22;
+		case OSC_SQUARE:
+			return (p & 0x80000000UL) ? 0 : 1023;
+		case OSC_RANDOM:{
+			//0..1023 along the half cosine from 0 to pi, i.e. 1023 - the sine from a quarter to three quarters of a cycle
+			uint16_t ease = 1023 - sine((p >> 17) + 0x4000);
+			int16_t from = randFrom[osc] << 2;
+			int16_t to = randTo[osc] << 2;
+			return from + (int16_t)(((int32_t)(to - from) * ease) >> 10);
+		}
+		default:
+			return sine(p >> 16);
+	}
+}
+
+uint32_t OscBank::getPhase(uint8_t osc) const{
+	return phase[osc];
+}
+
+void OscBank::setPhase(uint8_t osc, uint32_t phase){
+	this->phase[osc] = phase;
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Bank of DDS oscillators, all advanced once per tick by update(). Each has a 32 bit phase accumulator (2^32 = one cycle)
+ * and a rate source (a srcVals index or a SRC_CONST value, resolved once as PatchTable does), and adds
+ *	((rate >> pre shift) * step) >> post shift
+ * each tick, where step is set by begin() for the tick rate (2^21 at 16Hz, i.e. 1/2048 cycle). The sketch's LFO, program
+ * cycling and trigger/gate mask timing are oscillators of the bank, with the pre shifts of the old accumulators, so that they run
+ * exactly as before at 16Hz; the general oscillators use the full 10 bit rate (post shift 4, same speed range as the LFO).
+ *
+ * An oscillator may be held (not advanced), and may restart at 0 when it wraps rather than carry the remainder, for timers
+ * that act once per cycle. update() returns a bit per oscillator that wrapped.
+ *
+ * value() is the waveform at the current phase, 0..1023:
+ *	OSC_SINE		quarter-wave table of 65 points in PROGMEM, linearly interpolated (1..1023)
+ *	OSC_TRIANGLE	from the top 11 bits of phase, as the original LFO (0..1024)
+ *	OSC_SAW, OSC_SQUARE	from the top bits of phase
+ *	OSC_RANDOM		smooth random: a new random level each cycle, eased from the last along a half cosine (from the sine table)
+ * Triangle, saw and square are cheaper to calculate than to look up on the AVR, so have no tables.
+ */
+
+#ifndef OSCBANK_H
+#define OSCBANK_H
+
+#include <Arduino.h>
+
+#ifndef OSC_BANK_SIZE
+#define OSC_BANK_SIZE 7
+#endif
+//the sketch's LFO, program cycling and trigger/gate mask come first, then OSC_COUNT general oscillators (sources SRC_OSC_BASE...)
+#define OSC_GENERAL 3
+#define OSC_COUNT (OSC_BANK_SIZE - OSC_GENERAL)
+#if (OSC_BANK_SIZE <= OSC_GENERAL) || (OSC_BANK_SIZE > 16)
+#error OSC_BANK_SIZE must be 4..16
+#endif
+//step for a tick rate: 1/2048 cycle per tick at 16Hz, and the same cycles per second at any other rate. At most 2^21 (16Hz)
+#define OSC_STEP(tickHz) ((33554432UL + (tickHz) / 2) / (tickHz))
+
+//waves
+#define OSC_SINE 0
+#define OSC_TRIANGLE 1
+#define OSC_SAW 2
+#define OSC_SQUARE 3
+#define OSC_RANDOM 4
+#define OSC_WAVES 5
+
+class OscBank{
+	public:
+		OscBank();
+		//srcVals (srcCount of them) are where rate sources are read; step is the phase added per tick for a rate of 1
+		void begin(uint16_t* srcVals, uint8_t srcCount, uint32_t step);
+		//the rate source and its shifts (see above). All oscillators start at rate SRC_OFF, sine, phase 0
+		void setRate(uint8_t osc, uint8_t src, uint8_t preShift, uint8_t postShift);
+		void setWave(uint8_t osc, uint8_t wave);
+		void setHold(uint8_t osc, boolean hold);
+		void setRestart(uint8_t osc, boolean restart);
+		//advance every oscillator that is not held; returns a bit per oscillator that wrapped (1 << osc)
+		uint16_t update();
+		uint16_t value(uint8_t osc) const;
+		uint32_t getPhase(uint8_t osc) const;
+		//e.g. to follow another board's oscillator (see SyncLink.h)
+		void setPhase(uint8_t osc, uint32_t phase);
+	private:
+		uint16_t* srcVals;
+		uint8_t srcCount;
+		uint32_t step;
+		uint32_t phase[OSC_BANK_SIZE];
+		const uint16_t* rateSrc[OSC_BANK_SIZE];
+		uint16_t constRate[OSC_BANK_SIZE];
+		uint8_t shift[OSC_BANK_SIZE];//pre shift | post shift << 4
+		uint8_t mode[OSC_BANK_SIZE];//wave | OSC_HOLD | OSC_RESTART
+		uint8_t randFrom[OSC_BANK_SIZE];//OSC_RANDOM levels, >>2
+		uint8_t randTo[OSC_BANK_SIZE];
+};
+
+#endif
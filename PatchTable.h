@@ -0,0 +1,103 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The patches, "compiled" into a form that is cheap to evaluate every tick.
+ * compile() is called whenever the patches change (i.e. in loadProgram()). Each parameter keeps one byte per LED: a srcVals
+ * index, or a constant (bit 7 set, as SRC_CONST, with the value in the low bits). An out-of-range source index becomes the
+ * constant 0. A constant is read as (v & 0x7F) << 3, as the patch would be, so it needs no storage of its own.
+ * The rate factor is pre-classified into a limit and up/down shift counts (a nibble each, in one byte). A rate that would
+ * overflow 16 bits when shifted up saturates at 0xFFFF instead of wrapping. A constant rate is folded completely, including its
+ * rate factor, into the limit, and marked by PATCH_RATE_CONST in place of the shifts.
+ * So 6 bytes per LED: evaluation is one load and a test per parameter, plus a compare and shifts for the rate.
+ * The srcVals index behind each parameter is also what source() gives, so that the tick can skip parameters whose source has not
+ * changed; constants have none (PATCH_NO_SRC) and never change.
+ * Header-only because it is a template.
+ */
+
+#ifndef PATCHTABLE_H
+#define PATCHTABLE_H
+
+#include <Arduino.h>
+
+#define PATCH_NO_SRC 0xFF //source() of a parameter that is constant
+#define PATCH_CONST 0x80 //set in an index that is a constant
+#define PATCH_RATE_CONST 0xFF //rateShift of a folded constant rate; no rate factor shifts both up and down
+
+template <uint8_t LEDS>
+class PatchTable{
+	public:
+		//srcPatches[param][led] are srcVals indeces (or SRC_CONST values); param order is rate, scale, trigger/gate
+		void compile(const uint8_t srcPatches[3][LEDS], const signed char* rateFactor, const uint16_t* srcVals, uint8_t srcCount){
+			vals = srcVals;
+			for(uint8_t led=0; led<LEDS; led++){
+				for(uint8_t param=0; param<3; param++){
+					uint8_t src = srcPatches[param][led];
+					index[param][led] = ((src & PATCH_CONST) || src < srcCount) ? src : PATCH_CONST;
+				}
+				signed char rf = rateFactor[led];
+				uint8_t up = 0;
+				uint8_t down = 0;
+				rateLimit[led] = 0xFFFF;
+				if(rf >= 16){
+					rateLimit[led] = 0;//anything but 0 saturates
+				}else if(rf > 0){
+					up = rf;
+					rateLimit[led] = 0xFFFF >> rf;
+				}else if(rf <= -16){
+					index[0][led] = PATCH_CONST;
+				}else if(rf < 0){
+					down = -rf;
+				}
+				rateShift[led] = (up << 4) | down;
+				//fold a constant rate, so that it costs no more than any other constant
+				if(index[0][led] & PATCH_CONST){
+					rateLimit[led] = rate(led);
+					rateShift[led] = PATCH_RATE_CONST;
+				}
+			}
+		}
+
+		inline uint16_t rate(uint8_t led) const{
+			uint8_t shift = rateShift[led];
+			if(shift == PATCH_RATE_CONST) return rateLimit[led];
+			uint16_t v = value(index[0][led]);
+			if(v > rateLimit[led]) return 0xFFFF;
+			v <<= shift >> 4;
+			return v >> (shift & 0x0F);
+		}
+
+		inline uint16_t scale(uint8_t led) const{
+			return value(index[1][led]);
+		}
+
+		inline uint16_t triggerIP(uint8_t led) const{
+			return value(index[2][led]);
+		}
+
+		//the srcVals index that a parameter (0 rate, 1 scale, 2 trigger/gate) is read from, or PATCH_NO_SRC
+		inline uint8_t source(uint8_t param, uint8_t led) const{
+			uint8_t i = index[param][led];
+			return (i & PATCH_CONST) ? PATCH_NO_SRC : i;
+		}
+
+	private:
+		const uint16_t* vals;
+		uint8_t index[3][LEDS];
+		uint16_t rateLimit[LEDS];//or the value of a constant rate
+		uint8_t rateShift[LEDS];//up << 4 | down, or PATCH_RATE_CONST
+
+		inline uint16_t value(uint8_t i) const{
+			return (i & PATCH_CONST) ? (uint16_t)((i & 0x7F) << 3) : vals[i];
+		}
+};
+
+#endif
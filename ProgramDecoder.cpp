@@ -0,0 +1,212 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProgramDecoder.h"
+
+//op value while the rest of the program is being ignored (after an unknown op, whose length cannot be known)
+#define OP_SKIP 0xFF
+
+void ProgramDecoder::begin(uint8_t format, uint8_t* image, uint8_t numLeds, ProgramStore* store, word dictAddr, uint8_t dictCount){
+	this->format = format;
+	this->image = image;
+	this->numLeds = numLeds;
+	this->store = store;
+	this->dictAddr = dictAddr;
+	this->dictCount = dictCount;
+	pos = 0;
+	op = 0;
+	argCount = 0;
+	bad = false;
+	if(format == PROG_FORMAT_COMPACT){
+		//the default every compact program starts from
+		memset(image, 0xFF, 8);
+		uint8_t* p = image + 8;
+		for(uint8_t led=0; led<numLeds; led++){
+			p[0] = 0;
+			p[1] = 0xFF;
+			p[2] = 0;
+			p[3] = 0;
+			p += 4;
+		}
+		memset(p, 0, numLeds*4);
+	}
+	//no mod buses, the oscillators stopped and no mask program (a legacy image has none of them)
+	memset(image + 8 + (word)numLeds*8, 0, PROG_IMAGE_BYTES(numLeds) - (8 + (word)numLeds*8));
+}
+
+void ProgramDecoder::feed(uint8_t b){
+	if(format != PROG_FORMAT_COMPACT){
+		if(pos < 8 + (word)numLeds*8) image[pos++] = b;
+		return;
+	}
+	if(pos < 3){
+		//LFO rate src, TGM rate src, TGM pattern
+		image[pos==0 ? 0 : pos+3] = b;
+		pos++;
+		return;
+	}
+	if(op == OP_SKIP) return;
+	if(op == 0){
+		op = b;
+		argCount = 0;
+		uint8_t patchLen = (b & PROG_OP_PATCH_REF) ? 1 : 4;
+		//only the ops that carry a patch may take PROG_OP_PATCH_REF; execute() tells MOD, OSC and TGM by their exact value
+		switch(b){
+			case PROG_OP_ALL:
+			case PROG_OP_ALL | PROG_OP_PATCH_REF:
+				argLen = 3 + patchLen;
+				break;
+			case PROG_OP_TRIPLE:
+			case PROG_OP_TRIPLE | PROG_OP_PATCH_REF:
+				argLen = 5 + patchLen;
+				break;
+			case PROG_OP_LED:
+			case PROG_OP_LED | PROG_OP_PATCH_REF:
+				argLen = 4 + patchLen;
+				break;
+			case PROG_OP_MOD:
+				argLen = 4;//until the term count is known
+				break;
+			case PROG_OP_OSC:
+				argLen = 2;
+				break;
+			case PROG_OP_TGM:
+				argLen = 1;//until the length is known
+				break;
+			default:
+				op = OP_SKIP;
+				bad = true;
+		}
+		return;
+	}
+	args[argCount++] = b;
+	if(op == PROG_OP_MOD && argCount == 4){
+		if(b > MOD_TERMS){
+			op = OP_SKIP;
+			bad = true;
+			return;
+		}
+		argLen = 4 + 2*b;
+	}
+	if(op == PROG_OP_TGM && argCount == 1){
+		if(b > TGS_CODE_BYTES){
+			op = OP_SKIP;
+			bad = true;
+			return;
+		}
+		argLen = 1 + b;
+	}
+	if(argCount == argLen){
+		execute();
+		op = 0;
+	}
+}
+
+boolean ProgramDecoder::error(){
+	return bad;
+}
+
+void ProgramDecoder::execute(){
+	uint8_t* a = args;
+	int step = 0;
+	uint8_t onlyLed = 0;
+	uint8_t baseOp = op & ~PROG_OP_PATCH_REF;
+	if(op == PROG_OP_MOD){
+		setMod();
+		return;
+	}
+	if(op == PROG_OP_OSC){
+		uint8_t osc = a[0] & 0x0F;
+		uint8_t wave = a[0] >> 4;
+		if(osc >= OSC_COUNT || wave >= OSC_WAVES){
+			bad = true;
+			return;
+		}
+		uint8_t* p = image + 8 + (word)numLeds*8 + MOD_BUSES*MOD_BUS_BYTES + osc*2;
+		p[0] = wave;
+		p[1] = a[1];
+		return;
+	}
+	if(op == PROG_OP_TGM){
+		memcpy(image + PROG_TGM_CODE_OFFSET(numLeds), a, 1 + a[0]);
+		return;
+	}
+	if(baseOp == PROG_OP_TRIPLE){
+		step = (a[0] << 8) | a[1];
+		a += 2;
+	}else if(baseOp == PROG_OP_LED){
+		onlyLed = a[0];
+		a++;
+	}
+	const uint8_t* pattern = a;
+	uint8_t patch[4];
+	if(op & PROG_OP_PATCH_REF){
+		if(a[3] >= dictCount){
+			bad = true;
+			return;
+		}
+		word addr = dictAddr + a[3]*4;
+		store->readBytes(&addr, patch, 4);
+	}else{
+		memcpy(patch, a+3, 4);
+	}
+
+	if(baseOp == PROG_OP_LED){
+		if(onlyLed >= numLeds){
+			bad = true;
+			return;
+		}
+		setLed(onlyLed, pattern, 0, patch, false);
+	}else{
+		uint8_t inTriple = 0;
+		for(uint8_t led=0; led<numLeds; led++){
+			setLed(led, pattern, step*inTriple, patch, true);
+			if(++inTriple == 3) inTriple = 0;
+		}
+	}
+}
+
+void ProgramDecoder::setLed(uint8_t led, const uint8_t* pattern, int phaseOffset, const uint8_t* patch, boolean replicated){
+	uint8_t* p = image + 8 + led*4;
+	int phase = ((pattern[1] << 8) | pattern[2]) + phaseOffset;
+	p[0] = pattern[0];
+	p[1] = 0xFF;
+	p[2] = (uint8_t)(phase >> 8);
+	p[3] = (uint8_t)phase;
+	p = image + 8 + (word)numLeds*4 + led*4;
+	memcpy(p, patch, 4);
+	if(replicated && (patch[3] == PROG_TG_MASK_BASE)){
+		p[3] = PROG_TG_MASK_BASE + led;
+	}
+}
+
+void ProgramDecoder::setMod(){
+	uint8_t bus = args[0] & ~MOD_PRODUCT;
+	uint8_t led = args[1];
+	uint8_t param = args[2];
+	if(bus >= MOD_BUSES || (led >= numLeds && led != PROG_MOD_ALL_LEDS) || (param > 2 && param != PROG_MOD_NO_PARAM)){
+		bad = true;
+		return;
+	}
+	uint8_t* def = image + 8 + (word)numLeds*8 + bus*MOD_BUS_BYTES;
+	memset(def, 0, MOD_BUS_BYTES);
+	def[0] = args[3] | (args[0] & MOD_PRODUCT);
+	memcpy(def + 1, args + 4, 2*args[3]);
+	if(param == PROG_MOD_NO_PARAM) return;
+	//patch block bytes: rate src, rate factor, scale src, trigger/gate src
+	uint8_t offset = (param == 0) ? 0 : param + 1;
+	for(uint8_t i=0; i<numLeds; i++){
+		if(led == PROG_MOD_ALL_LEDS || led == i){
+			image[8 + (word)numLeds*4 + i*4 + offset] = PROG_SRC_MOD_BASE(numLeds) + bus;
+		}
+	}
+}
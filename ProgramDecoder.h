@@ -0,0 +1,110 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Streaming decoder for programs held in EEPROM. Bytes are fed in one at a time (in any size of chunk, so that a program
+ * can be decoded a few bytes per loop() pass) and are decoded into an "image" with the legacy layout:
+ *	LFO block (rate src, -, -, -), TGM block (rate src, pattern, -, -), numLeds pattern blocks, numLeds patch blocks
+ * ("-" bytes are 0xFF, as in the legacy EEPROM files). Pattern blocks are sbc prog bytes; patch blocks are rate src, rate factor,
+ * scale src, trigger/gate src. The image ends with the modulation matrix (MOD_BUSES bus definitions, see ModMatrix.h) and the
+ * general oscillators (OSC_COUNT of wave, rate src; see OscBank.h) and a trigger/gate mask program (length, then
+ * TGS_CODE_BYTES; see TgmSequencer.h), which only the compact format can set; otherwise every bus is unused, every oscillator
+ * a sine at rate SRC_OFF and the mask program empty. PROG_IMAGE_BYTES is the whole image.
+ *
+ * EEPROM header (8 bytes): NUM_LEDS, program count, program cycling rate src, format, then for PROG_FORMAT_COMPACT the number of
+ * dictionary entries. Unused header bytes are 0.
+ *
+ * PROG_FORMAT_LEGACY: programs follow the header, each a plain image (8+NUM_LEDS*8 bytes).
+ *
+ * PROG_FORMAT_COMPACT: a dictionary of 4-byte patch blocks follows the header, then the programs, each being a 2-byte length
+ * (MSB first, not counting itself) and then:
+ *	LFO rate src, TGM rate src, TGM pattern, and a sequence of operations, applied in order.
+ * Before the first operation every LED is OFF with all patch sources SRC_OFF. The operations are one op byte followed by
+ * a pattern (shape, phase MSB, phase LSB) and a patch (4 bytes, or with PROG_OP_PATCH_REF set, a 1 byte dictionary index):
+ *	PROG_OP_ALL		pattern, patch: copied to all LEDs
+ *	PROG_OP_TRIPLE	phase step (2 bytes MSB first), pattern, patch: copied to all LEDs, with the phase advanced by the step
+ *					for the second and third LED of each RGB triple (i.e. as programTriple())
+ *	PROG_OP_LED		LED index, pattern, patch: one LED
+ * In ALL and TRIPLE, a trigger/gate src of PROG_TG_MASK_BASE becomes the mask value for each LED (as programAll()).
+ * One more op defines a mod bus, without a pattern or patch:
+ *	PROG_OP_MOD		bus | MOD_PRODUCT, LED index (PROG_MOD_ALL_LEDS for all), parameter (0 rate, 1 scale, 2 trigger/gate, or
+ *					PROG_MOD_NO_PARAM), term count, then a src, depth pair per term.
+ *					The parameter of the LED(s) is patched to the bus, i.e. to src PROG_SRC_MOD_BASE(numLeds) + bus; the rate
+ *					factor is left as it is. A later op may patch more LEDs to the bus (as a src).
+ * and another sets up a general oscillator:
+ *	PROG_OP_OSC		oscillator | wave << 4, rate src. The oscillator is the source PROG_SRC_OSC_BASE(numLeds) + oscillator
+ * and another gives the program its own trigger/gate mask program, run when the TGM pattern is PROG_TGM_CODE:
+ *	PROG_OP_TGM		length (up to TGS_CODE_BYTES), then the mask program
+ * The encoder is host/encode_programs.cpp.
+ */
+
+#ifndef PROGRAMDECODER_H
+#define PROGRAMDECODER_H
+
+#include <Arduino.h>
+#include "ProgramStore.h"
+#include "ModMatrix.h"
+#include "OscBank.h"
+#include "TgmSequencer.h"
+
+//format, in header byte 3
+#define PROG_FORMAT_LEGACY 0
+#define PROG_FORMAT_COMPACT 1
+//compact ops
+#define PROG_OP_ALL 0x10
+#define PROG_OP_TRIPLE 0x20
+#define PROG_OP_LED 0x30
+#define PROG_OP_MOD 0x40
+#define PROG_OP_OSC 0x50
+#define PROG_OP_TGM 0x60
+#define PROG_MOD_ALL_LEDS 0xFF
+#define PROG_MOD_NO_PARAM 0xFF
+#define PROG_OP_PATCH_REF 0x01 //flag: the patch is a dictionary index
+//= SRC_TG_MASK_BASE
+#define PROG_TG_MASK_BASE 0x10
+//= TGM_CODE: the TGM pattern that runs the program's own mask program
+#define PROG_TGM_CODE 5
+//= SRC_MOD_BASE: the mod buses follow the trigger/gate mask sources and SRC_BEAT
+#define PROG_SRC_MOD_BASE(numLeds) (PROG_TG_MASK_BASE + (numLeds) + 1)
+//= SRC_OSC_BASE
+#define PROG_SRC_OSC_BASE(numLeds) (PROG_SRC_MOD_BASE(numLeds) + MOD_BUSES)
+#define PROG_MAX(a, b) ((a) > (b) ? (a) : (b))
+//offset of the mask program in an image
+#define PROG_TGM_CODE_OFFSET(numLeds) (8 + (numLeds)*8 + MOD_BUSES*MOD_BUS_BYTES + OSC_COUNT*2)
+#define PROG_IMAGE_BYTES(numLeds) (PROG_TGM_CODE_OFFSET(numLeds) + 1 + TGS_CODE_BYTES)
+
+class ProgramDecoder{
+	public:
+		//start decoding a program into image (PROG_IMAGE_BYTES(numLeds)). The dictionary (compact format only) is dictCount entries at dictAddr in store
+		void begin(uint8_t format, uint8_t* image, uint8_t numLeds, ProgramStore* store, word dictAddr, uint8_t dictCount);
+		void feed(uint8_t b);
+		//true if an unknown op or a bad LED/dictionary index was met. The image is still usable; the faulty op was skipped
+		boolean error();
+	private:
+		uint8_t* image;
+		uint8_t numLeds;
+		uint8_t format;
+		ProgramStore* store;
+		word dictAddr;
+		uint8_t dictCount;
+		word pos;//bytes fed so far (legacy), or header bytes fed (compact)
+		uint8_t op;//current op, 0 = expecting an op byte
+		uint8_t argLen;//bytes of argument that the op takes
+		uint8_t argCount;//bytes of argument received
+		//room for the longest arguments: of a mod bus, a mask program, or a TRIPLE
+		uint8_t args[PROG_MAX(PROG_MAX(4 + 2*MOD_TERMS, 1 + TGS_CODE_BYTES), 9)];
+		boolean bad;
+		void execute();
+		void setLed(uint8_t led, const uint8_t* pattern, int phaseOffset, const uint8_t* patch, boolean replicated);
+		void setMod();
+};
+
+#endif
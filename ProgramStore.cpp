@@ -0,0 +1,153 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ProgramStore.h"
+#include <EEPROM.h>
+#include <Wire.h>
+
+#ifdef __AVR__
+#include <avr/eeprom.h>
+#define PSTORE_INTERNAL_READY() eeprom_is_ready()
+#else
+#include "HostSim.h"
+#define PSTORE_INTERNAL_READY() (HostSim::nowMicros() >= HostSim::eepromBusyUntil)
+#endif
+
+ProgramStore::ProgramStore(){
+	i2cAddr = 0;
+	i2cSize = 0;
+	lastLine = 0;
+	fetches = 0;
+	errors = 0;
+	invalidate();
+}
+
+void ProgramStore::beginInternal(){
+	i2cAddr = 0;
+	invalidate();
+}
+
+boolean ProgramStore::beginI2C(uint8_t i2cAddress, unsigned long size){
+	Wire.begin();
+	Wire.beginTransmission(i2cAddress);
+	if(Wire.endTransmission() != 0){
+		return false;
+	}
+	i2cAddr = i2cAddress;
+	i2cSize = size;
+	invalidate();
+	return true;
+}
+
+boolean ProgramStore::isI2C(){
+	return i2cAddr != 0;
+}
+
+uint8_t ProgramStore::read(word address){
+	if(i2cAddr == 0){
+		return EEPROM.read(address);
+	}
+	word base = address & ~(word)(PSTORE_LINE_BYTES - 1);
+	uint8_t line;
+	for(line = 0; line < PSTORE_LINES; line++){
+		if(lineValid[line] && (lineAddr[line] == base)) break;
+	}
+	if(line == PSTORE_LINES){
+		line = (lastLine + 1) % PSTORE_LINES;
+		fetch(line, base);
+	}
+	lastLine = line;
+	return lineData[line][address - base];
+}
+
+void ProgramStore::readBytes(word* address, uint8_t* buff, uint8_t count){
+	for(uint8_t i = 0; i < count; i++){
+		buff[i] = read((*address)++);
+	}
+}
+
+word ProgramStore::readWord(word* address){
+	word v = read((*address)++) << 8;
+	v |= read((*address)++);
+	return v;
+}
+
+void ProgramStore::invalidate(){
+	for(uint8_t line = 0; line < PSTORE_LINES; line++){
+		lineValid[line] = false;
+	}
+}
+
+unsigned long ProgramStore::capacity(){
+	return (i2cAddr == 0) ? E2END + 1UL - PSTORE_RESERVED_BYTES : i2cSize;
+}
+
+boolean ProgramStore::ready(){
+	if(i2cAddr == 0){
+		return PSTORE_INTERNAL_READY();
+	}
+	//acknowledge polling: the device only answers once its write cycle is over
+	Wire.beginTransmission(i2cAddr);
+	return Wire.endTransmission() == 0;
+}
+
+uint8_t ProgramStore::write(word address, const uint8_t* data, uint8_t count){
+	if(count == 0) return 0;
+	if(i2cAddr == 0){
+		if(!PSTORE_INTERNAL_READY()) return 0;
+		if(EEPROM.read(address) != data[0]){
+			EEPROM.write(address, data[0]);
+		}
+		return 1;
+	}
+	uint8_t n = PSTORE_PAGE_BYTES - (address & (PSTORE_PAGE_BYTES - 1));
+	if(n > count) n = count;
+	invalidate();
+	Wire.beginTransmission(i2cAddr);
+	Wire.write((uint8_t)(address >> 8));
+	Wire.write((uint8_t)address);
+	for(uint8_t i = 0; i < n; i++){
+		Wire.write(data[i]);
+	}
+	return (Wire.endTransmission() == 0) ? n : 0;
+}
+
+uint16_t ProgramStore::getFetches(){
+	return fetches;
+}
+
+uint16_t ProgramStore::getErrors(){
+	return errors;
+}
+
+//one sequential read of a whole line. A failed read is not cached, so that it is retried next time
+void ProgramStore::fetch(uint8_t line, word base){
+	fetches++;
+	uint8_t got = 0;
+	Wire.beginTransmission(i2cAddr);
+	Wire.write((uint8_t)(base >> 8));
+	Wire.write((uint8_t)base);
+	if(Wire.endTransmission() == 0){
+		Wire.requestFrom(i2cAddr, (uint8_t)PSTORE_LINE_BYTES);
+		while(Wire.available() && (got < PSTORE_LINE_BYTES)){
+			lineData[line][got++] = Wire.read();
+		}
+	}
+	lineAddr[line] = base;
+	lineValid[line] = (got == PSTORE_LINE_BYTES);
+	if(!lineValid[line]){
+		errors++;
+		while(got < PSTORE_LINE_BYTES){
+			lineData[line][got++] = 0xFF;
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Where the programs are read from: the internal EEPROM, or a 24LCxx-style I2C EEPROM (up to 64KB, 2-byte addressing, e.g. 24LC256/512).
+ * The image layout is the same in both (see ProgramDecoder.h).
+ * I2C reads go through a cache of PSTORE_LINES lines of PSTORE_LINE_BYTES. A miss fetches the whole aligned line as one sequential read
+ * (an address write then one read of the line), rather than an address write and read per byte. There are two lines so that
+ * dictionary look-ups while a program is decoded do not evict the line the program is being streamed from.
+ * The internal EEPROM is read directly; it is as fast as the cache would be.
+ * Writing (for ProgramUpload.h) never waits for the device: write() starts one write, of a byte of the internal EEPROM or a page
+ * of an I2C EEPROM, and ready() says when the device has finished it and can take the next.
+ */
+
+#ifndef PROGRAMSTORE_H
+#define PROGRAMSTORE_H
+
+#include <Arduino.h>
+
+//bytes per cache line; must not exceed the Wire library buffer (32)
+#define PSTORE_LINE_BYTES 16
+#define PSTORE_LINES 2
+//bytes per I2C page write. The page size of the 2-byte-address parts is 32 bytes or more; 16 keeps within the Wire buffer
+//with the address, and any page write within one aligned block of 16 bytes is within a page
+#define PSTORE_PAGE_BYTES 16
+//bytes at the top of the internal EEPROM that are not for programs: the state journal (StateJournal.h)
+#define PSTORE_RESERVED_BYTES 128
+
+class ProgramStore{
+	public:
+		ProgramStore();
+		//read from the internal EEPROM
+		void beginInternal();
+		//read from the I2C EEPROM of size bytes at i2cAddress (0x50 for A0..A2 low). Returns false, leaving the store as it was, if no
+		//device answers
+		boolean beginI2C(uint8_t i2cAddress, unsigned long size);
+		boolean isI2C();
+		uint8_t read(word address);
+		//read count bytes from *address into buff, advancing *address past them (as EEPROMUtils::loadBytes)
+		void readBytes(word* address, uint8_t* buff, uint8_t count);
+		//read a 2-byte value, MSB first, advancing *address
+		word readWord(word* address);
+		//drop the cached lines; call after the device has been written other than by write()
+		void invalidate();
+		//bytes for programs: the internal EEPROM's size less PSTORE_RESERVED_BYTES, or the size given to beginI2C() (a part smaller
+		//than that would wrap writes round onto the header)
+		unsigned long capacity();
+		//false while the device is still busy with the last write: 3.4ms per byte of the internal EEPROM, about 5ms per page of an
+		//I2C EEPROM, during which it does not acknowledge its address
+		boolean ready();
+		//if ready(), starts writing from data to address, and returns the number of bytes taken: one byte of the internal
+		//EEPROM (not written if it already holds the value), or up to the end of the PSTORE_PAGE_BYTES block of an I2C EEPROM.
+		//Returns 0 if not ready or if the I2C EEPROM did not acknowledge. Drops the cached lines
+		uint8_t write(word address, const uint8_t* data, uint8_t count);
+		//I2C statistics: line fetches, and fetches that failed (the bytes then read as 0xFF, so a reader that must not take those
+		//for data checks whether the count has changed; the sketch reads a program again)
+		uint16_t getFetches();
+		uint16_t getErrors();
+	private:
+		uint8_t i2cAddr;//0 = internal EEPROM
+		unsigned long i2cSize;
+		word lineAddr[PSTORE_LINES];
+		boolean lineValid[PSTORE_LINES];
+		uint8_t lineData[PSTORE_LINES][PSTORE_LINE_BYTES];
+		uint8_t lastLine;//most recently used line; the other is replaced on a miss
+		uint16_t fetches;
+		uint16_t errors;
+		void fetch(uint8_t line, word base);
+};
+
+#endif
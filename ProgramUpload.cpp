@@ -0,0 +1,220 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ProgramUpload.h"
+
+//command receiver states
+#define UPL_RX_SYNC 0
+#define UPL_RX_TYPE 1
+#define UPL_RX_LEN 2
+#define UPL_RX_PAYLOAD 3
+#define UPL_RX_SUM 4
+
+ProgramUpload::ProgramUpload(){
+	telemetry = 0;
+	store = 0;
+	numLeds = 0;
+	rxState = UPL_RX_SYNC;
+	rxType = 0;
+	rxLen = 0;
+	rxPos = 0;
+	rxSum = 0;
+	cmd = 0;
+	addr = 0;
+	len = 0;
+	done = 0;
+	started = 0;
+	commitProgram = 0;
+	session = false;
+	countCleared = false;
+	lastCommand = 0;
+	errors = 0;
+}
+
+void ProgramUpload::begin(Telemetry* telemetry, ProgramStore* store, uint8_t numLeds){
+	this->telemetry = telemetry;
+	this->store = store;
+	this->numLeds = numLeds;
+}
+
+boolean ProgramUpload::poll(){
+	if(cmd != 0){
+		return stepWrite();
+	}
+	if(session && (millis() - lastCommand > UPL_TIMEOUT_MS)){
+		session = false;//the uploader has gone away
+		if(countCleared){
+			//the store is left part written with no programs, which the sketch takes up as a commit of none
+			data[0] = 0;
+			data[1] = store->read(2);
+			commitProgram = 0;
+			return true;
+		}
+	}
+	//take in bytes until a command starts a write; the rest wait in the receive buffer
+	int c;
+	while((cmd == 0) && ((c = telemetry->read()) >= 0)){
+		uint8_t b = c;
+		switch(rxState){
+			case UPL_RX_SYNC:
+				if(b == TEL_SYNC) rxState = UPL_RX_TYPE;
+				break;
+			case UPL_RX_TYPE:
+				rxType = b;
+				rxSum = b;
+				rxState = UPL_RX_LEN;
+				break;
+			case UPL_RX_LEN:
+				if(b > UPL_MAX_PAYLOAD){
+					errors++;
+					rxState = (b == TEL_SYNC) ? UPL_RX_TYPE : UPL_RX_SYNC;
+					break;
+				}
+				rxLen = b;
+				rxSum += b;
+				rxPos = 0;
+				rxState = (b == 0) ? UPL_RX_SUM : UPL_RX_PAYLOAD;
+				break;
+			case UPL_RX_PAYLOAD:
+				payload[rxPos++] = b;
+				rxSum += b;
+				if(rxPos == rxLen) rxState = UPL_RX_SUM;
+				break;
+			case UPL_RX_SUM:
+				rxState = UPL_RX_SYNC;
+				if((uint8_t)(rxSum + b) != 0){
+					errors++;
+					break;
+				}
+				command();
+				break;
+		}
+	}
+	return false;
+}
+
+boolean ProgramUpload::active(){
+	return session;
+}
+
+void ProgramUpload::getCommit(uint8_t* programCount, uint8_t* pcRateSrc, uint8_t* program){
+	*programCount = data[0];
+	*pcRateSrc = data[1];
+	*program = commitProgram;
+}
+
+uint16_t ProgramUpload::getErrors(){
+	return errors;
+}
+
+//acts on the command in payload
+void ProgramUpload::command(){
+	lastCommand = millis();
+	switch(rxType){
+		case UPL_HELLO:
+			if(telemetry->open(TEL_UPLOAD, 13)){
+				telemetry->put8(UPL_HELLO);
+				telemetry->put8(UPL_OK);
+				telemetry->put16(0);
+				telemetry->put8(numLeds);
+				telemetry->put8(store->isI2C() ? 1 : 0);
+				telemetry->put16(store->capacity() >> 4);
+				for(word a = 0; a < 5; a++){
+					telemetry->put8(store->read(a));
+				}
+				telemetry->close();
+			}
+			break;
+		case UPL_WRITE:{
+			if(rxLen < 3){
+				reply(UPL_WRITE, UPL_BAD_COMMAND, 0);
+				break;
+			}
+			word address = payload[0] | (payload[1] << 8);
+			if((address < UPL_FIRST_ADDRESS) || ((unsigned long)address + rxLen - 2 > store->capacity())){
+				reply(UPL_WRITE, UPL_BAD_ADDRESS, address);
+				break;
+			}
+			session = true;
+			startWrite(UPL_WRITE, address, payload + 2, rxLen - 2);
+			break;
+		}
+		case UPL_COMMIT:
+			if(rxLen != 3){
+				reply(UPL_COMMIT, UPL_BAD_COMMAND, 0);
+				break;
+			}
+			commitProgram = payload[2];
+			startWrite(UPL_COMMIT, 1, payload, 2);//header bytes 1 and 2
+			break;
+		default:
+			reply(rxType, UPL_BAD_COMMAND, 0);
+	}
+}
+
+void ProgramUpload::startWrite(uint8_t type, word address, const uint8_t* bytes, uint8_t count){
+	cmd = type;
+	addr = address;
+	memcpy(data, bytes, count);
+	len = count;
+	done = 0;
+	started = millis();
+}
+
+//starts the next write if the store is ready, and once all are done, reads back and replies. Returns true for a verified commit
+boolean ProgramUpload::stepWrite(){
+	uint8_t type = cmd;
+	if(millis() - started > UPL_WRITE_MS){
+		cmd = 0;
+		reply(type, UPL_WRITE_FAILED, addr);
+		return false;
+	}
+	if(!store->ready()) return false;
+	if((type == UPL_WRITE) && !countCleared){
+		//the first write since the last commit: no programs until the next one
+		const uint8_t zero = 0;
+		if(store->write(1, &zero, 1)) countCleared = true;
+		return false;
+	}
+	if(done < len){
+		done += store->write(addr + done, data + done, len - done);
+		return false;
+	}
+	cmd = 0;
+	if((type == UPL_WRITE) && (store->read(1) != 0)){
+		countCleared = false;//clear it again with the next attempt
+		reply(type, UPL_VERIFY_FAILED, addr);
+		return false;
+	}
+	for(uint8_t i = 0; i < len; i++){
+		if(store->read(addr + i) != data[i]){
+			reply(type, UPL_VERIFY_FAILED, addr);
+			return false;
+		}
+	}
+	reply(type, UPL_OK, (type == UPL_WRITE) ? addr : 0);
+	if(type == UPL_COMMIT){
+		session = false;
+		countCleared = false;
+		return true;
+	}
+	return false;
+}
+
+void ProgramUpload::reply(uint8_t type, uint8_t status, word address){
+	if(!telemetry->open(TEL_UPLOAD, 4)) return;//the uploader will ask again
+	telemetry->put8(type);
+	telemetry->put8(status);
+	telemetry->put16(address);
+	telemetry->close();
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Program upload over the UART, so that programs can be changed without a programmer and without stopping the show.
+ * Only with TELEMETRY: commands come in on the telemetry UART's receiver, and each is answered by a TEL_UPLOAD record in the
+ * telemetry stream. host/upload_programs.cpp is the uploader.
+ *
+ * A command is framed as a telemetry record: TEL_SYNC, type, payload length, payload, checksum (type + length + payload +
+ * checksum = 0 mod 256). Multi-byte values are little-endian.
+ *	UPL_HELLO	-								reply: NUM_LEDS, store (0 internal, 1 I2C), capacity (16, in 16 byte units),
+ *												header bytes 0..4 as stored
+ *	UPL_WRITE	address (16), 1..UPL_CHUNK bytes	write to the program store, from address 3 on; replied to once written and
+ *												read back
+ *	UPL_COMMIT	program count, cycling rate source, program to load (0 = the current one)
+ *												write header bytes 1 and 2, and once read back, the sketch takes up the new
+ *												header and loads the program (see poll())
+ * A reply (TEL_UPLOAD) is the command type, a status (UPL_OK...) and the address (16; 0 but for UPL_WRITE), then any more
+ * values as above. A command with a bad checksum or length is dropped without reply. The uploader sends one command at a
+ * time and sends it again if no reply comes, which also covers a reply dropped from a full telemetry buffer; writing the same
+ * bytes twice does no harm.
+ *
+ * Nothing waits on the EEPROM. poll(), called on every loop() pass outside the tick, takes in the bytes received and, whenever
+ * the store is ready, starts the next write of the command in hand: a byte of the internal EEPROM (3.4ms each; bytes that
+ * already hold the value are skipped) or a page of an I2C EEPROM (about 5ms for up to 16 bytes). So the tick is never held up.
+ * From the first write until the commit, or UPL_TIMEOUT_MS without a command, active() is true: the EEPROM is part written, so
+ * the sketch plays on from RAM, without cycling or loading programs. The first write of a session starts by clearing the program
+ * count (header byte 1), so that a part written store is never taken for the old programs: not after a reset, and not after a
+ * session that times out, which poll() then reports as a commit of no programs. Only the commit writes header bytes 1 and 2.
+ */
+
+#ifndef PROGRAMUPLOAD_H
+#define PROGRAMUPLOAD_H
+
+#include <Arduino.h>
+#include "Telemetry.h"
+#include "ProgramStore.h"
+
+#define UPL_CHUNK 16 //most bytes per UPL_WRITE
+#define UPL_MAX_PAYLOAD (2 + UPL_CHUNK)
+#define UPL_TIMEOUT_MS 10000 //an upload session ends this long after the last command
+#define UPL_WRITE_MS 500 //a write not done in this long fails, e.g. an I2C EEPROM that stops answering
+#define UPL_FIRST_ADDRESS 3 //UPL_WRITE may not touch NUM_LEDS or the header bytes that UPL_COMMIT writes
+
+//commands
+#define UPL_HELLO 0x40
+#define UPL_WRITE 0x41
+#define UPL_COMMIT 0x42
+
+//reply status
+#define UPL_OK 0
+#define UPL_BAD_COMMAND 1 //unknown type, or wrong length
+#define UPL_BAD_ADDRESS 2 //outside UPL_FIRST_ADDRESS..capacity
+#define UPL_WRITE_FAILED 3 //not written within UPL_WRITE_MS
+#define UPL_VERIFY_FAILED 4 //read back differently
+
+class ProgramUpload{
+	public:
+		ProgramUpload();
+		void begin(Telemetry* telemetry, ProgramStore* store, uint8_t numLeds);
+		//takes in the bytes received, acts on a whole command and moves the write in hand on. Returns true when a commit has
+		//been written and read back, or a session that wrote has timed out; the sketch should then take up the new header and
+		//load the program (getCommit())
+		boolean poll();
+		//an upload is under way: the store is part written
+		boolean active();
+		//the header bytes 1 and 2 committed, and the program to load (0 = the current one). After a timeout, no programs
+		void getCommit(uint8_t* programCount, uint8_t* pcRateSrc, uint8_t* program);
+		//commands dropped for a bad checksum or length
+		uint16_t getErrors();
+	private:
+		Telemetry* telemetry;
+		ProgramStore* store;
+		uint8_t numLeds;
+		//the command being received
+		uint8_t rxState;
+		uint8_t rxType;
+		uint8_t rxLen;
+		uint8_t rxPos;
+		uint8_t rxSum;
+		uint8_t payload[UPL_MAX_PAYLOAD];
+		//the write in hand: UPL_WRITE or UPL_COMMIT, 0 if none
+		uint8_t cmd;
+		word addr;
+		uint8_t data[UPL_CHUNK];
+		uint8_t len;
+		uint8_t done;//bytes written so far
+		unsigned long started;//millis() when the write began
+		uint8_t commitProgram;
+		boolean session;
+		boolean countCleared;//header byte 1 has been written 0 since the last commit
+		unsigned long lastCommand;//millis()
+		uint16_t errors;
+		void command();
+		void startWrite(uint8_t type, word address, const uint8_t* bytes, uint8_t count);
+		boolean stepWrite();
+		void reply(uint8_t type, uint8_t status, word address);
+};
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "StateJournal.h"
+
+StateJournal::StateJournal(){
+	store = 0;
+	slot = JOURNAL_SLOTS - 1;
+	seq = 0;
+	memset(saved, 0, JOURNAL_PAYLOAD);
+	memset(pending, 0, JOURNAL_PAYLOAD);
+	dirty = false;
+	firstChange = 0;
+	lastChange = 0;
+	done = JOURNAL_RECORD_BYTES;
+	writes = 0;
+}
+
+word StateJournal::slotAddress(uint8_t s){
+	return JOURNAL_BASE + (word)s * JOURNAL_RECORD_BYTES;
+}
+
+boolean StateJournal::begin(ProgramStore* store, uint8_t* state){
+	this->store = store;
+	boolean found = false;
+	for(uint8_t s = 0; s < JOURNAL_SLOTS; s++){
+		word a = slotAddress(s);
+		uint8_t buff[JOURNAL_RECORD_BYTES];
+		store->readBytes(&a, buff, JOURNAL_RECORD_BYTES);
+		uint8_t sum = 0;
+		for(uint8_t i = 0; i < JOURNAL_RECORD_BYTES; i++){
+			sum += buff[i];
+		}
+		if(sum != JOURNAL_CHECK) continue;
+		//the ring holds at most JOURNAL_SLOTS consecutive numbers, so the difference tells which is later
+		if(found && (int8_t)(buff[0] - seq) <= 0) continue;
+		found = true;
+		slot = s;
+		seq = buff[0];
+		memcpy(saved, buff + 1, JOURNAL_PAYLOAD);
+	}
+	if(found){
+		memcpy(state, saved, JOURNAL_PAYLOAD);
+	}else{
+		memcpy(saved, state, JOURNAL_PAYLOAD);
+	}
+	memcpy(pending, saved, JOURNAL_PAYLOAD);
+	return found;
+}
+
+void StateJournal::update(const uint8_t* state){
+	if(store == 0) return;
+	if(memcmp(state, pending, JOURNAL_PAYLOAD) == 0) return;
+	memcpy(pending, state, JOURNAL_PAYLOAD);
+	lastChange = millis();
+	if(!dirty){
+		dirty = true;
+		firstChange = lastChange;
+	}
+}
+
+void StateJournal::poll(){
+	if(store == 0) return;
+	if(done < JOURNAL_RECORD_BYTES){
+		//the check byte goes last
+		done += store->write(slotAddress(slot) + done, record + done, JOURNAL_RECORD_BYTES - done);
+		return;
+	}
+	if(!dirty) return;
+	unsigned long now = millis();
+	if((now - lastChange < JOURNAL_QUIET_MS) && (now - firstChange < JOURNAL_MAX_DELAY_MS)) return;
+	dirty = false;
+	if(memcmp(pending, saved, JOURNAL_PAYLOAD) == 0) return;//changed back
+	memcpy(saved, pending, JOURNAL_PAYLOAD);
+	slot = (slot + 1) % JOURNAL_SLOTS;
+	seq++;
+	record[0] = seq;
+	memcpy(record + 1, saved, JOURNAL_PAYLOAD);
+	uint8_t sum = 0;
+	for(uint8_t i = 0; i < JOURNAL_RECORD_BYTES - 1; i++){
+		sum += record[i];
+	}
+	record[JOURNAL_RECORD_BYTES - 1] = JOURNAL_CHECK - sum;
+	done = 0;
+	writes++;
+}
+
+uint16_t StateJournal::getWrites(){
+	return writes;
+}
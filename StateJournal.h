@@ -0,0 +1,71 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Runtime state kept across power cycles, in a journal at the top of the internal EEPROM (the PSTORE_RESERVED_BYTES that
+ * ProgramStore keeps back from programs). The sketch's state is an opaque JOURNAL_PAYLOAD bytes.
+ *
+ * The journal is a ring of JOURNAL_SLOTS records: a sequence number, the payload, and a check byte (the bytes add up to
+ * JOURNAL_CHECK). Each record goes in the slot after the latest, so a write cut short by a power cut can only spoil that slot,
+ * and the record before it is then recovered. begin() takes the valid record with the highest sequence number (modulo 256).
+ *
+ * update() is given the state on every loop() pass, and only notes whether it differs from what was last written. A record is
+ * written once the state has been unchanged for JOURNAL_QUIET_MS (e.g. after a run of IR presses), or JOURNAL_MAX_DELAY_MS after
+ * the first change if it keeps changing (e.g. program cycling), so that a change is never held back for long. poll() writes one
+ * byte per call, when the EEPROM is ready, so nothing waits on the 3.4ms byte write. Bytes that already hold their value are not
+ * written (ProgramStore::write()); only the sequence number and check byte, and whatever state changed, wear.
+ * Wear: at most one record per JOURNAL_MAX_DELAY_MS is 144 a day; spread over JOURNAL_SLOTS slots, a byte is written at most
+ * 18 times a day, or about 2200 times in 4 months of 24/7 running, against the 100000 write cycles the EEPROM is rated for.
+ */
+
+#ifndef STATEJOURNAL_H
+#define STATEJOURNAL_H
+
+#include <Arduino.h>
+#include "ProgramStore.h"
+
+#define JOURNAL_RECORD_BYTES 16
+#define JOURNAL_PAYLOAD (JOURNAL_RECORD_BYTES - 2) //less the sequence number and check byte
+#define JOURNAL_SLOTS (PSTORE_RESERVED_BYTES / JOURNAL_RECORD_BYTES)
+#define JOURNAL_BASE (E2END + 1 - PSTORE_RESERVED_BYTES)
+#define JOURNAL_CHECK 0x5A //not the sum of an erased (0xFF) or zeroed record
+#define JOURNAL_QUIET_MS 30000UL
+#define JOURNAL_MAX_DELAY_MS 600000UL
+
+class StateJournal{
+	public:
+		StateJournal();
+		//recovers the latest record into state and returns true, or returns false, leaving state alone, if there is none. store
+		//must be the internal EEPROM
+		boolean begin(ProgramStore* store, uint8_t* state);
+		//notes the current state. Call on every loop() pass
+		void update(const uint8_t* state);
+		//writes the next byte of a record, or starts a record when one is due. Call on every loop() pass, outside the tick
+		void poll();
+		//records written since start
+		uint16_t getWrites();
+	private:
+		ProgramStore* store;
+		uint8_t slot;//the slot of the latest record; the next goes in the one after
+		uint8_t seq;//its sequence number
+		uint8_t saved[JOURNAL_PAYLOAD];//the payload last written (or recovered)
+		uint8_t pending[JOURNAL_PAYLOAD];//the state as last given to update()
+		boolean dirty;//pending differs from saved
+		unsigned long firstChange;//millis() of the first change since the last record
+		unsigned long lastChange;
+		uint8_t record[JOURNAL_RECORD_BYTES];//the record being written
+		uint8_t done;//bytes of it written; JOURNAL_RECORD_BYTES when none is being written
+		uint16_t writes;
+		word slotAddress(uint8_t s);
+};
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SyncLink.h"
+#include <Wire.h>
+
+//the link that receives frames. There is only one TWI, so only one can be active
+static SyncLink* activeSync = 0;
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+#define SL_ENTER_CRITICAL() uint8_t oldSREG = SREG; cli()
+#define SL_EXIT_CRITICAL() SREG = oldSREG
+#else
+//the simulated bus delivers frames synchronously, so no locking is needed
+#define SL_ENTER_CRITICAL()
+#define SL_EXIT_CRITICAL()
+#endif
+
+//called by Wire from the TWI interrupt at the end of a frame
+static void syncWireReceive(int count){
+	(void)count;
+	uint8_t f[SYNC_FRAME_BYTES];
+	uint8_t n = 0;
+	while(Wire.available()){
+		uint8_t b = Wire.read();
+		if(n < SYNC_FRAME_BYTES) f[n] = b;
+		if(n < 255) n++;
+	}
+	activeSync->received(f, n);
+}
+
+static void put16(uint8_t* p, uint16_t v){
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t* p, uint32_t v){
+	put16(p, v & 0xFFFF);
+	put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t* p){
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p){
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+SyncLink::SyncLink(){
+	follower = false;
+	period = 0;
+	fresh = false;
+	arrival = 0;
+	errors = 0;
+	frames = 0;
+	lastError = 0;
+	trim = 0;
+	locked = false;
+}
+
+void SyncLink::beginMaster(){
+	follower = false;
+}
+
+void SyncLink::beginFollower(unsigned long tickPeriodMicros){
+	follower = true;
+	period = tickPeriodMicros;
+	activeSync = this;
+	Wire.begin(SYNC_I2C_ADDR);
+	#ifdef __AVR__
+	TWAR |= _BV(TWGCE);//also answer the general call address
+	#endif
+	Wire.onReceive(syncWireReceive);
+}
+
+boolean SyncLink::isFollower(){
+	return follower;
+}
+
+//magic, tick, program, phases, seed, age, checksum (the bytes sum to 0), little-endian
+boolean SyncLink::send(const SyncState& s){
+	uint8_t f[SYNC_FRAME_BYTES];
+	f[0] = SYNC_MAGIC;
+	put32(f + 1, s.tick);
+	f[5] = s.program;
+	for(uint8_t i = 0; i < SYNC_PHASES; i++){
+		put32(f + 6 + 4 * i, s.phase[i]);
+	}
+	put16(f + 18, s.seed);
+	put16(f + 20, s.age);
+	uint8_t sum = 0;
+	for(uint8_t i = 0; i < SYNC_FRAME_BYTES - 1; i++) sum += f[i];
+	f[SYNC_FRAME_BYTES - 1] = -sum;
+	Wire.beginTransmission(0);
+	Wire.write(f, SYNC_FRAME_BYTES);
+	if(Wire.endTransmission() != 0){
+		errors++;
+		return false;
+	}
+	frames++;
+	return true;
+}
+
+void SyncLink::received(const uint8_t* f, uint8_t len){
+	uint8_t sum = 0;
+	if(len == SYNC_FRAME_BYTES){
+		for(uint8_t i = 0; i < SYNC_FRAME_BYTES; i++) sum += f[i];
+	}
+	if(len != SYNC_FRAME_BYTES || f[0] != SYNC_MAGIC || sum != 0){
+		errors++;
+		return;
+	}
+	//a frame not yet taken up is replaced: the newer one supersedes it
+	for(uint8_t i = 0; i < SYNC_FRAME_BYTES; i++) frame[i] = f[i];
+	arrival = micros();
+	fresh = true;
+}
+
+boolean SyncLink::receive(unsigned long tickDue, SyncState* s, uint8_t* ticksSince, long* correction){
+	if(!fresh) return false;//a single byte, so safe to test without locking
+	uint8_t f[SYNC_FRAME_BYTES];
+	SL_ENTER_CRITICAL();
+	for(uint8_t i = 0; i < SYNC_FRAME_BYTES; i++) f[i] = frame[i];
+	//when the master's tick fell due, and how long before this one
+	unsigned long masterDue = arrival - SYNC_FRAME_US - get16(f + 20);
+	long since = (long)(tickDue - masterDue);
+	//this tick is the frame's own, or earlier: take it up at the next. Otherwise it is taken up now, under the same lock as the
+	//copy, so that a frame that arrives meanwhile is kept for the next tick
+	boolean due = since >= (long)(period / 2);
+	if(due) fresh = false;
+	SL_EXIT_CRITICAL();
+	if(!due) return false;
+	s->age = get16(f + 20);
+	
+	s->tick = get32(f + 1);
+	s->program = f[5];
+	for(uint8_t i = 0; i < SYNC_PHASES; i++){
+		s->phase[i] = get32(f + 6 + 4 * i);
+	}
+	s->seed = get16(f + 18);
+	unsigned long n = (since + period / 2) / period;
+	*ticksSince = n > 255 ? 255 : n;
+	
+	//positive if this tick fell due later than the master's equivalent
+	long err = since - (long)(n * period);
+	lastError = err;
+	long maxSlew = period / 4;
+	if(locked){
+		trim += err / 8;
+		if(trim > maxSlew) trim = maxSlew;
+		if(trim < -maxSlew) trim = -maxSlew;
+	}
+	locked = true;
+	long c = err / 2 + trim;
+	if(c > maxSlew) c = maxSlew;
+	if(c < -maxSlew) c = -maxSlew;
+	*correction = c;
+	frames++;
+	return true;
+}
+
+uint16_t SyncLink::getFrames(){
+	return frames;
+}
+
+uint16_t SyncLink::getErrors(){
+	SL_ENTER_CRITICAL();
+	uint16_t e = errors;
+	SL_EXIT_CRITICAL();
+	return e;
+}
+
+long SyncLink::getLastError(){
+	return lastError;
+}
+
+long SyncLink::getTrim(){
+	return trim;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Tick synchronisation of several boards that drive one display, over I2C; see SYNC_I2C in XmasConfig.h.
+ * Every board runs the same build. The master (PIN_SYNC_FOLLOW open) sends a frame to the I2C general call address, so every
+ * follower receives it and none has to be addressed, every SYNC_FRAME_TICKS ticks and whenever its program changes. A frame
+ * holds the master's tick count, program, the phases of the LFO, program cycling and mask oscillators, the seed that both ends
+ * then give randomSeed(), and how long after its tick fell due the frame was sent.
+ *
+ * A follower (PIN_SYNC_FOLLOW grounded) listens as an I2C slave with general call recognition. The frame is kept by the TWI
+ * interrupt, with the time it arrived, and taken up at the start of the follower's next tick: that tick is the master's tick
+ * after the one in the frame, so the follower adopts the frame's state and tick count there. The follower also moves its own
+ * tick schedule (TickScheduler::shift()) towards the instant the master's tick fell due, i.e. the arrival time less the bus
+ * time of the frame and the master's delay in sending it. This is a phase-locked loop: half of the error is corrected at each
+ * frame, plus a term that builds up to cancel a steady clock difference (resonators are only good to about 0.5%), with each
+ * correction limited to a quarter of the tick period. Ticks therefore stay within a fraction of a millisecond, apart from the 1024us step
+ * of the timer interrupt that drives the scheduler, and the latency of a change on the master (e.g. an IR program change)
+ * is one frame time, about 2ms, plus at most one tick.
+ */
+
+#ifndef SYNCLINK_H
+#define SYNCLINK_H
+
+#include <Arduino.h>
+
+//a follower's own slave address, which it never uses; frames are sent to the general call address, 0
+#define SYNC_I2C_ADDR 0x30
+#define SYNC_MAGIC 0xA5
+//magic, tick (4), program, 3 phases (4 each), seed (2), age (2), checksum. Within the Wire library's 32 byte buffer
+#define SYNC_FRAME_BYTES 23
+//bus time per byte (8 bits + ACK at 100kHz), and of a whole frame with its address byte
+#define SYNC_BYTE_US 90
+#define SYNC_FRAME_US ((SYNC_FRAME_BYTES + 1) * SYNC_BYTE_US)
+#define SYNC_PHASES 3
+
+struct SyncState{
+	unsigned long tick;//the master's tick count, of the tick that sent the frame
+	uint8_t program;
+	uint32_t phase[SYNC_PHASES];//OSC_LFO, OSC_PC, OSC_TGM
+	uint16_t seed;//for randomSeed(), which takes 16 bits; not 0, which it ignores
+	uint16_t age;//microseconds from the master's tick falling due to the frame being sent
+};
+
+class SyncLink{
+	public:
+		SyncLink();
+		//the master sends on Wire, which must already have been begun
+		void beginMaster();
+		//a follower listens for frames, as a slave at SYNC_I2C_ADDR with general call recognition
+		void beginFollower(unsigned long tickPeriodMicros);
+		boolean isFollower();
+		//master: send a frame. Takes about SYNC_FRAME_US. Returns false if nothing acknowledged it
+		boolean send(const SyncState& s);
+		//follower, at the start of a tick that fell due at micros() tickDue: if a frame has arrived since the master's previous
+		//tick, gets its state and the number of ticks between the frame's tick and this one (normally 1), and returns the
+		//correction for the tick schedule (for TickScheduler::shift()). Returns false if there is no frame to take up, which
+		//includes one that arrived too soon after this tick fell due (it is then taken up at the next tick)
+		boolean receive(unsigned long tickDue, SyncState* s, uint8_t* ticksSince, long* correction);
+		//called from the TWI interrupt with the bytes received
+		void received(const uint8_t* frame, uint8_t len);
+		//frames sent (master) or taken up (follower), and frames that failed: not acknowledged, or bad length or checksum
+		uint16_t getFrames();
+		uint16_t getErrors();
+		//follower: the last phase error, in microseconds (positive if the follower was late), and the correction for a steady
+		//clock difference, in microseconds per frame
+		long getLastError();
+		long getTrim();
+	private:
+		boolean follower;
+		unsigned long period;
+		volatile uint8_t frame[SYNC_FRAME_BYTES];
+		volatile boolean fresh;//frame holds a frame not yet taken up
+		volatile unsigned long arrival;//micros() at the end of the frame
+		volatile uint16_t errors;
+		uint16_t frames;
+		long lastError;
+		long trim;
+		boolean locked;//the trim is only built up from errors measured after the first correction
+};
+
+#endif
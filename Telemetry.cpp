@@ -0,0 +1,252 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Telemetry.h"
+
+#define TEL_MASK (TEL_BUFFER - 1)
+#define TEL_RX_MASK (TEL_RX_BUFFER - 1)
+//sync, type, length, checksum
+#define TEL_OVERHEAD 4
+
+static Telemetry* activeTelemetry = 0;
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+ISR(USART_UDRE_vect){
+	activeTelemetry->txReady();
+}
+
+ISR(USART_RX_vect){
+	activeTelemetry->rxReady(UDR0);
+}
+#else
+#include "HostSim.h"
+
+//the simulator sends, and receives from the Serial input, the bytes that the UART would have in each TEL_HOST_DRAIN_US
+#define TEL_HOST_DRAIN_US 1000
+static void hostTelemetryHook(){
+	//10 bits per byte
+	for(uint8_t n = 0; n < TEL_BAUD / 10 / (1000000UL / TEL_HOST_DRAIN_US); n++){
+		activeTelemetry->txReady();
+		int c = HostSim::popSerial();
+		if(c >= 0) activeTelemetry->rxReady(c);
+	}
+}
+#endif
+
+Telemetry::Telemetry(){
+	head = 0;
+	tail = 0;
+	wr = 0;
+	sum = 0;
+	dropped = 0;
+	droppedSent = 0;
+	rxHead = 0;
+	rxTail = 0;
+	rxDropped = 0;
+}
+
+void Telemetry::begin(uint8_t numLeds, uint16_t tickPeriodMicros){
+	activeTelemetry = this;
+	#ifdef __AVR__
+	UCSR0A = _BV(U2X0);
+	UBRR0 = F_CPU / 8 / TEL_BAUD - 1;
+	UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);//8N1
+	UCSR0B = _BV(TXEN0) | _BV(RXEN0) | _BV(RXCIE0);//the data register empty interrupt is enabled when there is something to send
+	#else
+	hostAttachTimer(hostTelemetryHook, TEL_HOST_DRAIN_US);
+	#endif
+	if(open(TEL_START, 5)){
+		put8(TEL_VERSION);
+		put8(numLeds);
+		put16(tickPeriodMicros);
+		put8(TEL_CLOCK_NS);
+		close();
+	}
+}
+
+uint8_t Telemetry::space(){
+	//one byte is kept empty so that head == tail only when empty
+	return (tail - head - 1) & TEL_MASK;
+}
+
+boolean Telemetry::open(uint8_t type, uint8_t len){
+	uint8_t needed = len + TEL_OVERHEAD;
+	if(dropped != droppedSent){
+		//the drop count goes first, or not at all
+		if(space() < needed + 2 + TEL_OVERHEAD){
+			dropped++;
+			return false;
+		}
+		wr = head;
+		putRaw(TEL_SYNC);
+		sum = 0;
+		put8(TEL_DROPPED);
+		put8(2);
+		put16(dropped);
+		putRaw(-sum);
+		head = wr;
+		droppedSent = dropped;
+	}else if(space() < needed){
+		dropped++;
+		return false;
+	}
+	wr = head;
+	putRaw(TEL_SYNC);
+	sum = 0;
+	put8(type);
+	put8(len);
+	return true;
+}
+
+void Telemetry::putRaw(uint8_t v){
+	buf[wr] = v;
+	wr = (wr + 1) & TEL_MASK;
+}
+
+void Telemetry::put8(uint8_t v){
+	sum += v;
+	putRaw(v);
+}
+
+void Telemetry::put16(uint16_t v){
+	put8(v & 0xFF);
+	put8(v >> 8);
+}
+
+void Telemetry::put32(unsigned long v){
+	put16(v & 0xFFFF);
+	put16(v >> 16);
+}
+
+void Telemetry::close(){
+	putRaw(-sum);
+	head = wr;//publish the whole record at once
+	#ifdef __AVR__
+	UCSR0B |= _BV(UDRIE0);//the interrupt only ever clears this, and only when the buffer is empty, so no need to stop it here
+	#endif
+}
+
+void Telemetry::txReady(){
+	if(tail == head){
+		#ifdef __AVR__
+		UCSR0B &= ~_BV(UDRIE0);
+		#endif
+		return;
+	}
+	uint8_t b = buf[tail];
+	tail = (tail + 1) & TEL_MASK;
+	#ifdef __AVR__
+	UDR0 = b;
+	#else
+	if(HostSim::telemetryOut) fputc(b, HostSim::telemetryOut);
+	#endif
+}
+
+void Telemetry::rxReady(uint8_t b){
+	uint8_t h = rxHead;
+	uint8_t next = (h + 1) & TEL_RX_MASK;
+	if(next == rxTail){
+		rxDropped++;
+		return;
+	}
+	rxBuf[h] = b;
+	rxHead = next;
+}
+
+int Telemetry::read(){
+	uint8_t t = rxTail;
+	if(t == rxHead) return -1;
+	uint8_t b = rxBuf[t];
+	rxTail = (t + 1) & TEL_RX_MASK;
+	return b;
+}
+
+uint16_t Telemetry::getRxDropped(){
+	return rxDropped;
+}
+
+void Telemetry::text(const char* s){
+	uint8_t len = strlen(s);
+	if(len > TEL_BUFFER / 2) len = TEL_BUFFER / 2;
+	if(!open(TEL_TEXT, len)) return;
+	for(uint8_t i = 0; i < len; i++) put8(s[i]);
+	close();
+}
+
+void Telemetry::text(const __FlashStringHelper* s){
+	const char* p = reinterpret_cast<const char*>(s);
+	uint8_t len = 0;
+	while((len < TEL_BUFFER / 2) && pgm_read_byte(p + len)) len++;
+	if(!open(TEL_TEXT, len)) return;
+	for(uint8_t i = 0; i < len; i++) put8(pgm_read_byte(p + i));
+	close();
+}
+
+void Telemetry::programLoad(uint8_t program, uint8_t format, boolean error){
+	if(!open(TEL_PROG_LOAD, 3)) return;
+	put8(program);
+	put8(format);
+	put8(error ? 1 : 0);
+	close();
+}
+
+void Telemetry::programLed(uint8_t led, const uint8_t* pattern, const uint8_t* patch){
+	if(!open(TEL_PROG_LED, 9)) return;
+	put8(led);
+	for(uint8_t i = 0; i < 4; i++) put8(pattern[i]);
+	for(uint8_t i = 0; i < 4; i++) put8(patch[i]);
+	close();
+}
+
+void Telemetry::ir(unsigned long code){
+	if(!open(TEL_IR, 4)) return;
+	put32(code);
+	close();
+}
+
+void Telemetry::sources(uint8_t first, const uint16_t* vals, uint8_t count){
+	if(!open(TEL_SOURCES, 1 + 2 * count)) return;
+	put8(first);
+	for(uint8_t i = 0; i < count; i++) put16(vals[i]);
+	close();
+}
+
+void Telemetry::tick(uint16_t tickNum, unsigned long duration, unsigned long lateness, uint16_t skipped){
+	if(!open(TEL_TICK, 8)) return;
+	put16(tickNum);
+	put16(duration > 0xFFFF ? 0xFFFF : duration);
+	put16(lateness > 0xFFFF ? 0xFFFF : lateness);
+	put16(skipped);
+	close();
+}
+
+void Telemetry::value(uint8_t src, uint16_t v){
+	if(!open(TEL_VALUE, 3)) return;
+	put8(src);
+	put16(v);
+	close();
+}
+
+void Telemetry::memory(uint16_t staticBytes, uint16_t heapBytes, uint16_t freeBytes, uint16_t minFreeBytes){
+	if(!open(TEL_MEMORY, 8)) return;
+	put16(staticBytes);
+	put16(heapBytes);
+	put16(freeBytes);
+	put16(minFreeBytes);
+	close();
+}
+
+uint16_t Telemetry::getDropped(){
+	return dropped;
+}
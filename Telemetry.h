@@ -0,0 +1,109 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Binary telemetry stream on the UART, at TEL_BAUD.
+ * Records are written into a ring buffer of TEL_BUFFER bytes which the UART data-register-empty interrupt drains. Writing never
+ * waits: a record that does not fit is dropped and counted, and the count is sent (TEL_DROPPED) once there is room again.
+ * On the host, the simulator drains the buffer at the same byte rate into HostSim::telemetryOut; host/tel_decode.cpp prints a stream.
+ * The receiver is used for program upload (ProgramUpload.h): the receive interrupt puts each byte into a ring buffer of
+ * TEL_RX_BUFFER bytes, which read() empties; a byte that does not fit is dropped. On the host, Serial input (HostSim::pushSerial())
+ * is received at the same byte rate.
+ *
+ * Record: TEL_SYNC, type, payload length, payload, checksum (chosen so that type + length + payload + checksum = 0 mod 256).
+ * Multi-byte values are little-endian.
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+#define TEL_BAUD 500000UL //exact at 16MHz with U2X
+#define TEL_BUFFER 128 //power of 2
+#define TEL_RX_BUFFER 32 //power of 2; holds an upload command
+#define TEL_SYNC 0x7E
+#define TEL_VERSION 2
+
+//clock for tick durations: micros() on the target; nanoseconds of wall clock on the host, where time may be simulated
+#ifdef __AVR__
+#define TEL_CLOCK() micros()
+#define TEL_CLOCK_NS 0
+#else
+#define TEL_CLOCK() hostWallNanos()
+#define TEL_CLOCK_NS 1
+#endif
+
+//record types and their payloads
+#define TEL_START 0x01 //version, NUM_LEDS, tick period (16, us), unit of tick durations (0 = us, 1 = ns)
+#define TEL_DROPPED 0x02 //records dropped since start (16)
+#define TEL_TEXT 0x03 //ASCII text
+#define TEL_PROG_LOAD 0x10 //program number, format, decode error (0/1)
+#define TEL_PROG_LED 0x11 //LED, 4 pattern bytes, 4 patch bytes, as in the program image
+#define TEL_IR 0x12 //IR code (32)
+#define TEL_SOURCES 0x13 //first srcVals index, then values (16 each)
+#define TEL_TICK 0x14 //tick count (16), duration of the tick work (16, clock units, saturating), lateness (16, us, saturating),
+	//LED parameters not pushed because their source was unchanged (16; from version 2)
+#define TEL_SNAPSHOT 0x15 //tick count (16), first LED, then per LED the controller inputs: rate, scale, trigger/gate (16 each)
+#define TEL_SCHED 0x16 //tick scheduler statistics: ticks (32), missed (16), overruns (16), jitter min, mean, max (16 each, us, 0xFFFF if longer)
+#define TEL_VALUE 0x17 //srcVals index, new value (16): a source changed from IR
+#define TEL_UPLOAD 0x18 //the reply to a program upload command; see ProgramUpload.h
+#define TEL_MEMORY 0x19 //SRAM (bytes, 16 each): static data, heap, free now, least free since start; see MemoryMonitor.h
+
+class Telemetry{
+	public:
+		Telemetry();
+		//set up the UART (host: the simulated drain) and send TEL_START
+		void begin(uint8_t numLeds, uint16_t tickPeriodMicros);
+		//begin a record of len payload bytes. Returns false, and counts a drop, if it will not fit; put*() and close() must then not be called
+		boolean open(uint8_t type, uint8_t len);
+		void put8(uint8_t v);
+		void put16(uint16_t v);
+		void put32(unsigned long v);
+		//finish the record and start sending it
+		void close();
+		//whole records
+		void text(const char* s);
+		//... from program memory, F("...")
+		void text(const __FlashStringHelper* s);
+		void programLoad(uint8_t program, uint8_t format, boolean error);
+		void programLed(uint8_t led, const uint8_t* pattern, const uint8_t* patch);
+		void ir(unsigned long code);
+		void sources(uint8_t first, const uint16_t* vals, uint8_t count);
+		void tick(uint16_t tickNum, unsigned long duration, unsigned long lateness, uint16_t skipped);
+		void value(uint8_t src, uint16_t v);
+		void memory(uint16_t staticBytes, uint16_t heapBytes, uint16_t freeBytes, uint16_t minFreeBytes);
+		uint16_t getDropped();
+		//send the next byte, or stop if there is none; called from the UART interrupt
+		void txReady();
+		//the next byte received, or -1 if there is none
+		int read();
+		//called from the UART receive interrupt
+		void rxReady(uint8_t b);
+		//bytes received that did not fit in the buffer
+		uint16_t getRxDropped();
+	private:
+		volatile uint8_t buf[TEL_BUFFER];
+		volatile uint8_t head;//next byte to write; only advanced by close()
+		volatile uint8_t tail;//next byte to send
+		uint8_t wr;//write position in the record being built
+		uint8_t sum;
+		uint16_t dropped;
+		uint16_t droppedSent;
+		volatile uint8_t rxBuf[TEL_RX_BUFFER];
+		volatile uint8_t rxHead;//only advanced by rxReady()
+		volatile uint8_t rxTail;//only advanced by read()
+		uint16_t rxDropped;
+		uint8_t space();
+		void putRaw(uint8_t v);
+};
+
+#endif
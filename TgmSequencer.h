@@ -0,0 +1,264 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Trigger/gate mask sequencer: moves the mask (a bit per LED, over a run of runLength LEDs) by running a small mask program,
+ * so that a new chase pattern needs a new program rather than new firmware. The original four patterns are built in (PROGMEM)
+ * and a program image may carry its own (PROG_OP_TGM, see ProgramDecoder.h).
+ *
+ * step() is called each time the mask is to move (each time OSC_TGM wraps). It runs on from where the last step stopped until
+ * a STEP op, or until TGS_MAX_OPS ops have run, so a step takes a bounded time whatever the program. Running off the end goes
+ * back to the start. Loading a program restarts it with the mask as bit 0. There is also a direction, A or B, which BOUNCE
+ * flips and IF can test; as with the original patterns it is kept from one program to the next.
+ *
+ * An op is a byte, the high nibble being the op and the low nibble n; some take a second byte, b:
+ *	TGS_STEP n		end the step; the mask is then held for n more steps
+ *	TGS_SHL n		shift towards the top of the run with n (0 or 1) into bit 0. The bit shifted out of the run is lost
+ *	TGS_SHR n		shift towards bit 0 with n into the top of the run
+ *	TGS_ROL			rotate towards the top, within the run
+ *	TGS_ROR			rotate towards bit 0
+ *	TGS_SET b		set bit b
+ *	TGS_CLR			clear the mask
+ *	TGS_XOR b		toggle bit b, or with TGS_XOR_RUN invert the whole run
+ *	TGS_IF n		run the next op only if condition n (TGS_IF_...) holds, or with TGS_IF_NOT added, does not
+ *	TGS_BOUNCE		flip the direction
+ *	TGS_LOOP n b	jump to b n times, then go on. There is one loop counter, so loops do not nest
+ *	TGS_JMP b		jump to b
+ * Jump targets are byte offsets in the program. Other ops do nothing.
+ * Header-only because it is a template (LEDS being the mask size, as PatchTable).
+ */
+
+#ifndef TGMSEQUENCER_H
+#define TGMSEQUENCER_H
+
+#include <Arduino.h>
+#include "LedBits.h"
+
+#define TGS_CODE_BYTES 16 //longest program; a program image has room for one this long
+#define TGS_MAX_OPS 16 //ops run per step at most
+
+//ops
+#define TGS_STEP 0x00
+#define TGS_SHL 0x10
+#define TGS_SHR 0x20
+#define TGS_ROL 0x30
+#define TGS_ROR 0x40
+#define TGS_SET 0x50
+#define TGS_CLR 0x60
+#define TGS_XOR 0x70
+#define TGS_IF 0x80
+#define TGS_BOUNCE 0x90
+#define TGS_LOOP 0xA0
+#define TGS_JMP 0xB0
+#define TGS_XOR_RUN 0xFF
+//ops SET, XOR, LOOP and JMP take a second byte
+#define TGS_HAS_ARG(op) ((0x0CA0 >> ((op) >> 4)) & 1)
+//IF conditions
+#define TGS_IF_ZERO 0 //no bit set
+#define TGS_IF_FULL 1 //every bit of the run set
+#define TGS_IF_BIT0 2 //only bit 0 set
+#define TGS_IF_BIT1 3 //only bit 1 set
+#define TGS_IF_TOP 4 //only the top bit of the run set
+#define TGS_IF_B 5 //direction B
+#define TGS_IF_NOT 0x08
+
+//the built-in programs, numbered as the TGM patterns they replace: 1 single bit, 2 grow, 3 pass, 4 double (0 is an empty program)
+#define TGS_BUILTINS 5
+static const uint8_t tgsBuiltinCode[] PROGMEM = {
+	//single: one bit, moving up and starting again at the bottom
+	TGS_ROL, TGS_STEP,
+	//grow: bits on to the top (A), then off from the top (B)
+	TGS_IF | TGS_IF_B, TGS_JMP, 8,
+	TGS_SHL | 1, TGS_IF | TGS_IF_FULL, TGS_BOUNCE, TGS_JMP, 11,
+	TGS_SHR, TGS_IF | TGS_IF_BIT0, TGS_BOUNCE,
+	TGS_STEP,
+	//pass: bits on to the top (A), then off from the bottom (B)
+	TGS_IF | TGS_IF_B, TGS_JMP, 8,
+	TGS_SHL | 1, TGS_IF | TGS_IF_FULL, TGS_BOUNCE, TGS_JMP, 11,
+	TGS_SHL, TGS_IF | TGS_IF_TOP, TGS_BOUNCE,
+	TGS_STEP,
+	//double: two bits, moving up; the first step after bit 0 alone fills in bit 0 again
+	TGS_SHL, TGS_IF | TGS_IF_BIT1, TGS_SET, 0, TGS_IF | TGS_IF_ZERO, TGS_SET, 0,
+	TGS_STEP
+};
+//where each built-in program starts in tgsBuiltinCode; it ends where the next starts
+static const uint8_t tgsBuiltinStart[TGS_BUILTINS + 1] PROGMEM = {0, 0, 2, 14, 26, 34};
+
+template <uint8_t LEDS>
+class TgmSequencer{
+	public:
+		TgmSequencer(){
+			codeLen = 0;
+			dirB = false;
+			begin(LEDS);
+		}
+
+		//load built-in program n (1..TGS_BUILTINS-1; any other n loads an empty program, which leaves the mask as bit 0)
+		void loadBuiltin(uint8_t n, uint8_t runLength){
+			uint8_t from = 0;
+			uint8_t to = 0;
+			if(n < TGS_BUILTINS){
+				from = pgm_read_byte(&tgsBuiltinStart[n]);
+				to = pgm_read_byte(&tgsBuiltinStart[n + 1]);
+			}
+			codeLen = to - from;
+			for(uint8_t i=0; i<codeLen; i++) code[i] = pgm_read_byte(&tgsBuiltinCode[from + i]);
+			begin(runLength);
+		}
+
+		//load a program of len bytes (at most TGS_CODE_BYTES), e.g. from a program image. It is copied
+		void load(const uint8_t* program, uint8_t len, uint8_t runLength){
+			if(len > TGS_CODE_BYTES) len = TGS_CODE_BYTES;
+			codeLen = len;
+			memcpy(code, program, len);
+			begin(runLength);
+		}
+
+		//move the mask one step. Returns the number of ops run (0 while held)
+		uint8_t step(){
+			if(hold){
+				hold--;
+				return 0;
+			}
+			uint8_t ops = 0;
+			boolean skip = false;
+			while(codeLen && (ops < TGS_MAX_OPS)){
+				if(pc >= codeLen) pc = 0;
+				uint8_t op = code[pc++];
+				uint8_t b = 0;
+				if(TGS_HAS_ARG(op)){
+					if(pc < codeLen) b = code[pc];
+					pc++;
+				}
+				ops++;
+				if(skip){
+					skip = false;
+					continue;
+				}
+				uint8_t n = op & 0x0F;
+				switch(op & 0xF0){
+					case TGS_STEP:
+						hold = n;
+						return ops;
+					case TGS_SHL:
+						mask.shiftUp(n & 1);
+						mask.andWith(run);
+						break;
+					case TGS_SHR:
+						mask.shiftDown();
+						if(n & 1) mask.set(runLength - 1);
+						break;
+					case TGS_ROL:{
+						boolean top = mask.test(runLength - 1);
+						mask.shiftUp(top);
+						mask.andWith(run);
+						break;
+					}
+					case TGS_ROR:{
+						boolean bottom = mask.test(0);
+						mask.shiftDown();
+						if(bottom) mask.set(runLength - 1);
+						break;
+					}
+					case TGS_SET:
+						if(b < runLength) mask.set(b);
+						break;
+					case TGS_CLR:
+						mask.clear();
+						break;
+					case TGS_XOR:
+						if(b == TGS_XOR_RUN){
+							mask.xorWith(run);
+						}else if(b < runLength){
+							mask.toggle(b);
+						}
+						break;
+					case TGS_IF:
+						skip = condition(n & ~TGS_IF_NOT) == ((n & TGS_IF_NOT) != 0);
+						break;
+					case TGS_BOUNCE:
+						dirB = !dirB;
+						break;
+					case TGS_LOOP:
+						if(!looping){
+							looping = true;
+							loopCount = n;
+						}
+						if(loopCount){
+							loopCount--;
+							pc = b;
+						}else{
+							looping = false;
+						}
+						break;
+					case TGS_JMP:
+						pc = b;
+						break;
+				}
+			}
+			return ops;
+		}
+
+		//bit n of the mask (0..runLength-1)
+		boolean test(uint8_t n) const{
+			return mask.test(n);
+		}
+
+	private:
+		LedBits<LEDS> mask;
+		LedBits<LEDS> run;//bits 0..runLength-1
+		uint8_t runLength;
+		uint8_t code[TGS_CODE_BYTES];
+		uint8_t codeLen;
+		uint8_t pc;
+		uint8_t hold;//steps still to hold the mask for
+		uint8_t loopCount;
+		boolean looping;
+		boolean dirB;//direction B; kept when a program is loaded
+
+		void begin(uint8_t runLength){
+			if(runLength < 1 || runLength > LEDS) runLength = LEDS;
+			this->runLength = runLength;
+			run.setLow(runLength);
+			mask.setOnly(0);
+			pc = 0;
+			hold = 0;
+			loopCount = 0;
+			looping = false;
+		}
+
+		boolean condition(uint8_t c) const{
+			LedBits<LEDS> only;
+			switch(c){
+				case TGS_IF_ZERO:
+					return mask.isZero();
+				case TGS_IF_FULL:
+					return mask == run;
+				case TGS_IF_BIT0:
+					only.set(0);
+					break;
+				case TGS_IF_BIT1:
+					only.set(1);
+					break;
+				case TGS_IF_TOP:
+					only.set(runLength - 1);
+					break;
+				case TGS_IF_B:
+					return dirB;
+				default:
+					return false;
+			}
+			return mask == only;
+		}
+};
+
+#endif
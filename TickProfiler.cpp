@@ -0,0 +1,105 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TickProfiler.h"
+
+#ifdef PROFILE
+
+//short names keep the report compact, and the RAM cost of the strings small
+//fixed width, so that a name is read from program memory without a table of pointers
+static const char profPhaseNames[PROF_PHASE_COUNT][6] PROGMEM = {"src", "pcyc", "ir", "osc", "tgm", "mod", "patch", "sbc", "tick",
+	"irrx", "stage", "jrnl", "out"};
+
+TickProfiler::TickProfiler(){
+	reset();
+	phaseStart = 0;
+	tickStart = 0;
+}
+
+void TickProfiler::reset(){
+	for(uint8_t p=0; p<PROF_PHASE_COUNT; p++){
+		minTime[p] = 0xFFFFFFFF;
+		maxTime[p] = 0;
+		sumTime[p] = 0;
+		count[p] = 0;
+		for(uint8_t b=0; b<PROF_HIST_BINS; b++){
+			hist[p][b] = 0;
+		}
+	}
+}
+
+void TickProfiler::start(){
+	phaseStart = PROF_CLOCK();
+}
+
+void TickProfiler::mark(uint8_t phase){
+	unsigned long now = PROF_CLOCK();
+	record(phase, now - phaseStart);
+	phaseStart = now;
+}
+
+void TickProfiler::startTick(){
+	tickStart = PROF_CLOCK();
+	phaseStart = tickStart;
+}
+
+void TickProfiler::endTick(){
+	record(PROF_TICK, PROF_CLOCK() - tickStart);
+}
+
+void TickProfiler::record(uint8_t phase, unsigned long t){
+	//once the count is full the mean is that of the first 65535 since the last dump; min, max and the histogram keep going
+	if(count[phase] != 0xFFFF){
+		count[phase]++;
+		sumTime[phase] += t;
+	}
+	if(t < minTime[phase]) minTime[phase] = t;
+	if(t > maxTime[phase]) maxTime[phase] = t;
+	//histogram bin is the position of the highest set bit above PROF_HIST_SHIFT
+	unsigned long v = t >> PROF_HIST_SHIFT;
+	uint8_t bin = 0;
+	while(v && bin < PROF_HIST_BINS-1){
+		v >>= 1;
+		bin++;
+	}
+	if(hist[phase][bin] != 0xFFFF) hist[phase][bin]++;
+}
+
+//one line per phase: name n min mean max | histogram bins
+void TickProfiler::dump(){
+	Serial.print(F("PROF "));
+	Serial.println(PROF_UNIT);
+	for(uint8_t p=0; p<PROF_PHASE_COUNT; p++){
+		Serial.print(reinterpret_cast<const __FlashStringHelper*>(profPhaseNames[p]));
+		Serial.print(' ');
+		Serial.print(count[p]);
+		if(count[p] > 0){
+			Serial.print(' ');
+			Serial.print(minTime[p]);
+			Serial.print(' ');
+			Serial.print(sumTime[p] / count[p]);
+			Serial.print(' ');
+			Serial.print(maxTime[p]);
+			Serial.print(F(" |"));
+			for(uint8_t b=0; b<PROF_HIST_BINS; b++){
+				Serial.print(' ');
+				Serial.print(hist[p][b]);
+			}
+		}
+		Serial.println();
+	}
+	reset();
+}
+
+TickProfiler profiler;
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Per-phase timing of loop(). Only compiled when PROFILE is #defined in XmasConfig.h; otherwise the PROF_* macros are empty.
+ * Each phase keeps min/mean/max and a histogram of durations in power-of-two bins.
+ * Bin 0 counts durations < 2^PROF_HIST_SHIFT clock units, bin i (1..6) counts [2^(PROF_HIST_SHIFT+i-1), 2^(PROF_HIST_SHIFT+i)),
+ * and the last bin counts everything longer.
+ * The count and the mean stop at 65535 samples (about 68 minutes of ticks at 16Hz) until the next dump, and each bin saturates at
+ * 65535; min and max cover every sample.
+ */
+
+#ifndef TICKPROFILER_H
+#define TICKPROFILER_H
+
+#ifdef PROFILE
+
+#include <Arduino.h>
+
+//the phases of loop() that are timed. Those up to PROF_TICK are in the tick; the rest are the background work on every pass
+#define PROF_SOURCES 0 //readSourceValues(), on every pass
+#define PROF_PROG_CYCLE 1 //program cycling, including loadProgram()
+#define PROF_IR 2 //IR decode and dispatch
+#define PROF_OSC 3 //oscillator bank update (LFO, general oscillators)
+#define PROF_TGM 4 //updateTGM()
+#define PROF_MOD 5 //mod bus evaluation (ModMatrix)
+#define PROF_PATCH 6 //patch loop: sbc.setRate/setScale/setTriggerIP
+#define PROF_SBC 7 //sbc.tick()
+#define PROF_TICK 8 //the whole tick, start to end
+#define PROF_IR_POLL 9 //pollIR(): taking a code from the IR receiver into the queue
+#define PROF_STAGING 10 //pollStaging(): reading a block of the next program from EEPROM
+#define PROF_JOURNAL 11 //the state journal: checking for a change, and a step of any EEPROM write
+#define PROF_OUTPUT 12 //the DEBUG program listing (TELEMETRY, and with it the program upload, is never built with PROFILE)
+#define PROF_PHASE_COUNT 13
+
+#define PROF_HIST_BINS 8
+
+//micros() on the target (4us resolution); nanoseconds of wall clock on the host, where time may be simulated
+#ifdef __AVR__
+#define PROF_CLOCK() micros()
+#define PROF_UNIT "us"
+#define PROF_HIST_SHIFT 4
+#else
+#define PROF_CLOCK() hostWallNanos()
+#define PROF_UNIT "ns"
+#define PROF_HIST_SHIFT 6
+#endif
+
+class TickProfiler{
+	public:
+		TickProfiler();
+		//begin timing a phase, or a run of consecutive phases
+		void start();
+		//record the time since start() or the previous mark() against phase
+		void mark(uint8_t phase);
+		//begin/end timing of the whole tick
+		void startTick();
+		void endTick();
+		//print the statistics to Serial and clear them
+		void dump();
+		void reset();
+	private:
+		unsigned long phaseStart;
+		unsigned long tickStart;
+		unsigned long minTime[PROF_PHASE_COUNT];
+		unsigned long maxTime[PROF_PHASE_COUNT];
+		unsigned long sumTime[PROF_PHASE_COUNT];
+		uint16_t count[PROF_PHASE_COUNT];
+		uint16_t hist[PROF_PHASE_COUNT][PROF_HIST_BINS];
+		void record(uint8_t phase, unsigned long t);
+};
+
+extern TickProfiler profiler;
+
+#define PROF_START() profiler.start()
+#define PROF_MARK(phase) profiler.mark(phase)
+#define PROF_TICK_START() profiler.startTick()
+#define PROF_TICK_END() profiler.endTick()
+
+#else
+
+#define PROF_START()
+#define PROF_MARK(phase)
+#define PROF_TICK_START()
+#define PROF_TICK_END()
+
+#endif
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TickScheduler.h"
+
+//the scheduler that receives timer events. There is only one timer, so only one scheduler can be active
+static TickScheduler* activeScheduler = 0;
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+
+ISR(TIMER0_COMPB_vect){
+	activeScheduler->timerEvent(TICK_TIMER_US);
+}
+
+#define TS_ENTER_CRITICAL() uint8_t oldSREG = SREG; cli()
+#define TS_EXIT_CRITICAL() SREG = oldSREG
+#else
+static void hostTimerHook(){
+	activeScheduler->timerEvent(TICK_TIMER_US);
+}
+
+//the host simulator delivers timer events synchronously, so no locking is needed
+#define TS_ENTER_CRITICAL()
+#define TS_EXIT_CRITICAL()
+#endif
+
+TickScheduler::TickScheduler(unsigned long periodMicros){
+	period = periodMicros;
+	accumulator = 0;
+	pending = 0;
+	dueStamp = 0;
+	dueCount = 0;
+	tickDueCount = 0;
+	lastJitter = 0;
+	reset();
+}
+
+void TickScheduler::begin(){
+	TS_ENTER_CRITICAL();
+	accumulator = 0;
+	pending = 0;
+	activeScheduler = this;
+	TS_EXIT_CRITICAL();
+	#ifdef __AVR__
+	//compare-B fires once per Timer0 cycle, mid-way between the millis() overflows
+	OCR0B = 0x80;
+	TIMSK0 |= _BV(OCIE0B);
+	#else
+	hostAttachTimer(hostTimerHook, TICK_TIMER_US);
+	#endif
+}
+
+void TickScheduler::timerEvent(uint16_t elapsedMicros){
+	accumulator += elapsedMicros;
+	if(accumulator >= (long)period){
+		accumulator -= period;
+		dueCount++;
+		if(pending == 0){
+			dueStamp = micros() - accumulator;
+			pending = 1;
+		}else if(pending < TICK_MAX_BACKLOG){
+			pending++;
+		}else{
+			//drop the oldest pending tick, so the backlog is always the most recent ones
+			dueStamp += period;
+			missed++;
+		}
+	}
+}
+
+void TickScheduler::shift(long us){
+	TS_ENTER_CRITICAL();
+	accumulator += us;
+	TS_EXIT_CRITICAL();
+}
+
+boolean TickScheduler::due(){
+	if(pending == 0) return false;//a single byte, so safe to test without locking
+	unsigned long now = micros();
+	TS_ENTER_CRITICAL();
+	unsigned long jitter = now - dueStamp;
+	pending--;
+	//the next pending tick, if any, was due one period after this one
+	dueStamp += period;
+	tickDueCount = dueCount;
+	TS_EXIT_CRITICAL();
+	ticks++;
+	lastJitter = jitter;
+	//halve the sums before they overflow (after about three days at 16Hz), so the mean stays right on a display left running
+	if((sumJitter > 0x7FFFFFFFUL) || (jitterTicks > 0x7FFFFFFFUL)){
+		sumJitter >>= 1;
+		jitterTicks >>= 1;
+	}
+	sumJitter += jitter;
+	jitterTicks++;
+	if(jitter < minJitter) minJitter = jitter;
+	if(jitter > maxJitter) maxJitter = jitter;
+	return true;
+}
+
+void TickScheduler::endTick(){
+	if(dueCount != tickDueCount) overruns++;//a single byte, so safe to read without locking
+}
+
+void TickScheduler::reset(){
+	TS_ENTER_CRITICAL();
+	missed = 0;
+	TS_EXIT_CRITICAL();
+	ticks = 0;
+	overruns = 0;
+	minJitter = 0xFFFFFFFF;
+	maxJitter = 0;
+	sumJitter = 0;
+	jitterTicks = 0;
+}
+
+unsigned long TickScheduler::getTicks(){
+	return ticks;
+}
+
+uint16_t TickScheduler::getMissed(){
+	TS_ENTER_CRITICAL();
+	uint16_t m = missed;
+	TS_EXIT_CRITICAL();
+	return m;
+}
+
+uint16_t TickScheduler::getOverruns(){
+	return overruns;
+}
+
+unsigned long TickScheduler::getMinJitter(){
+	return ticks ? minJitter : 0;
+}
+
+unsigned long TickScheduler::getMaxJitter(){
+	return maxJitter;
+}
+
+unsigned long TickScheduler::getMeanJitter(){
+	return jitterTicks ? sumJitter / jitterTicks : 0;
+}
+
+unsigned long TickScheduler::getLastJitter(){
+	return lastJitter;
+}
+
+#ifndef TELEMETRY
+//TICK ticks missed overruns | jitter (us) min mean max
+void TickScheduler::dump(){
+	Serial.print(F("TICK "));
+	Serial.print(ticks);
+	Serial.print(' ');
+	Serial.print(getMissed());
+	Serial.print(' ');
+	Serial.print(overruns);
+	if(ticks > 0){
+		Serial.print(F(" | "));
+		Serial.print(minJitter);
+		Serial.print(' ');
+		Serial.print(getMeanJitter());
+		Serial.print(' ');
+		Serial.print(maxJitter);
+	}
+	Serial.println();
+	reset();
+}
+#endif
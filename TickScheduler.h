@@ -0,0 +1,80 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Fixed-period tick scheduler driven by a timer interrupt.
+ * On the target the Timer0 compare-B interrupt is used. Timer0 already overflows every 1024us (at 16MHz) for millis(),
+ * so no extra timer is needed and the ShiftPWM/IRremote timers are left alone. Each interrupt adds the elapsed time to an accumulator;
+ * whenever a whole period has built up a tick becomes due, and the remainder is carried forward so the tick rate does not drift.
+ * On the host the same timerEvent() is called by the simulator (see hal/HostSim.h), so it can be tested in simulated time.
+ *
+ * Usage: call begin() at the end of setup(); in loop(), if(due()){ ...tick work... endTick(); }
+ * If loop() falls behind, up to TICK_MAX_BACKLOG late ticks are run back to back to keep animation speed exact;
+ * any more are dropped and counted as missed.
+ */
+
+#ifndef TICKSCHEDULER_H
+#define TICKSCHEDULER_H
+
+#include <Arduino.h>
+#include "XmasConfig.h"
+
+//microseconds between Timer0 overflows: prescaler 64, 256 counts
+#define TICK_TIMER_US (64UL * 256UL * 1000000UL / F_CPU)
+#define TICK_MAX_BACKLOG 2
+
+class TickScheduler{
+	public:
+		TickScheduler(unsigned long periodMicros);
+		//start the timer interrupt. The first tick is due one period later
+		void begin();
+		//true if a tick is due; consumes it and records how late it is
+		boolean due();
+		//call at the end of the tick work; counts an overrun if another tick became due while it ran
+		void endTick();
+		//called from the timer interrupt with the time since the previous call
+		void timerEvent(uint16_t elapsedMicros);
+		//move the schedule: the next tick falls due this many microseconds sooner (later if negative). For keeping in step with
+		//another board's ticks (see SyncLink.h). Keep it well under a period: the ticks otherwise bunch up or pause
+		void shift(long us);
+		#ifndef TELEMETRY
+		//print the statistics to Serial and clear them
+		void dump();
+		#endif
+		void reset();
+		//statistics since the last reset
+		unsigned long getTicks();
+		uint16_t getMissed();
+		uint16_t getOverruns();
+		unsigned long getMinJitter();
+		unsigned long getMaxJitter();
+		//over the ticks since the last reset, weighted towards recent ones once there have been days of them (see due())
+		unsigned long getMeanJitter();
+		//lateness of the current (or last) tick
+		unsigned long getLastJitter();
+	private:
+		unsigned long period;
+		volatile long accumulator;//microseconds since the last due point; negative after a shift() later
+		volatile uint8_t pending;//ticks due but not yet started
+		volatile uint16_t missed;
+		volatile unsigned long dueStamp;//micros() at which the oldest pending tick became due
+		volatile uint8_t dueCount;//incremented, with wrap-round, each time a tick falls due
+		uint8_t tickDueCount;//dueCount when the current tick started
+		unsigned long ticks;
+		uint16_t overruns;
+		unsigned long minJitter;
+		unsigned long maxJitter;
+		unsigned long sumJitter;
+		unsigned long jitterTicks;//ticks in sumJitter
+		unsigned long lastJitter;
+};
+
+#endif
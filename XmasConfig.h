@@ -0,0 +1,42 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Build options. Included by sketch.cpp and by main.cpp, which needs to know whether the Arduino HardwareSerial is wanted. */
+
+#ifndef XMASCONFIG_H
+#define XMASCONFIG_H
+
+//uncomment for debug messages as text on Serial at 9600 baud. These wait whenever the Serial buffer is full, so can hold up a tick
+//#define DEBUG
+
+//uncomment to time each phase of loop() (see TickProfiler.h). IR_CH or 'p' on Serial prints and clears the statistics
+//(with DEBUG, these also print the tick scheduler statistics)
+//#define PROFILE
+
+//binary telemetry on the UART (see Telemetry.h), which never waits. It has its own UART driver, so the Arduino HardwareSerial
+//is then left out; hence it is only used when neither DEBUG nor PROFILE wants Serial. Define NO_TELEMETRY to leave the UART idle.
+//Programs can then also be uploaded over the UART while the board plays (see ProgramUpload.h)
+#if !defined(DEBUG) && !defined(PROFILE) && !defined(NO_TELEMETRY)
+#define TELEMETRY
+#endif
+
+//uncomment to drive the LED shift registers with binary code modulation (see BcmOutput.h) rather than the library's ShiftPWM
+//output, for much less interrupt load. The library must then be built with its ShiftPWM output left out (it then only computes
+//brightness, read with getBrightness()); both use Timer1
+//#define SBC_OUTPUT_BCM
+
+//uncomment when several boards drive one display, to keep their ticks, programs and oscillators in step over I2C (see SyncLink.h).
+//Every board runs the same build: the one with PIN_SYNC_FOLLOW open is the master, the others have it grounded. Every board
+//needs the same programs; an I2C EEPROM on the shared bus serves them all, so there can only be one
+//#define SYNC_I2C
+
+#endif
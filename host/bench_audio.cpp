@@ -0,0 +1,164 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Benchmark and check the AudioEnvelope kernel with recorded audio.
+ * The WAV file (PCM, 8 or 16 bit, any rate, first channel used) is resampled to the rate at which the AdcScanner
+ * converts the audio input and scaled to 10-bit ADC counts around 512, then fed through AudioEnvelope::sample().
+ * Without a file, 30s of a synthetic 120bpm kick drum over noise is used.
+ *
+ * Usage: bench-audio [--gain G] [--csv FILE] [file.wav]
+ *	--gain G     multiply the input before conversion to ADC counts (default 1: full scale = +/-511 counts)
+ *	--csv FILE   write time, level and beat once per 16Hz tick, as the sketch would see them
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "AudioEnvelope.cpp"
+#include "AdcScanner.h"
+
+#include <vector>
+
+//one audio conversion in every two
+static const double sampleRate = 1e6 / (2 * ADC_CONVERSION_US);
+
+void setup(){}
+void loop(){}
+
+static uint32_t rd32(const uint8_t* p){ return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static uint16_t rd16(const uint8_t* p){ return p[0] | (p[1] << 8); }
+
+//read the first channel of a PCM WAV file as samples in -1..1
+static bool readWav(const char* path, std::vector<float>& out, double& rate){
+	FILE* f = fopen(path, "rb");
+	if(!f){
+		fprintf(stderr, "cannot open %s\n", path);
+		return false;
+	}
+	std::vector<uint8_t> buf;
+	uint8_t tmp[65536];
+	size_t n;
+	while((n = fread(tmp, 1, sizeof(tmp), f)) > 0) buf.insert(buf.end(), tmp, tmp + n);
+	fclose(f);
+	if(buf.size() < 12 || memcmp(&buf[0], "RIFF", 4) || memcmp(&buf[8], "WAVE", 4)){
+		fprintf(stderr, "%s: not a RIFF/WAVE file\n", path);
+		return false;
+	}
+	int channels = 0, bits = 0, format = 0;
+	size_t pos = 12;
+	while(pos + 8 <= buf.size()){
+		uint32_t len = rd32(&buf[pos + 4]);
+		const uint8_t* d = &buf[pos + 8];
+		if(pos + 8 + len > buf.size()) len = buf.size() - pos - 8;
+		if(!memcmp(&buf[pos], "fmt ", 4) && len >= 16){
+			format = rd16(d);
+			channels = rd16(d + 2);
+			rate = rd32(d + 4);
+			bits = rd16(d + 14);
+		}else if(!memcmp(&buf[pos], "data", 4)){
+			if(format != 1 || channels < 1 || (bits != 8 && bits != 16)){
+				fprintf(stderr, "%s: only 8/16-bit PCM is supported\n", path);
+				return false;
+			}
+			size_t frame = channels * bits / 8;
+			for(size_t i = 0; i + frame <= len; i += frame){
+				out.push_back(bits == 16 ? (int16_t)rd16(d + i) / 32768.0f : (d[i] - 128) / 128.0f);
+			}
+			return true;
+		}
+		pos += 8 + len + (len & 1);
+	}
+	fprintf(stderr, "%s: no data chunk\n", path);
+	return false;
+}
+
+//120bpm kick drum (decaying 55Hz burst) over low-level noise, at the ADC audio rate
+static void synthesise(std::vector<float>& out, double& rate){
+	rate = sampleRate;
+	uint32_t seed = 1;
+	for(int i = 0; i < (int)(30 * rate); i++){
+		double t = i / rate;
+		double tb = fmod(t, 0.5);
+		seed = seed * 1664525UL + 1013904223UL;
+		double noise = ((seed >> 8) / 16777216.0 - 0.5) * 0.1;
+		out.push_back((float)(0.8 * exp(-tb * 18) * sin(2 * M_PI * 55 * tb) + noise));
+	}
+}
+
+int main(int argc, char** argv){
+	double gain = 1;
+	const char* csvPath = 0;
+	const char* wavPath = 0;
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "--gain") && i + 1 < argc){
+			gain = atof(argv[++i]);
+		}else if(!strcmp(argv[i], "--csv") && i + 1 < argc){
+			csvPath = argv[++i];
+		}else if(argv[i][0] != '-'){
+			wavPath = argv[i];
+		}else{
+			fprintf(stderr, "usage: bench-audio [--gain G] [--csv FILE] [file.wav]\n");
+			return 2;
+		}
+	}
+
+	std::vector<float> in;
+	double inRate;
+	if(wavPath){
+		if(!readWav(wavPath, in, inRate)) return 1;
+	}else{
+		synthesise(in, inRate);
+	}
+
+	//resample (linear interpolation) and convert to ADC counts
+	std::vector<uint16_t> adc;
+	double step = inRate / sampleRate;
+	for(double p = 0; p + 1 < in.size(); p += step){
+		size_t i = (size_t)p;
+		double v = in[i] + (in[i + 1] - in[i]) * (p - i);
+		long c = lround(512 + v * gain * 511);
+		adc.push_back(c < 0 ? 0 : (c > 1023 ? 1023 : c));
+	}
+	double seconds = adc.size() / sampleRate;
+
+	//timed run
+	AudioEnvelope env;
+	uint64_t t0 = HostSim::wallNanos();
+	for(size_t i = 0; i < adc.size(); i++) env.sample(adc[i]);
+	uint64_t t1 = HostSim::wallNanos();
+	uint16_t beats = env.beatCount();
+
+	//second run, sampling the outputs at the tick rate as the sketch does
+	if(csvPath){
+		FILE* csv = fopen(csvPath, "w");
+		if(!csv){
+			fprintf(stderr, "cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "ms,level,beat\n");
+		AudioEnvelope env2;
+		size_t perTick = (size_t)(sampleRate / 16);
+		for(size_t i = 0; i < adc.size(); i++){
+			env2.sample(adc[i]);
+			if(i % perTick == perTick - 1){
+				fprintf(csv, "%.0f,%u,%d\n", i * 1000 / sampleRate, env2.level(), env2.beat() ? 1023 : 0);
+			}
+		}
+		fclose(csv);
+	}
+
+	double ns = (double)(t1 - t0) / adc.size();
+	printf("input        %s, %.1f s at %.0f Hz -> %zu samples at %.0f Hz\n", wavPath ? wavPath : "synthetic 120bpm kick",
+		seconds, inRate, adc.size(), sampleRate);
+	printf("kernel       %.1f ns/sample on this host (%.0fx real time)\n", ns, ns > 0 ? 1e9 / (ns * sampleRate) : 0.0);
+	printf("beats        %u (%.1f per minute)\n", beats, seconds > 0 ? beats * 60 / seconds : 0.0);
+	return 0;
+}
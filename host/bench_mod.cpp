@@ -0,0 +1,142 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Cost and accuracy of the modulation matrix (../ModMatrix.h) with every bus in use and MOD_TERMS terms each, i.e. the most it
+ * can cost in a tick: when all of its sources change, every bus is evaluated. The cost does not depend on the number of LEDs;
+ * any number of LEDs may be patched to the same buses.
+ *
+ * Checked: evaluate() against a reference for random sources and depths; a sum must be exact, a product within one step per
+ * term (it is truncated after each multiply). Measured on the host: the wall time per tick's evaluation. Estimated: AVR cycles,
+ * from the per-term costs below (avr-gcc, not cycle-counted): a 16x8 bit signed multiply into 32 bits is a library call of
+ * about 30 cycles; a product bus also does a 32x16 bit multiply per term.
+ *
+ * Usage: bench-mod
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "ModMatrix.cpp"
+
+void setup(){}
+void loop(){}
+
+//estimated AVR cycles
+#define MOD_BUS_FIXED 30 //call, count and mode, saturation
+#define MOD_SUM_TERM 50 //pointer and depth loads, multiply, 32 bit add, the sketch's change check
+#define MOD_PRODUCT_TERM 95 //as a sum term, plus saturation and a 32x16 bit multiply
+
+#define SRC_COUNT 32
+#define TRIALS 20000
+
+static uint16_t srcVals[SRC_COUNT];
+static uint8_t defs[MOD_BUSES][MOD_BUS_BYTES];
+
+static long reference(const uint8_t* def){
+	uint8_t n = def[0] & MOD_COUNT_MASK;
+	if(n == 0) return 0;
+	double acc = (def[0] & MOD_PRODUCT) ? 1.0 : 0.0;
+	for(uint8_t i = 0; i < n; i++){
+		uint8_t s = def[1 + 2*i];
+		double v = (s & 0x80) ? (s & 0x7F) << 3 : srcVals[s];
+		double t = v * (signed char)def[2 + 2*i] / 64;
+		if(def[0] & MOD_PRODUCT){
+			t = floor(t);
+			if(t < 0) t = 0;
+			if(t > 1023) t = 1023;
+			acc *= t / 1024;
+		}else{
+			acc += t;
+		}
+	}
+	if(def[0] & MOD_PRODUCT) acc *= 1024;
+	acc = floor(acc);
+	if(acc < 0) return 0;
+	if(acc > 1023) return 1023;
+	return (long)acc;
+}
+
+static void randomDefs(uint8_t mode){
+	for(uint8_t bus = 0; bus < MOD_BUSES; bus++){
+		defs[bus][0] = MOD_TERMS | mode;
+		for(uint8_t i = 0; i < MOD_TERMS; i++){
+			//mostly variable sources, some constants
+			defs[bus][1 + 2*i] = (random(8) == 0) ? 0x80 | random(128) : random(SRC_COUNT);
+			defs[bus][2 + 2*i] = random(256);
+		}
+	}
+}
+
+//largest error over the trials
+static long check(uint8_t mode){
+	ModMatrix m;
+	long worst = 0;
+	for(int t = 0; t < TRIALS; t++){
+		randomDefs(mode);
+		//product terms are mostly positive in use; make the depths so, or nearly every product is 0
+		if(mode){
+			for(uint8_t bus = 0; bus < MOD_BUSES; bus++){
+				for(uint8_t i = 0; i < MOD_TERMS; i++) defs[bus][2 + 2*i] = 32 + random(96);
+			}
+		}
+		for(uint8_t s = 0; s < SRC_COUNT; s++) srcVals[s] = random(1025);
+		m.compile(defs, srcVals, SRC_COUNT);
+		for(uint8_t bus = 0; bus < MOD_BUSES; bus++){
+			long err = labs((long)m.evaluate(bus) - reference(defs[bus]));
+			if(err > worst) worst = err;
+		}
+	}
+	return worst;
+}
+
+//host nanoseconds to evaluate every bus once
+static double timeAll(uint8_t mode){
+	ModMatrix m;
+	randomDefs(mode);
+	m.compile(defs, srcVals, SRC_COUNT);
+	const unsigned long rounds = 200000;
+	volatile uint16_t sink = 0;
+	uint64_t t0 = HostSim::wallNanos();
+	for(unsigned long r = 0; r < rounds; r++){
+		srcVals[r & (SRC_COUNT - 1)] = r & 1023;
+		for(uint8_t bus = 0; bus < MOD_BUSES; bus++) sink += m.evaluate(bus);
+	}
+	(void)sink;
+	return (double)(HostSim::wallNanos() - t0) / rounds;
+}
+
+int main(){
+	randomSeed(1);
+	long sumErr = check(0);
+	long productErr = check(MOD_PRODUCT);
+
+	printf("%d buses of %d terms, all evaluated each tick (the worst case). AVR cycles estimated\n", MOD_BUSES, MOD_TERMS);
+	printf("%-8s %10s %12s %10s %10s %10s\n", "mode", "host ns", "AVR cycles", "16Hz tick", "200Hz tick", "max error");
+	const char* names[2] = {"sum", "product"};
+	long errs[2] = {sumErr, productErr};
+	int status = 0;
+	for(int k = 0; k < 2; k++){
+		uint8_t mode = k ? MOD_PRODUCT : 0;
+		double cycles = MOD_BUSES * (MOD_BUS_FIXED + MOD_TERMS * (double)(k ? MOD_PRODUCT_TERM : MOD_SUM_TERM));
+		printf("%-8s %10.0f %12.0f %9.3f%% %9.3f%% %10ld\n", names[k], timeAll(mode), cycles, 100 * cycles * 16 / F_CPU,
+			100 * cycles * 200 / F_CPU, errs[k]);
+	}
+	if(sumErr != 0){
+		printf("FAIL: a sum bus differs from the reference\n");
+		status = 1;
+	}
+	if(productErr > MOD_TERMS){
+		printf("FAIL: a product bus differs from the reference by more than %d\n", MOD_TERMS);
+		status = 1;
+	}
+	return status;
+}
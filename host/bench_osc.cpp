@@ -0,0 +1,179 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Checks and per-tick cost of the oscillator bank (../OscBank.h).
+ *
+ * Checked:
+ *	- the LFO, program cycling and trigger/gate mask oscillators against the accumulators they replaced, tick for tick at 16Hz,
+ *	  with random rate changes: the LFO value and every wrap must be identical;
+ *	- speed at 16..200Hz ticks: cycles in 10 simulated minutes must match 16Hz to within 1 in 10^5;
+ *	- the sine table against 512 + 511 sin(), within 1.25 (table and interpolation rounding);
+ *	- smooth random: no step between ticks larger than the fastest rate allows.
+ * Measured on the host: the wall time of one tick's update() and value() for every oscillator. Estimated: AVR cycles, from the
+ * per-oscillator costs below (avr-gcc, not cycle-counted).
+ *
+ * Usage: bench-osc
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "OscBank.cpp"
+
+void setup(){}
+void loop(){}
+
+//estimated AVR cycles
+#define OSC_UPDATE_CYCLES 75 //16x32 bit multiply, 32 bit add and carry test, mode tests
+#define OSC_VALUE_SINE 90 //two table reads and an 8x16 bit interpolation
+#define OSC_VALUE_SIMPLE 25 //triangle, saw, square
+
+#define SRC_COUNT 4
+static uint16_t srcVals[SRC_COUNT];
+
+//the original accumulators at 16Hz: added (rate >> shift) per tick, acting at 2048
+static int checkLegacy(){
+	OscBank bank;
+	bank.begin(srcVals, SRC_COUNT, OSC_STEP(16));
+	bank.setWave(0, OSC_TRIANGLE);
+	bank.setRestart(1, true);
+	bank.setRestart(2, true);
+	bank.setRate(0, 0, 4, 0);
+	bank.setRate(1, 1, 5, 0);
+	bank.setRate(2, 2, 2, 0);
+	uint16_t lfo = 0, pc = 0, tgm = 0;
+	int failures = 0;
+	for(long t = 0; t < 1000000; t++){
+		if(t % 97 == 0){
+			for(uint8_t s = 0; s < 3; s++) srcVals[s] = random(1024);
+		}
+		lfo += srcVals[0] >> 4;
+		if(lfo >= 2048) lfo -= 2048;
+		uint16_t expect = (lfo < 1024) ? lfo : 2048 - lfo;
+		uint16_t expectWraps = 0;
+		pc += srcVals[1] >> 5;
+		if(pc >= 2048){
+			pc = 0;
+			expectWraps |= 2;
+		}
+		tgm += srcVals[2] >> 2;
+		if(tgm >= 2048){
+			tgm = 0;
+			expectWraps |= 4;
+		}
+		uint16_t wraps = bank.update() & 6;
+		if(bank.value(0) != expect || wraps != expectWraps){
+			if(failures++ == 0) printf("FAIL: tick %ld: LFO %u (expected %u), wraps %X (expected %X)\n", t, bank.value(0), expect,
+				wraps, expectWraps);
+		}
+	}
+	return failures;
+}
+
+//cycles of a general oscillator at the top rate in 10 minutes
+static double cycles(unsigned tickHz){
+	OscBank bank;
+	bank.begin(srcVals, SRC_COUNT, OSC_STEP(tickHz));
+	srcVals[3] = 1023;
+	bank.setRate(OSC_GENERAL, 3, 0, 4);
+	unsigned long wraps = 0;
+	unsigned long ticks = 600UL * tickHz;
+	for(unsigned long t = 0; t < ticks; t++){
+		if(bank.update() & (1 << OSC_GENERAL)) wraps++;
+	}
+	return wraps + bank.getPhase(OSC_GENERAL) / 4294967296.0;
+}
+
+static double sineError(){
+	OscBank bank;
+	bank.begin(srcVals, SRC_COUNT, 1 << 16);//one 65536th of a cycle per tick, for a rate of 1
+	srcVals[3] = 1;
+	bank.setRate(OSC_GENERAL, 3, 0, 0);
+	double worst = 0;
+	for(long t = 0; t < 65536; t++){
+		double expect = 512 + 511 * sin(2 * M_PI * bank.getPhase(OSC_GENERAL) / 4294967296.0);
+		double err = fabs(bank.value(OSC_GENERAL) - expect);
+		if(err > worst) worst = err;
+		bank.update();
+	}
+	return worst;
+}
+
+//largest change of a smooth random oscillator between ticks, at the top rate (a cycle in 32 ticks)
+static int randomStep(){
+	OscBank bank;
+	bank.begin(srcVals, SRC_COUNT, OSC_STEP(16));
+	srcVals[3] = 1023;
+	bank.setRate(OSC_GENERAL, 3, 0, 4);
+	bank.setWave(OSC_GENERAL, OSC_RANDOM);
+	int worst = 0;
+	int last = bank.value(OSC_GENERAL);
+	for(long t = 0; t < 100000; t++){
+		bank.update();
+		int v = bank.value(OSC_GENERAL);
+		if(abs(v - last) > worst) worst = abs(v - last);
+		last = v;
+	}
+	return worst;
+}
+
+int main(){
+	randomSeed(1);
+	int status = 0;
+
+	int legacy = checkLegacy();
+	printf("legacy accumulators  %s over 1000000 ticks\n", legacy ? "DIFFER" : "identical");
+	if(legacy) status = 1;
+
+	double base = cycles(16);
+	printf("speed                %.4f cycles in 10 min at 16Hz;", base);
+	const unsigned rates[] = {50, 100, 200};
+	for(int i = 0; i < 3; i++){
+		double c = cycles(rates[i]);
+		double ppm = 1e6 * (c - base) / base;
+		printf(" %uHz %+.2fppm", rates[i], ppm);
+		if(fabs(ppm) > 10) status = 1;
+	}
+	printf("\n");
+
+	double sinErr = sineError();
+	printf("sine                 max error %.2f\n", sinErr);
+	if(sinErr > 1.25) status = 1;
+
+	//a cycle is 32 ticks, and the half cosine is steepest (pi/2 of 1023 per half cycle) at its middle: about 1023*pi/2/32
+	int step = randomStep();
+	printf("smooth random        max step %d per tick\n", step);
+	if(step > 55) status = 1;
+
+	//cost: every oscillator, with the sketch's waves (triangle LFO, two timers that only update, and sines)
+	OscBank bank;
+	bank.begin(srcVals, SRC_COUNT, OSC_STEP(16));
+	for(uint8_t osc = 0; osc < OSC_BANK_SIZE; osc++) bank.setRate(osc, osc % SRC_COUNT, 0, 4);
+	bank.setWave(0, OSC_TRIANGLE);
+	const unsigned long rounds = 200000;
+	volatile uint16_t sink = 0;
+	uint64_t t0 = HostSim::wallNanos();
+	for(unsigned long r = 0; r < rounds; r++){
+		srcVals[r & (SRC_COUNT - 1)] = r & 1023;
+		sink += bank.update();
+		sink += bank.value(0);
+		for(uint8_t osc = OSC_GENERAL; osc < OSC_BANK_SIZE; osc++) sink += bank.value(osc);
+	}
+	(void)sink;
+	double ns = (double)(HostSim::wallNanos() - t0) / rounds;
+	double avr = OSC_BANK_SIZE * OSC_UPDATE_CYCLES + OSC_VALUE_SIMPLE + OSC_COUNT * OSC_VALUE_SINE;
+	printf("per tick             %d oscillators (%d general): host %.0f ns, AVR ~%.0f cycles = %.3f%% of a 16Hz tick, %.3f%% at 200Hz\n",
+		OSC_BANK_SIZE, OSC_COUNT, ns, avr, 100 * avr * 16 / F_CPU, 100 * avr * 200 / F_CPU);
+
+	if(status) printf("FAIL\n");
+	return status;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Interrupt load of the two output schemes, for several channel counts: the ShiftPWM-style PWM that the Shaped Brightness
+ * Controller library uses, and the BCM engine (../BcmOutput.h), both at BCM_BITS depth and BCM_FRAME_HZ refresh.
+ *
+ * The PWM scheme is modelled here as ShiftPWM does it: a counter runs 0..2^bits-1, one interrupt per step, and each interrupt
+ * compares every channel with the counter, shifts the result out and latches it. BcmOutput is the sketch's own code, run by
+ * the simulated timer.
+ *
+ * Measured, in simulated time: interrupts per second, bytes shifted per second, and the duty cycle of every channel over whole
+ * frames, which is checked against its value (a test ramp). Measured on the host: the wall time of one second's interrupts.
+ * Estimated: AVR cycles per second, from the measured counts and the per-interrupt costs below (avr-gcc, not cycle-counted):
+ * a PWM interrupt spends about 5 cycles comparing each channel; a BCM interrupt about 24 cycles per byte, waiting on the SPI.
+ *
+ * Usage: bench-output [channels...]   default 3 9 24 48 96
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "BcmOutput.cpp"
+
+#include <vector>
+
+void setup(){}
+void loop(){}
+
+//estimated AVR cycles
+#define PWM_ISR_FIXED 80 //entry, register saves, counter, latch, exit
+#define PWM_CYCLES_PER_CHANNEL 5
+#define BCM_ISR_FIXED 90 //entry, register saves, latch, OCR1A, plane select, exit
+#define BCM_CYCLES_PER_BYTE 24
+
+//the ShiftPWM scheme
+class PwmModel{
+	public:
+		PwmModel(uint8_t numChannels){
+			this->numChannels = numChannels;
+			numRegisters = (numChannels + 7) >> 3;
+			counter = BCM_MAX_VALUE;
+			interrupts = 0;
+			bytesShifted = 0;
+			value.assign(numRegisters * 8, 0);
+			latched.assign(numRegisters, 0);
+		}
+		void set(uint8_t channel, uint16_t v){
+			value[channel] = v;
+		}
+		void isr(){
+			interrupts++;
+			counter = (counter + 1) & BCM_MAX_VALUE;
+			for(uint8_t r = numRegisters; r > 0; r--){
+				uint8_t b = 0;
+				const uint16_t* v = &value[(r - 1) * 8];
+				for(uint8_t i = 0; i < 8; i++){
+					if(v[i] > counter) b |= 1 << i;
+				}
+				latched[r - 1] = b;
+			}
+			bytesShifted += numRegisters;
+		}
+		boolean getLatched(uint8_t channel){
+			return (latched[channel >> 3] >> (channel & 7)) & 1;
+		}
+		uint8_t numChannels;
+		uint8_t numRegisters;
+		uint16_t counter;
+		unsigned long interrupts;
+		unsigned long bytesShifted;
+	private:
+		std::vector<uint16_t> value;
+		std::vector<uint8_t> latched;
+};
+
+//a spread of values across the channels, including 0 and full scale
+static uint16_t testValue(uint8_t channel, uint8_t numChannels){
+	if(numChannels == 1) return BCM_MAX_VALUE;
+	return (uint32_t)channel * BCM_MAX_VALUE / (numChannels - 1);
+}
+
+struct Result{
+	double isrPerSec;
+	double bytesPerSec;
+	double cyclesPerSec;
+	double hostNsPerSec;
+	double maxDutyError;//in units of one step, 1/2^bits
+};
+
+#define FRAMES 32
+
+static Result benchPwm(uint8_t n){
+	PwmModel pwm(n);
+	for(uint8_t c = 0; c < n; c++) pwm.set(c, testValue(c, n));
+	//one interrupt per step; duty over whole frames, with "on" for value steps out of 2^bits
+	const unsigned long steps = (unsigned long)(BCM_MAX_VALUE + 1) * FRAMES;
+	std::vector<unsigned long> on(n, 0);
+	for(unsigned long s = 0; s < steps; s++){
+		pwm.isr();
+		for(uint8_t c = 0; c < n; c++) on[c] += pwm.getLatched(c);
+	}
+	Result r;
+	r.maxDutyError = 0;
+	for(uint8_t c = 0; c < n; c++){
+		double err = fabs((double)on[c] / FRAMES - testValue(c, n));
+		if(err > r.maxDutyError) r.maxDutyError = err;
+	}
+	double secs = (double)steps / ((BCM_MAX_VALUE + 1) * (double)BCM_FRAME_HZ);
+	r.isrPerSec = pwm.interrupts / secs;
+	r.bytesPerSec = pwm.bytesShifted / secs;
+	r.cyclesPerSec = r.isrPerSec * (PWM_ISR_FIXED + PWM_CYCLES_PER_CHANNEL * 8.0 * pwm.numRegisters);
+	//one second's interrupts, without the sampling
+	unsigned long perSec = (unsigned long)(BCM_MAX_VALUE + 1) * BCM_FRAME_HZ;
+	uint64_t t0 = HostSim::wallNanos();
+	for(unsigned long s = 0; s < perSec; s++) pwm.isr();
+	r.hostNsPerSec = HostSim::wallNanos() - t0;
+	return r;
+}
+
+static Result benchBcm(uint8_t n){
+	static BcmOutput bcm;//only one can be attached to the simulated timer
+	bcm.begin(n);
+	for(uint8_t c = 0; c < n; c++) bcm.set(c, testValue(c, n));
+	//the simulated timer period is one LSB plane, so sampling once per period sees every plane for its length.
+	//The first frame is skipped: the planes only start with the first interrupt
+	uint32_t lsbMicros = BCM_LSB_COUNTS * 8 * 1000000UL / F_CPU;
+	if(lsbMicros == 0) lsbMicros = 1;
+	for(unsigned long s = 0; s < BCM_MAX_VALUE; s++) HostSim::advance(lsbMicros);
+	unsigned long isr0 = bcm.getInterrupts();
+	unsigned long bytes0 = bcm.getBytesShifted();
+	const unsigned long steps = (unsigned long)BCM_MAX_VALUE * FRAMES;
+	std::vector<unsigned long> on(n, 0);
+	for(unsigned long s = 0; s < steps; s++){
+		HostSim::advance(lsbMicros);
+		for(uint8_t c = 0; c < n; c++) on[c] += bcm.getLatched(c);
+	}
+	Result r;
+	r.maxDutyError = 0;
+	for(uint8_t c = 0; c < n; c++){
+		double err = fabs((double)on[c] / FRAMES - testValue(c, n));
+		if(err > r.maxDutyError) r.maxDutyError = err;
+	}
+	double secs = (double)steps / (BCM_MAX_VALUE * (double)BCM_FRAME_HZ);
+	r.isrPerSec = (bcm.getInterrupts() - isr0) / secs;
+	r.bytesPerSec = (bcm.getBytesShifted() - bytes0) / secs;
+	r.cyclesPerSec = r.isrPerSec * (BCM_ISR_FIXED + BCM_CYCLES_PER_BYTE * (r.bytesPerSec / r.isrPerSec));
+	unsigned long perSec = (unsigned long)BCM_BITS * BCM_FRAME_HZ;
+	uint64_t t0 = HostSim::wallNanos();
+	for(unsigned long s = 0; s < perSec; s++) bcm.timerEvent();
+	r.hostNsPerSec = HostSim::wallNanos() - t0;
+	return r;
+}
+
+int main(int argc, char** argv){
+	std::vector<int> counts;
+	for(int i = 1; i < argc; i++){
+		int n = atoi(argv[i]);
+		if(n < 1 || n > BCM_MAX_CHANNELS){
+			fprintf(stderr, "usage: bench-output [channels...] (1..%d)\n", BCM_MAX_CHANNELS);
+			return 2;
+		}
+		counts.push_back(n);
+	}
+	if(counts.empty()){
+		int def[] = {3, 9, 24, 48, 96};
+		counts.assign(def, def + 5);
+	}
+	HostSim::setClockMode(HostSim::FAST);
+
+	printf("%d bit, %d Hz refresh, F_CPU %.0f MHz. Interrupt and byte counts measured in simulated time; AVR cycles estimated\n",
+		BCM_BITS, BCM_FRAME_HZ, F_CPU / 1e6);
+	printf("%-8s %-4s %10s %10s %14s %7s %12s %10s\n", "channels", "", "ISR/s", "bytes/s", "AVR cycles/s", "CPU", "host ns/s",
+		"duty err");
+	int status = 0;
+	for(size_t i = 0; i < counts.size(); i++){
+		uint8_t n = counts[i];
+		Result pwm = benchPwm(n);
+		Result bcm = benchBcm(n);
+		printf("%-8u %-4s %10.0f %10.0f %14.0f %6.2f%% %12.0f %10.2f\n", n, "PWM", pwm.isrPerSec, pwm.bytesPerSec, pwm.cyclesPerSec,
+			100 * pwm.cyclesPerSec / F_CPU, pwm.hostNsPerSec, pwm.maxDutyError);
+		printf("%-8s %-4s %10.0f %10.0f %14.0f %6.2f%% %12.0f %10.2f   (%.1fx less interrupt load)\n", "", "BCM", bcm.isrPerSec,
+			bcm.bytesPerSec, bcm.cyclesPerSec, 100 * bcm.cyclesPerSec / F_CPU, bcm.hostNsPerSec, bcm.maxDutyError,
+			pwm.cyclesPerSec / bcm.cyclesPerSec);
+		//both must reproduce every value exactly over whole frames
+		if(pwm.maxDutyError > 0.001 || bcm.maxDutyError > 0.001) status = 1;
+	}
+	if(status) printf("FAIL: a channel's duty cycle does not match its value\n");
+	return status;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Checks and speed of the trigger/gate mask sequencer (../TgmSequencer.h).
+ *
+ * Checked:
+ *	- the built-in programs against the updateTGM() switch they replaced (copied below), step for step, over random sequences of
+ *	  pattern changes (with and without TRIPLIFY, and with the A/B direction carried from pattern to pattern) for 3, 10 and 24 LEDs;
+ *	- the ops that the built-in programs do not use (ror, xor, loop, step holds), on a small program;
+ *	- that a program with no STEP ends each step after TGS_MAX_OPS ops.
+ * Measured on the host: steps per second for each built-in program. Estimated: AVR cycles and steps per second, from the ops run
+ * per step and the per-op cost below (avr-gcc, not cycle-counted): a mask op is a loop or two over the mask bytes.
+ *
+ * Usage: bench-tgm
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "TgmSequencer.h"
+
+void setup(){}
+void loop(){}
+
+//estimated AVR cycles
+#define TGS_OP_CYCLES 30 //fetch, argument, dispatch
+#define TGS_BYTE_CYCLES 12 //per mask byte, e.g. a shift and an AND
+
+#define PATTERN_TRIPLIFY 128
+
+//the mask patterns as updateTGM() had them, before the sequencer
+template <uint8_t LEDS>
+class LegacyTgm{
+	public:
+		LegacyTgm(){
+			ab = true;
+			load(0);
+		}
+		void load(uint8_t pattern){
+			this->pattern = pattern;
+			runLength = (pattern & PATTERN_TRIPLIFY) ? 3 : LEDS;
+			mask.setOnly(0);
+			maskMask.setLow(runLength);
+			bit0.setOnly(0);
+			bit1.setOnly(1);
+			topBit.setOnly(runLength - 1);
+		}
+		void step(){
+			switch(pattern & 0xF){
+				case 1:
+					mask.shiftUp(false);
+					if(mask.test(runLength)) mask.setOnly(0);
+					break;
+				case 2:
+					if(ab){
+						mask.shiftUp(true);
+						mask.andWith(maskMask);
+						if(mask == maskMask) ab = !ab;
+					}else{
+						mask.shiftDown();
+						if(mask == bit0) ab = !ab;
+					}
+					break;
+				case 3:
+					if(ab){
+						mask.shiftUp(true);
+						mask.andWith(maskMask);
+						if(mask == maskMask) ab = !ab;
+					}else{
+						mask.shiftUp(false);
+						mask.andWith(maskMask);
+						if(mask == topBit) ab = !ab;
+					}
+					break;
+				case 4:
+					mask.shiftUp(false);
+					if(mask == bit1) mask.set(0);
+					mask.andWith(maskMask);
+					if(mask.isZero()) mask.setOnly(0);
+					break;
+			}
+		}
+		LedBits<LEDS + 1> mask;
+		uint8_t runLength;
+	private:
+		LedBits<LEDS + 1> maskMask, bit0, bit1, topBit;
+		uint8_t pattern;
+		bool ab;
+};
+
+template <uint8_t LEDS>
+static long checkLegacy(){
+	LegacyTgm<LEDS> legacy;
+	TgmSequencer<LEDS> seq;
+	long failures = 0;
+	for(int load = 0; load < 5000; load++){
+		uint8_t pattern = random(5) | (random(2) ? PATTERN_TRIPLIFY : 0);
+		legacy.load(pattern);
+		seq.loadBuiltin(pattern & 0xF, legacy.runLength);
+		for(int s = random(1, 80); s > 0; s--){
+			legacy.step();
+			seq.step();
+			for(uint8_t i = 0; i < legacy.runLength; i++){
+				if(legacy.mask.test(i) != seq.test(i)){
+					if(failures++ == 0) printf("FAIL: %d LEDs, pattern %02X: bit %u differs\n", LEDS, pattern, i);
+					break;
+				}
+			}
+		}
+	}
+	return failures;
+}
+
+template <uint8_t LEDS>
+static unsigned maskOf(const TgmSequencer<LEDS>& seq, uint8_t bits){
+	unsigned m = 0;
+	for(uint8_t i = 0; i < bits; i++) m |= seq.test(i) << i;
+	return m;
+}
+
+//rol, twice more by the loop, then invert and hold a step; ror; then round again from the start: 010 100 001 110 110 011 110 ...
+static int checkOps(){
+	static const uint8_t program[] = {TGS_ROL, TGS_STEP, TGS_LOOP | 2, 0, TGS_XOR, TGS_XOR_RUN, TGS_STEP | 1, TGS_ROR, TGS_STEP};
+	static const unsigned expect[] = {2, 4, 1, 6, 6, 3, 6, 5, 3, 4};
+	TgmSequencer<3> seq;
+	seq.load(program, sizeof(program), 3);
+	for(unsigned s = 0; s < sizeof(expect) / sizeof(expect[0]); s++){
+		seq.step();
+		unsigned got = maskOf(seq, 3);
+		if(got != expect[s]){
+			printf("FAIL: op check step %u: mask %u, expected %u\n", s + 1, got, expect[s]);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int checkBound(){
+	static const uint8_t program[] = {TGS_ROL, TGS_JMP, 0};
+	TgmSequencer<24> seq;
+	seq.load(program, sizeof(program), 24);
+	uint8_t ops = seq.step();
+	if(ops != TGS_MAX_OPS){
+		printf("FAIL: a program without STEP ran %u ops in a step\n", ops);
+		return 1;
+	}
+	return 0;
+}
+
+template <uint8_t LEDS>
+static void bench(){
+	static const char* const names[] = {"", "single", "grow", "pass", "double"};
+	for(uint8_t n = 1; n < TGS_BUILTINS; n++){
+		TgmSequencer<LEDS> seq;
+		seq.loadBuiltin(n, LEDS);
+		const unsigned long steps = 1000000;
+		unsigned long ops = 0;
+		uint8_t maxOps = 0;
+		volatile unsigned sink = 0;
+		uint64_t t0 = HostSim::wallNanos();
+		for(unsigned long s = 0; s < steps; s++){
+			uint8_t o = seq.step();
+			ops += o;
+			if(o > maxOps) maxOps = o;
+			sink += seq.test(0);
+		}
+		double ns = (double)(HostSim::wallNanos() - t0) / steps;
+		(void)sink;
+		double perOp = TGS_OP_CYCLES + TGS_BYTE_CYCLES * ((LEDS + 7) / 8);
+		double cycles = perOp * ops / steps;
+		printf("%-6u %-8s %8.2f %8u %12.0f %10.0f %14.0f\n", LEDS, names[n], (double)ops / steps, maxOps, 1e9 / ns, cycles,
+			F_CPU / cycles);
+	}
+}
+
+int main(){
+	randomSeed(1);
+	int status = 0;
+	long legacy = checkLegacy<3>() + checkLegacy<10>() + checkLegacy<24>();
+	printf("built-in programs    %s to the patterns they replace (3, 10, 24 LEDs)\n", legacy ? "NOT identical" : "identical");
+	if(legacy) status = 1;
+	if(checkOps()) status = 1;
+	else printf("other ops            ok\n");
+	if(checkBound()) status = 1;
+	else printf("step bound           a program without STEP stops after %d ops\n", TGS_MAX_OPS);
+
+	printf("\n%-6s %-8s %8s %8s %12s %10s %14s\n", "LEDs", "program", "ops/step", "max ops", "host steps/s", "AVR cycles",
+		"AVR steps/s");
+	bench<3>();
+	bench<24>();
+	bench<96>();
+	if(status) printf("FAIL\n");
+	return status;
+}
@@ -0,0 +1,485 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Convert a legacy EEPROM image (Intel HEX, as in "EEPROM Programs") to PROG_FORMAT_COMPACT (see ProgramDecoder.h).
+ * Each program is encoded as the shortest of: per-LED ops only, ALL from LED 0, or TRIPLE from LEDs 0 and 1, followed by
+ * per-LED ops for the LEDs that differ. Patches used more than once across the image go in the dictionary.
+ * Every program is decoded again with the sketch's ProgramDecoder and compared with the original before the output is written.
+ * (Before that, the decoder is checked to refuse a dictionary reference on an op that has no patch.)
+ *
+ * Mod buses (ModMatrix.h), which a legacy image cannot hold, may be added to programs with --mod, once per bus:
+ *	PROGRAM:BUS:sum|product:LED|all:rate|scale|tg|none:SRC/DEPTH[,SRC/DEPTH...]
+ * e.g. 3:0:product:all:scale:0x0D/64,0x06/64 makes the scale of every LED in program 3 the LFO times the LDR (VR3).
+ * Sources are srcVals indeces (as in a patch; 0x prefix for hex), depths are 64ths (-128..127).
+ * General oscillators (OscBank.h) are set up with --osc, once per oscillator:
+ *	PROGRAM:OSC:sine|triangle|saw|square|random:RATE_SRC
+ * and a program's trigger/gate mask can be given its own mask program (TgmSequencer.h) with --tgm:
+ *	PROGRAM:RATE_SRC:OP,OP...
+ * where each OP is step [N], shl [N], shr [N], rol, ror, set B, clr, xor B|run, if [not] zero|full|bit0|bit1|top|b, bounce,
+ * loop N B or jmp B; jump targets B are byte offsets. e.g. 2:0x04:clr,set 2,step,xor run,step,clr,step 3 flashes the top LED and
+ * then the others, holding all off for 4 steps at the mask rate set by VR1. The TRIPLIFY flag of the program is kept.
+ *
+ * Usage: encode-programs [--mod SPEC]... [--osc SPEC]... [--tgm SPEC]... in.hex out.hex
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "EEPROM.cpp"
+#include "Wire.cpp"
+#include "ProgramStore.cpp"
+#include "ProgramDecoder.cpp"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+static int numLeds;
+//decoding reads the dictionary from HostSim::eeprom through this
+static ProgramStore store;
+
+//the decoded form of a program, with the bytes that the sketch ignores set to 0xFF as the decoder sets them
+static Bytes normalise(const uint8_t* p){
+	Bytes img(p, p + 8 + numLeds*8);
+	img.resize(PROG_IMAGE_BYTES(numLeds), 0);//no mod buses
+	img[1] = img[2] = img[3] = 0xFF;
+	img[6] = img[7] = 0xFF;
+	for(int led = 0; led < numLeds; led++) img[8 + led*4 + 1] = 0xFF;
+	return img;
+}
+
+static void patternOf(const Bytes& img, int led, uint8_t* out){
+	out[0] = img[8 + led*4];
+	out[1] = img[8 + led*4 + 2];
+	out[2] = img[8 + led*4 + 3];
+}
+
+static void patchOf(const Bytes& img, int led, uint8_t* out){
+	memcpy(out, &img[8 + numLeds*4 + led*4], 4);
+}
+
+//decode a program body (no length prefix) with the dictionary currently in HostSim::eeprom
+static Bytes decode(const Bytes& body, int dictCount){
+	Bytes img(PROG_IMAGE_BYTES(numLeds));
+	ProgramDecoder d;
+	d.begin(PROG_FORMAT_COMPACT, &img[0], numLeds, &store, 8, dictCount);
+	for(size_t i = 0; i < body.size(); i++) d.feed(body[i]);
+	return d.error() ? Bytes() : img;
+}
+
+//the decoder must refuse a dictionary reference on an op that carries no patch (MOD, OSC, TGM), rather than take it for another op
+static bool rejectsFlaggedOps(){
+	//each with the arguments of the unflagged op (a bus of no terms, an oscillator, a mask program of no code) and a dictionary
+	//entry for it to reach if it were taken for ALL
+	const uint8_t ops[] = {PROG_OP_MOD, PROG_OP_OSC, PROG_OP_TGM};
+	const uint8_t argLens[] = {4, 2, 1};
+	for(size_t i = 0; i < sizeof(ops); i++){
+		Bytes body(3, 0);
+		body.push_back(ops[i] | PROG_OP_PATCH_REF);
+		body.insert(body.end(), argLens[i], 0);
+		if(!decode(body, 1).empty()){
+			fprintf(stderr, "decoder accepted op 0x%02X\n", ops[i] | PROG_OP_PATCH_REF);
+			return false;
+		}
+	}
+	return true;
+}
+
+//append an op. The patch is replaced by a dictionary reference if it is in the dictionary
+static void addOp(Bytes& out, uint8_t op, const Bytes& pre, const uint8_t* pattern, uint8_t* patch,
+		const std::map<uint32_t, int>& dict){
+	uint32_t key = (patch[0] << 24) | (patch[1] << 16) | (patch[2] << 8) | patch[3];
+	std::map<uint32_t, int>::const_iterator it = dict.find(key);
+	out.push_back(it == dict.end() ? op : op | PROG_OP_PATCH_REF);
+	out.insert(out.end(), pre.begin(), pre.end());
+	out.insert(out.end(), pattern, pattern + 3);
+	if(it == dict.end()){
+		out.insert(out.end(), patch, patch + 4);
+	}else{
+		out.push_back((uint8_t)it->second);
+	}
+}
+
+//encode one program; base is 0 (none), PROG_OP_ALL or PROG_OP_TRIPLE
+static Bytes encodeWith(const Bytes& img, uint8_t base, const std::map<uint32_t, int>& dict, int dictCount){
+	Bytes out;
+	out.push_back(img[0]);
+	out.push_back(img[4]);
+	out.push_back(img[5]);
+	uint8_t pattern[3], patch[4];
+	if(base){
+		Bytes pre;
+		patternOf(img, 0, pattern);
+		patchOf(img, 0, patch);
+		if(base == PROG_OP_TRIPLE){
+			if(numLeds < 2) return Bytes();
+			int step = ((img[12 + 2] << 8) | img[12 + 3]) - ((pattern[1] << 8) | pattern[2]);
+			pre.push_back((uint8_t)(step >> 8));
+			pre.push_back((uint8_t)step);
+		}
+		addOp(out, base, pre, pattern, patch, dict);
+	}
+	Bytes got = decode(out, dictCount);
+	if(got.empty()) return Bytes();
+	for(int led = 0; led < numLeds; led++){
+		bool same = !memcmp(&got[8 + led*4], &img[8 + led*4], 4) &&
+			!memcmp(&got[8 + numLeds*4 + led*4], &img[8 + numLeds*4 + led*4], 4);
+		if(same) continue;
+		Bytes pre(1, (uint8_t)led);
+		patternOf(img, led, pattern);
+		patchOf(img, led, patch);
+		addOp(out, PROG_OP_LED, pre, pattern, patch, dict);
+	}
+	return out;
+}
+
+//the patches of a modulated parameter are encoded like any other (their src being the bus); the bus definitions follow as
+//PROG_OP_MOD ops that patch nothing
+static Bytes encode(const Bytes& img, const std::map<uint32_t, int>& dict, int dictCount){
+	Bytes best = encodeWith(img, 0, dict, dictCount);
+	Bytes all = encodeWith(img, PROG_OP_ALL, dict, dictCount);
+	if(!all.empty() && all.size() < best.size()) best = all;
+	Bytes triple = encodeWith(img, PROG_OP_TRIPLE, dict, dictCount);
+	if(!triple.empty() && triple.size() < best.size()) best = triple;
+	if(best.empty()) return best;
+	for(int bus = 0; bus < MOD_BUSES; bus++){
+		const uint8_t* def = &img[8 + numLeds*8 + bus*MOD_BUS_BYTES];
+		uint8_t n = def[0] & MOD_COUNT_MASK;
+		if(n == 0) continue;
+		best.push_back(PROG_OP_MOD);
+		best.push_back(bus | (def[0] & MOD_PRODUCT));
+		best.push_back(PROG_MOD_ALL_LEDS);
+		best.push_back(PROG_MOD_NO_PARAM);
+		best.push_back(n);
+		best.insert(best.end(), def + 1, def + 1 + 2*n);
+	}
+	for(int osc = 0; osc < OSC_COUNT; osc++){
+		const uint8_t* def = &img[8 + numLeds*8 + MOD_BUSES*MOD_BUS_BYTES + osc*2];
+		if(def[0] == OSC_SINE && def[1] == 0) continue;//the default
+		best.push_back(PROG_OP_OSC);
+		best.push_back(osc | (def[0] << 4));
+		best.push_back(def[1]);
+	}
+	const uint8_t* code = &img[PROG_TGM_CODE_OFFSET(numLeds)];
+	if(code[0]){
+		best.push_back(PROG_OP_TGM);
+		best.insert(best.end(), code, code + 1 + code[0]);
+	}
+	return best;
+}
+
+//assembles one op of a --tgm spec onto code. Returns false if it is malformed
+static bool assembleTgm(const char* text, Bytes& code){
+	static const char* const conds[] = {"zero", "full", "bit0", "bit1", "top", "b"};
+	char name[16], arg[16];
+	unsigned n = 0, b = 0;
+	int fields = sscanf(text, " %15[a-z] %15s %i", name, arg, &b);
+	if(fields < 1) return false;
+	if(!strcmp(name, "if")){
+		if(fields < 2) return false;
+		char cond[16];
+		uint8_t op = TGS_IF;
+		if(!strcmp(arg, "not")){
+			if(sscanf(text, " if not %15s", cond) != 1) return false;
+			op |= TGS_IF_NOT;
+		}else{
+			strcpy(cond, arg);
+		}
+		unsigned c = 0;
+		while(c < sizeof(conds) / sizeof(conds[0]) && strcmp(cond, conds[c])) c++;
+		if(c == sizeof(conds) / sizeof(conds[0])) return false;
+		code.push_back(op | c);
+		return true;
+	}
+	if(!strcmp(name, "xor") && fields >= 2 && !strcmp(arg, "run")){
+		code.push_back(TGS_XOR);
+		code.push_back(TGS_XOR_RUN);
+		return true;
+	}
+	//the numeric arguments: n (in the op byte) and/or b
+	if(fields >= 2){
+		char* end;
+		unsigned long v = strtoul(arg, &end, 0);
+		if(*end || v > 0xFF) return false;
+		n = v;
+	}
+	static const struct{const char* name; uint8_t op; int args;} ops[] = {
+		{"step", TGS_STEP, 1}, {"shl", TGS_SHL, 1}, {"shr", TGS_SHR, 1}, {"rol", TGS_ROL, 0}, {"ror", TGS_ROR, 0},
+		{"set", TGS_SET, 2}, {"clr", TGS_CLR, 0}, {"xor", TGS_XOR, 2}, {"bounce", TGS_BOUNCE, 0}, {"loop", TGS_LOOP, 3},
+		{"jmp", TGS_JMP, 2}
+	};
+	for(size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++){
+		if(strcmp(name, ops[i].name)) continue;
+		switch(ops[i].args){
+			case 0://no argument
+				if(fields != 1) return false;
+				code.push_back(ops[i].op);
+				return true;
+			case 1://optional n
+				if(fields > 2 || n > 15 || (ops[i].op != TGS_STEP && n > 1)) return false;
+				code.push_back(ops[i].op | n);
+				return true;
+			case 2://b
+				if(fields != 2) return false;
+				code.push_back(ops[i].op);
+				code.push_back(n);
+				return true;
+			default://n and b
+				if(fields != 3 || n > 15 || b > 0xFF) return false;
+				code.push_back(ops[i].op | n);
+				code.push_back(b);
+				return true;
+		}
+	}
+	return false;
+}
+
+//applies a --tgm spec to the images. Returns false if it is malformed
+static bool applyTgm(const char* spec, std::vector<Bytes>& images){
+	int prog;
+	unsigned src;
+	int used = 0;
+	if(sscanf(spec, "%d:%i:%n", &prog, &src, &used) != 2 || !used) return false;
+	if(prog < 1 || prog > (int)images.size() || src > 0xFF) return false;
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s", spec + used);
+	Bytes code;
+	char* save;
+	for(char* op = strtok_r(buf, ",", &save); op; op = strtok_r(0, ",", &save)){
+		if(!assembleTgm(op, code)) return false;
+	}
+	if(code.empty() || code.size() > TGS_CODE_BYTES) return false;
+	Bytes& img = images[prog - 1];
+	img[4] = src;
+	img[5] = (img[5] & 0x80) | PROG_TGM_CODE;//keep TRIPLIFY
+	uint8_t* p = &img[PROG_TGM_CODE_OFFSET(numLeds)];
+	p[0] = code.size();
+	memcpy(p + 1, &code[0], code.size());
+	return true;
+}
+
+//applies an --osc spec to the images. Returns false if it is malformed
+static bool applyOsc(const char* spec, std::vector<Bytes>& images){
+	static const char* const waves[OSC_WAVES] = {"sine", "triangle", "saw", "square", "random"};
+	char name[16];
+	int prog, osc;
+	unsigned src;
+	if(sscanf(spec, "%d:%d:%15[a-z]:%i", &prog, &osc, name, &src) != 4) return false;
+	if(prog < 1 || prog > (int)images.size() || osc < 0 || osc >= OSC_COUNT || src > 0xFF) return false;
+	int wave = 0;
+	while(wave < OSC_WAVES && strcmp(name, waves[wave])) wave++;
+	if(wave == OSC_WAVES) return false;
+	uint8_t* def = &images[prog - 1][8 + numLeds*8 + MOD_BUSES*MOD_BUS_BYTES + osc*2];
+	def[0] = wave;
+	def[1] = src;
+	return true;
+}
+
+//applies a --mod spec to the images. Returns false if it is malformed
+static bool applyMod(const char* spec, std::vector<Bytes>& images){
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%s", spec);
+	char* field[6];
+	char* save;
+	char* s = buf;
+	for(int i = 0; i < 6; i++){
+		field[i] = strtok_r(s, ":", &save);
+		s = 0;
+		if(!field[i]) return false;
+	}
+	int prog = atoi(field[0]);
+	int bus = atoi(field[1]);
+	if(prog < 1 || prog > (int)images.size() || bus < 0 || bus >= MOD_BUSES) return false;
+	uint8_t mode;
+	if(!strcmp(field[2], "sum")) mode = 0;
+	else if(!strcmp(field[2], "product")) mode = MOD_PRODUCT;
+	else return false;
+	int led = strcmp(field[3], "all") ? atoi(field[3]) : -1;
+	if(led >= numLeds) return false;
+	//offset in the patch block
+	int offset;
+	if(!strcmp(field[4], "rate")) offset = 0;
+	else if(!strcmp(field[4], "scale")) offset = 2;
+	else if(!strcmp(field[4], "tg")) offset = 3;
+	else if(!strcmp(field[4], "none")) offset = -1;
+	else return false;
+	Bytes& img = images[prog - 1];
+	uint8_t* def = &img[8 + numLeds*8 + bus*MOD_BUS_BYTES];
+	memset(def, 0, MOD_BUS_BYTES);
+	int n = 0;
+	for(char* term = strtok_r(field[5], ",", &save); term; term = strtok_r(0, ",", &save)){
+		char* slash = strchr(term, '/');
+		if(!slash || n == MOD_TERMS) return false;
+		long src = strtol(term, 0, 0);
+		long depth = strtol(slash + 1, 0, 0);
+		if(src < 0 || src > 0xFF || depth < -128 || depth > 127) return false;
+		def[1 + 2*n] = src;
+		def[2 + 2*n] = (uint8_t)depth;
+		n++;
+	}
+	if(n == 0) return false;
+	def[0] = n | mode;
+	for(int i = 0; offset >= 0 && i < numLeds; i++){
+		if(led < 0 || led == i) img[8 + numLeds*4 + i*4 + offset] = PROG_SRC_MOD_BASE(numLeds) + bus;
+	}
+	return true;
+}
+
+//the literal patches in an encoded program
+static void countPatches(const Bytes& body, std::map<uint32_t, int>& counts){
+	size_t i = 3;
+	while(i < body.size()){
+		uint8_t op = body[i++];
+		if(op == PROG_OP_MOD){
+			i += 4 + 2*body[i + 3];
+			continue;
+		}
+		if(op == PROG_OP_OSC){
+			i += 2;
+			continue;
+		}
+		if(op == PROG_OP_TGM){
+			i += 1 + body[i];
+			continue;
+		}
+		size_t skip = ((op & ~PROG_OP_PATCH_REF) == PROG_OP_TRIPLE) ? 2 : ((op & ~PROG_OP_PATCH_REF) == PROG_OP_LED) ? 1 : 0;
+		i += skip + 3;
+		if(op & PROG_OP_PATCH_REF){
+			i++;
+		}else{
+			counts[(body[i] << 24) | (body[i+1] << 16) | (body[i+2] << 8) | body[i+3]]++;
+			i += 4;
+		}
+	}
+}
+
+static bool writeHex(const char* path, const Bytes& data){
+	FILE* f = fopen(path, "w");
+	if(!f){
+		fprintf(stderr, "cannot write %s\n", path);
+		return false;
+	}
+	fprintf(f, ":020000040000FA\n");
+	for(size_t a = 0; a < data.size(); a += 32){
+		size_t n = data.size() - a < 32 ? data.size() - a : 32;
+		uint8_t sum = n + (a >> 8) + (a & 0xFF);
+		fprintf(f, ":%02X%04X00", (unsigned)n, (unsigned)a);
+		for(size_t i = 0; i < n; i++){
+			fprintf(f, "%02X", data[a + i]);
+			sum += data[a + i];
+		}
+		fprintf(f, "%02X\n", (uint8_t)(0x100 - sum));
+	}
+	fprintf(f, ":00000001FF\n");
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char** argv){
+	std::vector<const char*> mods, oscs, tgms;
+	int arg = 1;
+	for(; arg + 1 < argc; arg += 2){
+		if(!strcmp(argv[arg], "--mod")) mods.push_back(argv[arg + 1]);
+		else if(!strcmp(argv[arg], "--osc")) oscs.push_back(argv[arg + 1]);
+		else if(!strcmp(argv[arg], "--tgm")) tgms.push_back(argv[arg + 1]);
+		else break;
+	}
+	if(argc - arg != 2){
+		fprintf(stderr, "usage: encode-programs [--mod PROGRAM:BUS:sum|product:LED|all:rate|scale|tg|none:SRC/DEPTH,...]...\n"
+			"\t[--osc PROGRAM:OSC:sine|triangle|saw|square|random:RATE_SRC]... [--tgm PROGRAM:RATE_SRC:OP,...]...\n"
+			"\tin.hex out.hex\n");
+		return 2;
+	}
+	const char* inPath = argv[arg];
+	const char* outPath = argv[arg + 1];
+	if(!HostSim::loadIntelHex(inPath)) return 1;
+	const uint8_t* ee = HostSim::eeprom;
+	numLeds = ee[0];
+	int count = ee[1];
+	if(numLeds == 0 || numLeds == 0xFF || ee[3] != PROG_FORMAT_LEGACY){
+		fprintf(stderr, "%s: not a legacy program image\n", inPath);
+		return 1;
+	}
+	if(!rejectsFlaggedOps()) return 1;
+	int progBytes = 8 + numLeds*8;
+	if(8 + count*progBytes > HOST_EEPROM_SIZE){
+		fprintf(stderr, "%s: %d programs of %d bytes do not fit in EEPROM\n", inPath, count, progBytes);
+		return 1;
+	}
+	std::vector<Bytes> images;
+	for(int p = 0; p < count; p++) images.push_back(normalise(ee + 8 + p*progBytes));
+	for(size_t i = 0; i < mods.size(); i++){
+		if(!applyMod(mods[i], images)){
+			fprintf(stderr, "bad --mod %s\n", mods[i]);
+			return 2;
+		}
+	}
+	for(size_t i = 0; i < oscs.size(); i++){
+		if(!applyOsc(oscs[i], images)){
+			fprintf(stderr, "bad --osc %s\n", oscs[i]);
+			return 2;
+		}
+	}
+	for(size_t i = 0; i < tgms.size(); i++){
+		if(!applyTgm(tgms[i], images)){
+			fprintf(stderr, "bad --tgm %s\n", tgms[i]);
+			return 2;
+		}
+	}
+	uint8_t header[8] = {ee[0], ee[1], ee[2], PROG_FORMAT_COMPACT, 0, 0, 0, 0};
+
+	//first pass without a dictionary, to find the patches worth sharing: a reference saves 3 bytes per use, an entry costs 4
+	memset(HostSim::eeprom, 0xFF, HOST_EEPROM_SIZE);
+	std::map<uint32_t, int> none, counts;
+	for(int p = 0; p < count; p++) countPatches(encode(images[p], none, 0), counts);
+	std::vector<std::pair<int, uint32_t> > shared;
+	for(std::map<uint32_t, int>::iterator it = counts.begin(); it != counts.end(); ++it){
+		if(it->second >= 2) shared.push_back(std::make_pair(-it->second, it->first));
+	}
+	std::sort(shared.begin(), shared.end());
+	if(shared.size() > 255) shared.resize(255);
+	std::map<uint32_t, int> dict;
+	Bytes out(header, header + 8);
+	for(size_t i = 0; i < shared.size(); i++){
+		dict[shared[i].second] = i;
+		for(int b = 3; b >= 0; b--) out.push_back((uint8_t)(shared[i].second >> (8*b)));
+	}
+	out[4] = shared.size();
+
+	//second pass, decoding against the dictionary as the sketch will
+	memcpy(HostSim::eeprom, &out[0], out.size());
+	for(int p = 0; p < count; p++){
+		Bytes body = encode(images[p], dict, shared.size());
+		if(body.empty() || decode(body, shared.size()) != images[p]){
+			fprintf(stderr, "program %d cannot be encoded exactly\n", p + 1);
+			return 1;
+		}
+		out.push_back((uint8_t)(body.size() >> 8));
+		out.push_back((uint8_t)body.size());
+		out.insert(out.end(), body.begin(), body.end());
+	}
+	if(out.size() > HOST_EEPROM_SIZE){
+		fprintf(stderr, "compact image is %zu bytes, more than the EEPROM\n", out.size());
+		return 1;
+	}
+	if(out.size() > HOST_EEPROM_SIZE - PSTORE_RESERVED_BYTES){
+		fprintf(stderr, "note: the compact image runs into the state journal at the top of the internal EEPROM, which is then not kept;"
+			" it fits an I2C EEPROM\n");
+	}
+	if(!writeHex(outPath, out)) return 1;
+
+	size_t legacy = 8 + count*progBytes;
+	printf("%d programs, %d LEDs: legacy %zu bytes, compact %zu bytes (%zu dictionary entries), %.1f bytes/program\n",
+		count, numLeds, legacy, out.size(), shared.size(), count ? (double)(out.size() - 8 - 4*shared.size()) / count : 0.0);
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host (x86 Linux) stand-in for the Arduino core, used only by the build in host/.
+ * It provides just enough of Arduino.h for sketch.cpp to compile unchanged. Time, pins, ADC readings and the
+ * serial port are all backed by the simulator state in HostSim.h, so a run can be either real-time or as fast as possible.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000L
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define DEC 10
+#define HEX 16
+
+//program memory (avr/pgmspace.h) is ordinary memory on the host
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+//strings in program memory: F("...") for Serial.print(), as in the Arduino core's WString.h
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper*>(s))
+
+//analog pin numbering as per the "standard" (Uno) variant
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define NUM_DIGITAL_PINS 20
+//the ATmega328P's last EEPROM address (HOST_EEPROM_SIZE - 1)
+#define E2END 0x3FF
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned int seed);
+
+//host-only: wall clock in nanoseconds, for instrumentation that must see real CPU cost even when time is simulated
+unsigned long hostWallNanos(void);
+//host-only: stands in for a timer or peripheral interrupt (up to 4). fn is called once per periodMicros of (simulated or real) time, with micros()
+//reading the instant it was due. Delivery is synchronous, from inside the simulator's time keeping
+void hostAttachTimer(void (*fn)(void), unsigned long periodMicros);
+
+// Serial stand-in. Output goes to the stream chosen by the host runner (stdout, or nothing when quiet);
+// input comes from HostSim::pushSerial().
+class HostSerial{
+	public:
+		void begin(unsigned long baud);
+		int available(void);
+		int read(void);
+		size_t write(uint8_t c);
+		size_t print(const char* s);
+		size_t print(const __FlashStringHelper* s);
+		size_t print(char c);
+		size_t print(unsigned char n, int base = DEC);
+		size_t print(int n, int base = DEC);
+		size_t print(unsigned int n, int base = DEC);
+		size_t print(long n, int base = DEC);
+		size_t print(unsigned long n, int base = DEC);
+		size_t println(void);
+		size_t println(const char* s);
+		size_t println(const __FlashStringHelper* s);
+		size_t println(char c);
+		size_t println(unsigned char n, int base = DEC);
+		size_t println(int n, int base = DEC);
+		size_t println(unsigned int n, int base = DEC);
+		size_t println(long n, int base = DEC);
+		size_t println(unsigned long n, int base = DEC);
+	private:
+		size_t printNumber(unsigned long n, int base);
+};
+
+extern HostSerial Serial;
+
+// sketch entry points, as called by main.cpp on the target
+void setup(void);
+void loop(void);
+
+#endif
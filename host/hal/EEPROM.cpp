@@ -0,0 +1,32 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EEPROM.h"
+#include "HostSim.h"
+
+uint8_t EEPROMClass::read(int address){
+	return HostSim::eeprom[address & (HOST_EEPROM_SIZE - 1)];
+}
+
+#define EEPROM_WRITE_US 3400
+
+void EEPROMClass::write(int address, uint8_t value){
+	uint64_t now = HostSim::nowMicros();
+	if(now < HostSim::eepromBusyUntil){
+		HostSim::advance(HostSim::eepromBusyUntil - now);
+	}
+	HostSim::eeprom[address & (HOST_EEPROM_SIZE - 1)] = value;
+	HostSim::eepromWrites[address & (HOST_EEPROM_SIZE - 1)]++;
+	HostSim::eepromBusyUntil = HostSim::nowMicros() + EEPROM_WRITE_US;
+}
+
+EEPROMClass EEPROM;
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the Arduino EEPROM library, backed by HostSim::eeprom. */
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "Arduino.h"
+
+class EEPROMClass{
+	public:
+		uint8_t read(int address);
+		void write(int address, uint8_t value);
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "EEPROMUtils.h"
+#include "EEPROM.h"
+
+void EEPROMUtils::loadBytes(word* address, uint8_t* buff, uint8_t count){
+	for(uint8_t i = 0; i < count; i++){
+		buff[i] = EEPROM.read((*address)++);
+	}
+}
+
+int EEPROMUtils::loadInt(word* address){
+	int v = EEPROM.read((*address)++) << 8;
+	v |= EEPROM.read((*address)++);
+	return v;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for EEPROMUtils. Only the block helpers used by the sketch are provided. */
+
+#ifndef HOST_EEPROMUTILS_H
+#define HOST_EEPROMUTILS_H
+
+#include "Arduino.h"
+
+class EEPROMUtils{
+	public:
+		//read count bytes from *address into buff, advancing *address past them
+		static void loadBytes(word* address, uint8_t* buff, uint8_t count);
+		//read a 2-byte int (MSB first), advancing *address
+		static int loadInt(word* address);
+};
+
+#endif
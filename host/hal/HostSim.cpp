@@ -0,0 +1,433 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host implementation of the Arduino core functions declared in the stand-in Arduino.h, plus the simulator state. */
+
+#include "Arduino.h"
+#include "HostSim.h"
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+namespace HostSim{
+	uint16_t analog[8];
+	uint16_t analogNoise = 0;
+	uint8_t pinLevel[20];
+	uint32_t groundedPins = 0;
+	uint8_t eeprom[HOST_EEPROM_SIZE];
+	uint64_t eepromBusyUntil = 0;
+	uint32_t eepromWrites[HOST_EEPROM_SIZE];
+	uint8_t i2cEeprom[HOST_I2C_EEPROM_SIZE];
+	bool i2cEepromPresent = false;
+	unsigned long i2cTransactions = 0;
+	unsigned i2cLoseEvery = 0;
+	I2cHook i2cBroadcast = 0;
+	I2cHook i2cSlave = 0;
+	FILE* serialOut = stdout;
+	FILE* telemetryOut = 0;
+	FrameHook onFrame = 0;
+
+	static ClockMode mode = FAST;
+	static uint64_t simMicros = 0;
+	static std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	static std::deque<unsigned long> irQueue;
+	static std::deque<uint8_t> serialQueue;
+
+	//the simulated timer interrupts
+	#define HOST_TIMERS 6
+	static void (*timerFn[HOST_TIMERS])(void);
+	static uint64_t timerPeriod[HOST_TIMERS];
+	static uint64_t timerNext[HOST_TIMERS];
+	static int timerCount = 0;
+	static bool inTimer = false;
+	static uint64_t timerNow = 0;
+
+	//erased EEPROM reads as 0xFF
+	static struct EepromInit{
+		EepromInit(){
+			memset(eeprom, 0xFF, sizeof(eeprom));
+			memset(i2cEeprom, 0xFF, sizeof(i2cEeprom));
+		}
+	} eepromInit;
+
+	void setClockMode(ClockMode m){
+		mode = m;
+		startTime = std::chrono::steady_clock::now();
+		simMicros = 0;
+	}
+
+	ClockMode clockMode(){
+		return mode;
+	}
+
+	static uint64_t rawMicros(){
+		if(mode == REALTIME){
+			return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+		}
+		return simMicros;
+	}
+
+	//deliver any timer events that have fallen due, in time order. While a handler runs, time reads as the instant its event was due
+	static void serviceTimer(){
+		if(timerCount == 0 || inTimer) return;
+		uint64_t now = rawMicros();
+		inTimer = true;
+		for(;;){
+			int first = 0;
+			for(int i = 1; i < timerCount; i++){
+				if(timerNext[i] < timerNext[first]) first = i;
+			}
+			if(timerNext[first] > now) break;
+			timerNow = timerNext[first];
+			timerFn[first]();
+			timerNext[first] += timerPeriod[first];
+		}
+		inTimer = false;
+	}
+
+	uint64_t nowMicros(){
+		if(inTimer) return timerNow;
+		serviceTimer();
+		return rawMicros();
+	}
+
+	void advance(uint32_t us){
+		if(mode == FAST){
+			simMicros += us;
+			serviceTimer();
+		}
+	}
+
+	void attachTimer(void (*fn)(void), uint32_t periodMicros){
+		int i;
+		for(i = 0; i < timerCount; i++){
+			if(timerFn[i] == fn) break;//re-attaching replaces
+		}
+		if(i == HOST_TIMERS){
+			fprintf(stderr, "HostSim: too many timers\n");
+			abort();
+		}
+		if(i == timerCount) timerCount++;
+		timerFn[i] = fn;
+		timerPeriod[i] = periodMicros ? periodMicros : 1;
+		timerNext[i] = rawMicros() + timerPeriod[i];
+	}
+
+	uint64_t wallNanos(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void pushIR(unsigned long code){
+		irQueue.push_back(code);
+	}
+
+	bool popIR(unsigned long* code){
+		if(irQueue.empty()) return false;
+		*code = irQueue.front();
+		irQueue.pop_front();
+		return true;
+	}
+
+	int irPending(){
+		return (int)irQueue.size();
+	}
+
+	void pushSerial(const char* s){
+		while(*s) serialQueue.push_back((uint8_t)*s++);
+	}
+
+	void pushSerial(const uint8_t* data, size_t len){
+		serialQueue.insert(serialQueue.end(), data, data + len);
+	}
+
+	int serialAvailable(){
+		return (int)serialQueue.size();
+	}
+
+	int popSerial(){
+		if(serialQueue.empty()) return -1;
+		int c = serialQueue.front();
+		serialQueue.pop_front();
+		return c;
+	}
+
+	static int hexByte(const char* p){
+		unsigned int v;
+		if(sscanf(p, "%2x", &v) != 1) return -1;
+		return (int)v;
+	}
+
+	bool loadIntelHex(const char* path){
+		return loadIntelHex(path, eeprom, HOST_EEPROM_SIZE);
+	}
+
+	bool loadIntelHex(const char* path, uint8_t* mem, uint32_t size){
+		FILE* f = fopen(path, "r");
+		if(!f){
+			fprintf(stderr, "cannot open %s\n", path);
+			return false;
+		}
+		char line[600];
+		uint32_t base = 0;
+		int lineNum = 0;
+		bool ok = true;
+		while(ok && fgets(line, sizeof(line), f)){
+			lineNum++;
+			char* p = line;
+			while(*p == ' ' || *p == '\t' || *p == '\xEF' || *p == '\xBB' || *p == '\xBF') p++;//tolerate a BOM
+			if(*p == '\r' || *p == '\n' || *p == 0) continue;
+			if(*p != ':'){
+				ok = false;
+				break;
+			}
+			p++;
+			int len = hexByte(p);
+			int addrHi = hexByte(p+2);
+			int addrLo = hexByte(p+4);
+			int type = hexByte(p+6);
+			if(len < 0 || addrHi < 0 || addrLo < 0 || type < 0){
+				ok = false;
+				break;
+			}
+			uint8_t sum = len + addrHi + addrLo + type;
+			uint8_t data[256];
+			for(int i = 0; i <= len; i++){//includes the checksum byte
+				int b = hexByte(p + 8 + 2*i);
+				if(b < 0){
+					ok = false;
+					break;
+				}
+				if(i < len) data[i] = b;
+				sum += b;
+			}
+			if(!ok || sum != 0){
+				ok = false;
+				break;
+			}
+			switch(type){
+				case 0x00:
+					for(int i = 0; i < len; i++){
+						uint32_t a = base + (addrHi << 8) + addrLo + i;
+						if(a >= size){
+							fprintf(stderr, "%s:%d: address 0x%X beyond EEPROM size\n", path, lineNum, a);
+							fclose(f);
+							return false;
+						}
+						mem[a] = data[i];
+					}
+					break;
+				case 0x01:
+					fclose(f);
+					return true;
+				case 0x02:
+					base = ((data[0] << 8) | data[1]) << 4;
+					break;
+				case 0x04:
+					base = ((data[0] << 8) | data[1]) << 16;
+					break;
+				default:
+					break;//start address records are irrelevant for EEPROM
+			}
+		}
+		fclose(f);
+		if(!ok){
+			fprintf(stderr, "%s:%d: malformed Intel HEX record\n", path, lineNum);
+		}
+		return ok;
+	}
+
+	bool saveIntelHex(const char* path, const uint8_t* mem, uint32_t size){
+		FILE* f = fopen(path, "w");
+		if(!f){
+			fprintf(stderr, "cannot write %s\n", path);
+			return false;
+		}
+		fprintf(f, ":020000040000FA\n");
+		for(uint32_t a = 0; a < size; a += 32){
+			uint32_t n = (size - a < 32) ? size - a : 32;
+			uint8_t sum = n + ((a >> 8) & 0xFF) + (a & 0xFF);
+			fprintf(f, ":%02X%04X00", (unsigned)n, (unsigned)(a & 0xFFFF));
+			for(uint32_t i = 0; i < n; i++){
+				fprintf(f, "%02X", mem[a + i]);
+				sum += mem[a + i];
+			}
+			fprintf(f, "%02X\n", (uint8_t)(0x100 - sum));
+		}
+		fprintf(f, ":00000001FF\n");
+		return fclose(f) == 0;
+	}
+}
+
+// ---------- Arduino core ----------
+
+void pinMode(uint8_t pin, uint8_t mode){
+	if(pin < NUM_DIGITAL_PINS && mode == INPUT_PULLUP){
+		HostSim::pinLevel[pin] = ((HostSim::groundedPins >> pin) & 1) ? LOW : HIGH;
+	}
+}
+
+void digitalWrite(uint8_t pin, uint8_t val){
+	if(pin < NUM_DIGITAL_PINS) HostSim::pinLevel[pin] = val ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin){
+	return (pin < NUM_DIGITAL_PINS) ? HostSim::pinLevel[pin] : LOW;
+}
+
+//noise uses its own generator so that it does not disturb the sketch's random() sequence
+static uint32_t noiseState = 12345;
+
+int analogRead(uint8_t pin){
+	if(pin >= A0) pin -= A0;
+	if(pin >= 8) return 0;
+	int v = HostSim::analog[pin];
+	if(HostSim::analogNoise){
+		noiseState = noiseState * 1664525UL + 1013904223UL;
+		v += (int)((noiseState >> 8) % (2 * HostSim::analogNoise + 1)) - HostSim::analogNoise;
+	}
+	if(v < 0) v = 0;
+	if(v > 1023) v = 1023;
+	return v;
+}
+
+unsigned long millis(void){
+	return (unsigned long)(HostSim::nowMicros() / 1000);
+}
+
+unsigned long micros(void){
+	return (unsigned long)HostSim::nowMicros();
+}
+
+void delay(unsigned long ms){
+	if(HostSim::clockMode() == HostSim::REALTIME){
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+	}else{
+		HostSim::advance(ms * 1000);
+	}
+}
+
+void delayMicroseconds(unsigned int us){
+	if(HostSim::clockMode() == HostSim::REALTIME){
+		std::this_thread::sleep_for(std::chrono::microseconds(us));
+	}else{
+		HostSim::advance(us);
+	}
+}
+
+unsigned long hostWallNanos(void){
+	return (unsigned long)HostSim::wallNanos();
+}
+
+void hostAttachTimer(void (*fn)(void), unsigned long periodMicros){
+	HostSim::attachTimer(fn, periodMicros);
+}
+
+//a fixed-seed generator so that runs are repeatable
+static uint32_t randState = 1;
+
+void randomSeed(unsigned int seed){
+	if(seed != 0) randState = seed;
+}
+
+long random(long howbig){
+	if(howbig == 0) return 0;
+	randState = randState * 1103515245UL + 12345UL;
+	return (long)((randState >> 1) % (uint32_t)howbig);
+}
+
+long random(long howsmall, long howbig){
+	if(howsmall >= howbig) return howsmall;
+	return random(howbig - howsmall) + howsmall;
+}
+
+// ---------- Serial ----------
+
+HostSerial Serial;
+
+void HostSerial::begin(unsigned long baud){
+	(void)baud;
+}
+
+int HostSerial::available(void){
+	return HostSim::serialAvailable();
+}
+
+int HostSerial::read(void){
+	return HostSim::popSerial();
+}
+
+size_t HostSerial::write(uint8_t c){
+	if(HostSim::serialOut) fputc(c, HostSim::serialOut);
+	return 1;
+}
+
+size_t HostSerial::print(const char* s){
+	size_t n = 0;
+	while(*s) n += write(*s++);
+	return n;
+}
+
+size_t HostSerial::print(char c){
+	return write(c);
+}
+
+size_t HostSerial::printNumber(unsigned long n, int base){
+	char buf[8 * sizeof(long) + 1];
+	char* p = &buf[sizeof(buf) - 1];
+	*p = 0;
+	if(base < 2) base = 10;
+	do{
+		unsigned long d = n % base;
+		n /= base;
+		*--p = d < 10 ? '0' + d : 'A' + d - 10;
+	}while(n);
+	return print(p);
+}
+
+size_t HostSerial::print(unsigned char n, int base){
+	return printNumber(n, base);
+}
+
+size_t HostSerial::print(int n, int base){
+	return print((long)n, base);
+}
+
+size_t HostSerial::print(unsigned int n, int base){
+	return printNumber(n, base);
+}
+
+size_t HostSerial::print(long n, int base){
+	if(base == DEC && n < 0){
+		return write('-') + printNumber((unsigned long)(-n), DEC);
+	}
+	//as on the target, non-decimal output of negative numbers shows the 32 bit two's complement
+	return printNumber((uint32_t)n, base);
+}
+
+size_t HostSerial::print(unsigned long n, int base){
+	return printNumber((uint32_t)n, base);
+}
+
+size_t HostSerial::println(void){
+	return write('\r') + write('\n');
+}
+
+size_t HostSerial::print(const __FlashStringHelper* s){ return print(reinterpret_cast<const char*>(s)); }
+size_t HostSerial::println(const char* s){ return print(s) + println(); }
+size_t HostSerial::println(const __FlashStringHelper* s){ return print(s) + println(); }
+size_t HostSerial::println(char c){ return print(c) + println(); }
+size_t HostSerial::println(unsigned char n, int base){ return print(n, base) + println(); }
+size_t HostSerial::println(int n, int base){ return print(n, base) + println(); }
+size_t HostSerial::println(unsigned int n, int base){ return print(n, base) + println(); }
+size_t HostSerial::println(long n, int base){ return print(n, base) + println(); }
+size_t HostSerial::println(unsigned long n, int base){ return print(n, base) + println(); }
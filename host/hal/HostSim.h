@@ -0,0 +1,98 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Simulator state behind the host stand-ins for the Arduino core and libraries.
+ * Host runners use this to set the clock mode, drive the inputs (ADC, switches, IR) and load EEPROM images.
+ */
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//the ATmega328P has 1k of EEPROM
+#define HOST_EEPROM_SIZE 1024
+//simulated I2C EEPROM: a 24LC512 (64KB, 128 byte write pages) at 0x50
+#define HOST_I2C_EEPROM_SIZE 65536UL
+#define HOST_I2C_EEPROM_PAGE 128
+#define HOST_I2C_EEPROM_ADDR 0x50
+
+namespace HostSim{
+	//REALTIME: millis()/micros() follow the wall clock and delay() sleeps
+	//FAST: time is simulated, only advancing when advance() or delay() is called
+	enum ClockMode {REALTIME, FAST};
+
+	void setClockMode(ClockMode mode);
+	ClockMode clockMode();
+	//current (simulated or real) time since start, in microseconds
+	uint64_t nowMicros();
+	//move simulated time on, delivering any timer events that fall due. Ignored in REALTIME mode
+	void advance(uint32_t us);
+	//the simulated timer interrupt; see hostAttachTimer() in Arduino.h
+	void attachTimer(void (*fn)(void), uint32_t periodMicros);
+	//wall clock in nanoseconds, for measuring the cost of code under either clock mode
+	uint64_t wallNanos();
+
+	//inputs
+	extern uint16_t analog[8];//ADC readings, indexed by channel (A0 = 0)
+	extern uint16_t analogNoise;//each reading gets uniform noise of +/- this many counts
+	extern uint8_t pinLevel[20];//digital levels. Inputs are read from here and outputs written here
+	extern uint32_t groundedPins;//a bit per pin tied to ground, e.g. a strap: it stays LOW when its pull-up is turned on
+	void pushIR(unsigned long code);
+	bool popIR(unsigned long* code);
+	int irPending();
+	//queue characters to be read from Serial (or received by the telemetry UART)
+	void pushSerial(const char* s);
+	void pushSerial(const uint8_t* data, size_t len);
+	int serialAvailable();
+	int popSerial();
+
+	//EEPROM contents, initialised to 0xFF as for an erased device
+	extern uint8_t eeprom[HOST_EEPROM_SIZE];
+	//the end of the write cycle of the last byte written (3.4ms). EEPROM.write() waits for it first, as the AVR's does
+	extern uint64_t eepromBusyUntil;
+	//EEPROM.write() calls per address, for wear
+	extern uint32_t eepromWrites[HOST_EEPROM_SIZE];
+	//load an Intel HEX EEPROM image (as in "EEPROM Programs"). Returns false, with a message on stderr, on error
+	bool loadIntelHex(const char* path);
+	//... into another memory, e.g. i2cEeprom
+	bool loadIntelHex(const char* path, uint8_t* mem, uint32_t size);
+	//write size bytes of mem as an Intel HEX image, e.g. the EEPROM after a run so that the next run can start from it
+	bool saveIntelHex(const char* path, const uint8_t* mem, uint32_t size);
+
+	//the I2C EEPROM. It only answers on the bus (Wire stand-in) if i2cEepromPresent. Contents are initialised to 0xFF.
+	//Bus time is simulated at 100kHz (90us per byte including ACK), and a write is followed by a 5ms write cycle during which
+	//the device does not acknowledge its address, as the real part
+	extern uint8_t i2cEeprom[HOST_I2C_EEPROM_SIZE];
+	extern bool i2cEepromPresent;
+	extern unsigned long i2cTransactions;//address + data transactions on the bus, to any address
+	//a fault for testing: if not 0, every i2cLoseEvery'th read from the I2C EEPROM is lost, as to another master, and returns nothing
+	extern unsigned i2cLoseEvery;
+	//other boards on the bus, for SyncLink.h. What the Wire stand-in sends to the general call address (0) goes to i2cBroadcast,
+	//if set, which returns whether anything acknowledged it. Once Wire is begun as a slave it sets i2cSlave, through which a
+	//runner delivers general calls from other boards (the AVR only sees them with TWGCE set, which the stand-in assumes)
+	typedef bool (*I2cHook)(const uint8_t* data, uint8_t len);
+	extern I2cHook i2cBroadcast;
+	extern I2cHook i2cSlave;
+
+	//where Serial output goes; NULL discards it
+	extern FILE* serialOut;
+	//where the telemetry stream (Telemetry.h) goes, at the UART byte rate; NULL discards it
+	extern FILE* telemetryOut;
+
+	//brightness frames. The ShapedBrightnessController stand-in calls onFrame, if set, at the end of each tick()
+	typedef void (*FrameHook)(uint32_t tickNum, uint8_t numLeds, const uint8_t* brightness);
+	extern FrameHook onFrame;
+}
+
+#endif
@@ -0,0 +1,41 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "IRremote.h"
+#include "HostSim.h"
+
+IRrecv::IRrecv(int recvpin){
+	(void)recvpin;
+	enabled = false;
+	holding = false;
+	held = 0;
+}
+
+void IRrecv::enableIRIn(){
+	enabled = true;
+}
+
+int IRrecv::decode(decode_results* results){
+	if(!enabled) return 0;
+	if(!holding){
+		if(!HostSim::popIR(&held)) return 0;
+		holding = true;
+	}
+	results->decode_type = NEC;
+	results->value = held;
+	results->bits = 32;
+	return 1;
+}
+
+void IRrecv::resume(){
+	holding = false;
+}
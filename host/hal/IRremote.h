@@ -0,0 +1,41 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the IRremote library. Codes queued with HostSim::pushIR() are "received" one at a time. */
+
+#ifndef HOST_IRREMOTE_H
+#define HOST_IRREMOTE_H
+
+#include "Arduino.h"
+
+#define NEC 1
+
+class decode_results{
+	public:
+		int decode_type;
+		unsigned long value;
+		int bits;
+};
+
+class IRrecv{
+	public:
+		IRrecv(int recvpin);
+		void enableIRIn();
+		int decode(decode_results* results);
+		void resume();
+	private:
+		bool enabled;
+		bool holding;//a code has been returned by decode() and resume() has not been called
+		unsigned long held;
+};
+
+#endif
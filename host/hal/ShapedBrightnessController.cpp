@@ -0,0 +1,117 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ShapedBrightnessController.h"
+#include "HostSim.h"
+
+ShapedBrightnessController::ShapedBrightnessController(uint8_t numLeds){
+	this->numLeds = numLeds > SBC_MAX_LEDS ? SBC_MAX_LEDS : numLeds;
+	tickCount = 0;
+	memset(progBytes, 0, sizeof(progBytes));
+	memset(phase, 0, sizeof(phase));
+	memset(rate, 0, sizeof(rate));
+	memset(scale, 0, sizeof(scale));
+	memset(tgIP, 0, sizeof(tgIP));
+	memset(brightness, 0, sizeof(brightness));
+}
+
+void ShapedBrightnessController::initialise(){
+}
+
+void ShapedBrightnessController::setPattern(uint8_t led, uint8_t shape, int phase){
+	if(led >= numLeds) return;
+	progBytes[led][0] = shape;
+	progBytes[led][1] = 0xFF;
+	progBytes[led][2] = (uint8_t)(phase >> 8);
+	progBytes[led][3] = (uint8_t)phase;
+	this->phase[led] = phase % SBC_PHASE_MAX;
+}
+
+void ShapedBrightnessController::setPatternFromProgBytes(uint8_t led, uint8_t* bytes){
+	if(led >= numLeds) return;
+	memcpy(progBytes[led], bytes, 4);
+	phase[led] = ((bytes[2] << 8) | bytes[3]) % SBC_PHASE_MAX;
+}
+
+void ShapedBrightnessController::getPatternProgBytes(uint8_t led, uint8_t* bytes){
+	if(led >= numLeds) return;
+	memcpy(bytes, progBytes[led], 4);
+}
+
+void ShapedBrightnessController::setRate(uint8_t led, uint16_t r){
+	if(led < numLeds) rate[led] = r;
+}
+
+void ShapedBrightnessController::setScale(uint8_t led, uint16_t s){
+	if(led < numLeds) scale[led] = s;
+}
+
+void ShapedBrightnessController::setTriggerIP(uint8_t led, uint16_t t){
+	if(led < numLeds) tgIP[led] = t;
+}
+
+uint8_t ShapedBrightnessController::shapeValue(uint8_t shape, uint16_t ph){
+	uint8_t v;
+	switch(shape & 0x0F){
+		case SBC_WAVESHAPE_OFF:
+			return 0;
+		case SBC_WAVESHAPE_SAW:
+			v = ph >> 3;
+			break;
+		case SBC_WAVESHAPE_SQUARE:
+			v = (ph < SBC_PHASE_MAX/2) ? 255 : 0;
+			break;
+		default://triangle stands in for all other shapes
+			v = (ph < SBC_PHASE_MAX/2) ? (ph >> 2) : ((SBC_PHASE_MAX - 1 - ph) >> 2);
+			break;
+	}
+	return (shape & SBC_WSMOD_INVERT) ? 255 - v : v;
+}
+
+void ShapedBrightnessController::tick(){
+	for(uint8_t led = 0; led < numLeds; led++){
+		uint8_t shape = progBytes[led][0];
+		if(tgIP[led] >= 512){//gate open: run
+			phase[led] = (phase[led] + (rate[led] >> 4)) % SBC_PHASE_MAX;
+			uint32_t b = (uint32_t)shapeValue(shape, phase[led]) * (scale[led] > 1023 ? 1023 : scale[led]);
+			brightness[led] = (uint8_t)(b / 1023);
+		}else{
+			brightness[led] = 0;
+		}
+	}
+	tickCount++;
+	if(HostSim::onFrame) HostSim::onFrame(tickCount, numLeds, brightness);
+}
+
+uint8_t ShapedBrightnessController::getBrightness(uint8_t led){
+	return led < numLeds ? brightness[led] : 0;
+}
+
+uint16_t ShapedBrightnessController::getRate(uint8_t led){
+	return led < numLeds ? rate[led] : 0;
+}
+
+uint16_t ShapedBrightnessController::getScale(uint8_t led){
+	return led < numLeds ? scale[led] : 0;
+}
+
+uint16_t ShapedBrightnessController::getTriggerIP(uint8_t led){
+	return led < numLeds ? tgIP[led] : 0;
+}
+
+uint32_t ShapedBrightnessController::getTickCount(){
+	return tickCount;
+}
+
+uint8_t ShapedBrightnessController::getNumLeds(){
+	return numLeds;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the Shaped Brightness Controller library.
+ * It keeps the same API and the same 4-byte pattern "prog bytes" (shape, -, phase MSB, phase LSB), and models the output
+ * with a simple phase accumulator per LED. The modelled brightness is NOT the library's exact output; it is meant for
+ * comparing one run of the sketch against another, e.g. before and after a change to the tick path.
+ */
+
+#ifndef HOST_SBC_H
+#define HOST_SBC_H
+
+#include "Arduino.h"
+
+#define SBC_MAX_LEDS 128
+
+//low nibble = basic shape, high nibble = modifiers
+#define SBC_WAVESHAPE_OFF 0x00
+#define SBC_WAVESHAPE_SAW 0x01
+#define SBC_WAVESHAPE_TRIANGLE 0x02
+#define SBC_WAVESHAPE_SQUARE 0x03
+#define SBC_WSMOD_INVERT 0x80
+
+//phase runs 0..SBC_PHASE_MAX-1
+#define SBC_PHASE_MAX 2048
+
+class ShapedBrightnessController{
+	public:
+		ShapedBrightnessController(uint8_t numLeds);
+		void initialise();
+		void tick();
+		void setPattern(uint8_t led, uint8_t shape, int phase);
+		void setPatternFromProgBytes(uint8_t led, uint8_t* progBytes);
+		void getPatternProgBytes(uint8_t led, uint8_t* progBytes);
+		void setRate(uint8_t led, uint16_t rate);
+		void setScale(uint8_t led, uint16_t scale);
+		void setTriggerIP(uint8_t led, uint16_t tgIP);
+		//host-only accessors
+		uint8_t getBrightness(uint8_t led);
+		uint16_t getRate(uint8_t led);
+		uint16_t getScale(uint8_t led);
+		uint16_t getTriggerIP(uint8_t led);
+		uint32_t getTickCount();
+		uint8_t getNumLeds();
+	private:
+		uint8_t numLeds;
+		uint32_t tickCount;
+		uint8_t progBytes[SBC_MAX_LEDS][4];
+		uint16_t phase[SBC_MAX_LEDS];
+		uint16_t rate[SBC_MAX_LEDS];
+		uint16_t scale[SBC_MAX_LEDS];
+		uint16_t tgIP[SBC_MAX_LEDS];
+		uint8_t brightness[SBC_MAX_LEDS];
+		uint8_t shapeValue(uint8_t shape, uint16_t ph);
+};
+
+#endif
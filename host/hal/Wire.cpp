@@ -0,0 +1,126 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Wire.h"
+#include "HostSim.h"
+
+//bus time per byte (8 bits + ACK at 100kHz)
+#define WIRE_BYTE_US 90
+#define EEPROM_WRITE_CYCLE_US 5000
+
+//the simulated I2C EEPROM's address pointer, and the end of its current write cycle
+static uint16_t eePointer = 0;
+static uint64_t eeBusyUntil = 0;
+static unsigned eeReads = 0;
+
+static void busTime(uint8_t bytes){
+	HostSim::i2cTransactions++;
+	HostSim::advance(bytes * WIRE_BYTE_US);
+}
+
+static bool eepromAcks(uint8_t address){
+	return HostSim::i2cEepromPresent && (address == HOST_I2C_EEPROM_ADDR) && (HostSim::nowMicros() >= eeBusyUntil);
+}
+
+void TwoWire::begin(){
+	txLength = 0;
+	rxLength = 0;
+	rxIndex = 0;
+}
+
+static bool hostSlaveHook(const uint8_t* data, uint8_t len){
+	return Wire.slaveReceive(data, len);
+}
+
+void TwoWire::begin(uint8_t address){
+	(void)address;
+	begin();
+	HostSim::i2cSlave = hostSlaveHook;
+}
+
+void TwoWire::beginTransmission(uint8_t address){
+	txAddress = address;
+	txLength = 0;
+}
+
+//the first two bytes written set the address pointer; any more are written to the current page, wrapping within it
+uint8_t TwoWire::endTransmission(void){
+	busTime(1 + txLength);
+	if(txAddress == 0){
+		return (HostSim::i2cBroadcast && HostSim::i2cBroadcast(txBuffer, txLength)) ? 0 : 2;
+	}
+	if(!eepromAcks(txAddress)) return 2;//address NACK
+	if(txLength >= 2){
+		eePointer = (txBuffer[0] << 8) | txBuffer[1];
+	}
+	if(txLength > 2){
+		uint16_t page = eePointer & ~(HOST_I2C_EEPROM_PAGE - 1);
+		for(uint8_t i = 2; i < txLength; i++){
+			HostSim::i2cEeprom[eePointer] = txBuffer[i];
+			eePointer = page | ((eePointer + 1) & (HOST_I2C_EEPROM_PAGE - 1));
+		}
+		eeBusyUntil = HostSim::nowMicros() + EEPROM_WRITE_CYCLE_US;
+	}
+	return 0;
+}
+
+//a sequential read from the address pointer, which wraps at the end of the device
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity){
+	if(quantity > BUFFER_LENGTH) quantity = BUFFER_LENGTH;
+	rxIndex = 0;
+	rxLength = 0;
+	if(!eepromAcks(address) || (HostSim::i2cLoseEvery && (++eeReads % HostSim::i2cLoseEvery == 0))){
+		busTime(1);
+		return 0;
+	}
+	busTime(1 + quantity);
+	for(uint8_t i = 0; i < quantity; i++){
+		rxBuffer[rxLength++] = HostSim::i2cEeprom[eePointer++];
+	}
+	return rxLength;
+}
+
+size_t TwoWire::write(uint8_t data){
+	if(txLength >= BUFFER_LENGTH) return 0;
+	txBuffer[txLength++] = data;
+	return 1;
+}
+
+size_t TwoWire::write(const uint8_t* data, size_t quantity){
+	size_t n = 0;
+	while(n < quantity && write(data[n])) n++;
+	return n;
+}
+
+int TwoWire::available(void){
+	return rxLength - rxIndex;
+}
+
+int TwoWire::read(void){
+	return (rxIndex < rxLength) ? rxBuffer[rxIndex++] : -1;
+}
+
+void TwoWire::onReceive(void (*function)(int)){
+	onReceiveHandler = function;
+}
+
+//the received bytes are read from the receive buffer in the handler, as from the TWI interrupt's buffer
+bool TwoWire::slaveReceive(const uint8_t* data, uint8_t len){
+	if(len > BUFFER_LENGTH) len = BUFFER_LENGTH;
+	for(uint8_t i = 0; i < len; i++) rxBuffer[i] = data[i];
+	rxLength = len;
+	rxIndex = 0;
+	if(onReceiveHandler) onReceiveHandler(len);
+	return true;
+}
+
+TwoWire Wire;
@@ -0,0 +1,51 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for the Wire library. The only device on the bus is the simulated I2C EEPROM (see HostSim.h), when present;
+ * transmissions to any other address are NACKed and requests return nothing, except for general calls (address 0), which go
+ * to other simulated boards through HostSim::i2cBroadcast. Once begun as a slave, general calls from other boards are received
+ * (HostSim::i2cSlave) and passed to the onReceive handler, as the TWI interrupt does. */
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+#define BUFFER_LENGTH 32
+
+class TwoWire{
+	public:
+		void begin();
+		void begin(uint8_t address);
+		void beginTransmission(uint8_t address);
+		uint8_t endTransmission(void);
+		uint8_t requestFrom(uint8_t address, uint8_t quantity);
+		size_t write(uint8_t data);
+		size_t write(const uint8_t* data, size_t quantity);
+		int available(void);
+		int read(void);
+		void onReceive(void (*function)(int));
+		//host-only: bytes written to this board as a slave
+		bool slaveReceive(const uint8_t* data, uint8_t len);
+	private:
+		void (*onReceiveHandler)(int);
+		uint8_t txAddress;
+		uint8_t txBuffer[BUFFER_LENGTH];
+		uint8_t txLength;
+		uint8_t rxBuffer[BUFFER_LENGTH];
+		uint8_t rxLength;
+		uint8_t rxIndex;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host equivalent of main.cpp: runs setup() then loop() from sketch.cpp against the stand-ins in hal/,
+ * and reports how fast the sketch ticks. See the Makefile in this directory for how to build.
+ *
+ * Usage: xmas-host [options]
+ *	--fast            simulated time, as fast as possible (default)
+ *	--realtime        follow the wall clock; delay() sleeps
+ *	--seconds N       stop after N (simulated or real) seconds, default 60
+ *	--ticks N         stop after N ticks instead
+ *	--loop-us N       in --fast mode, simulated time consumed by each pass of loop(), default 250
+ *	--eeprom FILE     load an Intel HEX EEPROM image, e.g. "../EEPROM Programs/Xmas1.hex"
+ *	--eeprom-out FILE after the run, save the EEPROM as an Intel HEX image, e.g. to start the next run from it as after a
+ *	                  power cycle (the state journal, ../StateJournal.h, is in the EEPROM)
+ *	--synth-program   instead, generate a one-program image for however many LEDs the sketch was built with:
+ *	                  an LFO-driven triangle chase, phase-spread along the LEDs and gated by a moving dot
+ *	--i2c-eeprom FILE fit the simulated I2C EEPROM, loaded with an Intel HEX image (the sketch prefers it to the internal EEPROM)
+ *	--i2c-synth N     fit the simulated I2C EEPROM, with N variations of the --synth-program program, cycling every ~4s
+ *	--lev1/2/3 N      ADC reading (0-1023) for VR1..VR3, default 512
+ *	--adc-noise N     add uniform noise of +/-N counts to every ADC conversion
+ *	--ir HEXCODE      queue an IR code (may be repeated)
+ *	--serial TEXT     queue TEXT as Serial input
+ *	--report-serial TEXT
+ *	                  after the run, send TEXT on Serial and make one more pass of loop(),
+ *	                  e.g. "p" for the profiler report of a PROFILE=1 build
+ *	--quiet           discard Serial output
+ *	--telemetry FILE  write the binary telemetry stream (see ../Telemetry.h) to FILE, "-" for stdout; decode it with tel-decode.
+ *	                  Only in a build with TELEMETRY (the default; see ../XmasConfig.h)
+ *	--ground PIN      tie a digital pin to ground, e.g. 7 to make a SYNC_I2C build a sync follower (may be repeated)
+ *	--node            be run, in steps, by another program (sync-sim, see sync_sim.cpp, or upload-programs, see
+ *	                  upload_programs.cpp) instead of running on its own. Commands are read from stdin, one per line, with
+ *	                  times in this board's own (simulated) microseconds:
+ *	                    R TIME       run until TIME, then reply "D"
+ *	                    S HEX        bytes of Serial input, e.g. program upload commands
+ *	                    B TIME HEX   an I2C general call from another board, to be received at TIME (SYNC_I2C builds)
+ *	                  and written to stdout, during R:
+ *	                    F TIME TICK PROGRAM HEX   a brightness frame (tick count, program, a byte per LED). The tick count is
+ *	                                 SyncLink's in a SYNC_I2C build
+ *	                    B TIME HEX   a general call sent by this board, ending at TIME (SYNC_I2C builds)
+ *	                    T HEX        telemetry bytes sent, unless --telemetry is given (TELEMETRY builds)
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "ShapedBrightnessController.h"
+#include "TickScheduler.h"
+#include "ProgramStore.h"
+#include "StateJournal.h"
+#include "XmasConfig.h"
+#ifdef TELEMETRY
+#include "Telemetry.h"
+#endif
+
+#include <vector>
+
+extern ShapedBrightnessController sbc;
+extern TickScheduler ticker;
+extern ProgramStore progStore;
+extern StateJournal journal;
+#ifdef TELEMETRY
+extern Telemetry telemetry;
+#endif
+extern uint8_t currentProgram;
+#ifdef SYNC_I2C
+extern unsigned long syncTick;
+#endif
+
+//legacy-format programs that exercise every LED: see --synth-program. Program n has shape n%3+1 and the phase spread n+1 times
+//along the LEDs. Returns false if they do not fit in size bytes
+static bool synthPrograms(uint8_t* e, uint32_t size, uint8_t numLeds, int count){
+	if(8 + (uint32_t)count * (8 + 8 * numLeds) > size) return false;
+	uint32_t a = 0;
+	e[a++] = numLeds;
+	e[a++] = count;
+	e[a++] = count > 1 ? 0xFF : 0;//program cycling rate source: constant 1016 (a change every ~4s), or SRC_OFF
+	while(a < 8) e[a++] = 0;
+	for(int p = 0; p < count; p++){
+		//LFO rate from VR1
+		e[a++] = 4; e[a++] = 0xFF; e[a++] = 0xFF; e[a++] = 0xFF;
+		//trigger/gate mask: single moving dot, rate from VR2
+		e[a++] = 5; e[a++] = 1; e[a++] = 0xFF; e[a++] = 0xFF;
+		for(uint8_t led = 0; led < numLeds; led++){
+			int phase = (led * 2048 * (p + 1) / numLeds) % 2048;
+			e[a++] = 0x01 + (p + 1) % 3; e[a++] = 0xFF; e[a++] = phase >> 8; e[a++] = phase & 0xFF;
+		}
+		for(uint8_t led = 0; led < numLeds; led++){
+			//rate from the LFO, scale from VR3, gated by this LED's mask bit
+			e[a++] = 0x0D; e[a++] = 0; e[a++] = 6; e[a++] = 0x10 + led;
+		}
+	}
+	return true;
+}
+
+static void usage(){
+	fprintf(stderr, "usage: xmas-host [--fast|--realtime] [--seconds N|--ticks N] [--loop-us N] [--eeprom FILE|--synth-program] [--eeprom-out FILE]\n"
+		"                 [--i2c-eeprom FILE|--i2c-synth N] [--lev1 N] [--lev2 N] [--lev3 N] [--adc-noise N] [--ir HEXCODE]... [--serial TEXT]\n"
+		"                 [--report-serial TEXT] [--quiet] [--telemetry FILE] [--ground PIN]... [--node]\n");
+	exit(2);
+}
+
+//--node: general calls from the other boards, in the order they are to be received
+struct Delivery{
+	uint64_t at;
+	std::vector<uint8_t> data;
+};
+static std::vector<Delivery> deliveries;
+
+static void putHex(const uint8_t* data, size_t len){
+	for(size_t i = 0; i < len; i++) printf("%02X", data[i]);
+}
+
+static std::vector<uint8_t> parseHex(const char* p){
+	std::vector<uint8_t> data;
+	unsigned b;
+	int n;
+	for(; sscanf(p, "%2x%n", &b, &n) == 1; p += n) data.push_back(b);
+	return data;
+}
+
+#ifdef SYNC_I2C
+static bool nodeBroadcast(const uint8_t* data, uint8_t len){
+	printf("B %llu ", (unsigned long long)HostSim::nowMicros());
+	putHex(data, len);
+	printf("\n");
+	return true;
+}
+
+#endif
+
+static void nodeFrame(uint32_t tickNum, uint8_t numLeds, const uint8_t* brightness){
+	#ifdef SYNC_I2C
+	tickNum = syncTick;
+	#endif
+	printf("F %llu %lu %u ", (unsigned long long)HostSim::nowMicros(), (unsigned long)tickNum, currentProgram);
+	putHex(brightness, numLeds);
+	printf("\n");
+}
+
+//runs loop() in passes of loopMicros, but never past a delivery or the end of the run, so frames arrive on time
+static int runNode(uint32_t loopMicros){
+	#ifdef SYNC_I2C
+	HostSim::i2cBroadcast = nodeBroadcast;
+	#endif
+	HostSim::onFrame = nodeFrame;
+	//telemetry is passed on after each run
+	char* telBuf = 0;
+	size_t telLen = 0;
+	FILE* tel = 0;
+	if(!HostSim::telemetryOut){
+		tel = HostSim::telemetryOut = open_memstream(&telBuf, &telLen);
+	}
+	setup();
+	char line[256];
+	while(fgets(line, sizeof(line), stdin)){
+		unsigned long long t;
+		int pos = 0;
+		if(sscanf(line, "B %llu %n", &t, &pos) == 1 && pos > 0){
+			Delivery d;
+			d.at = t;
+			d.data = parseHex(line + pos);
+			deliveries.push_back(d);
+		}else if(line[0] == 'S' && line[1] == ' '){
+			std::vector<uint8_t> data = parseHex(line + 2);
+			if(!data.empty()) HostSim::pushSerial(&data[0], data.size());
+		}else if(sscanf(line, "R %llu", &t) == 1){
+			while(HostSim::nowMicros() < t){
+				while(!deliveries.empty() && deliveries[0].at <= HostSim::nowMicros()){
+					if(HostSim::i2cSlave) HostSim::i2cSlave(&deliveries[0].data[0], deliveries[0].data.size());
+					deliveries.erase(deliveries.begin());
+				}
+				loop();
+				uint64_t end = HostSim::nowMicros() + loopMicros;
+				if(end > t) end = t;
+				if(!deliveries.empty() && deliveries[0].at < end) end = deliveries[0].at;
+				if(end > HostSim::nowMicros()) HostSim::advance(end - HostSim::nowMicros());
+			}
+			if(tel){
+				fflush(tel);
+				if(telLen){
+					printf("T ");
+					putHex((const uint8_t*)telBuf, telLen);
+					printf("\n");
+					fseek(tel, 0, SEEK_SET);
+				}
+			}
+			printf("D\n");
+			fflush(stdout);
+		}else{
+			fprintf(stderr, "node: bad command %s", line);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char** argv){
+	double seconds = 60;
+	unsigned long maxTicks = 0;
+	uint32_t loopMicros = 250;
+	HostSim::ClockMode mode = HostSim::FAST;
+	const char* reportSerial = 0;
+	bool synth = false;
+	int i2cSynth = 0;
+	bool node = false;
+	const char* eepromOut = 0;
+	for(int i = 0; i < 8; i++) HostSim::analog[i] = 512;
+	HostSim::analog[0] = 0;
+
+	for(int i = 1; i < argc; i++){
+		const char* a = argv[i];
+		bool hasVal = (i + 1 < argc);
+		if(!strcmp(a, "--fast")){
+			mode = HostSim::FAST;
+		}else if(!strcmp(a, "--realtime")){
+			mode = HostSim::REALTIME;
+		}else if(!strcmp(a, "--seconds") && hasVal){
+			seconds = atof(argv[++i]);
+		}else if(!strcmp(a, "--ticks") && hasVal){
+			maxTicks = strtoul(argv[++i], 0, 10);
+		}else if(!strcmp(a, "--loop-us") && hasVal){
+			loopMicros = strtoul(argv[++i], 0, 10);
+		}else if(!strcmp(a, "--eeprom") && hasVal){
+			if(!HostSim::loadIntelHex(argv[++i])) return 1;
+		}else if(!strcmp(a, "--eeprom-out") && hasVal){
+			eepromOut = argv[++i];
+		}else if(!strcmp(a, "--synth-program")){
+			synth = true;
+		}else if(!strcmp(a, "--i2c-eeprom") && hasVal){
+			if(!HostSim::loadIntelHex(argv[++i], HostSim::i2cEeprom, HOST_I2C_EEPROM_SIZE)) return 1;
+			HostSim::i2cEepromPresent = true;
+		}else if(!strcmp(a, "--i2c-synth") && hasVal){
+			i2cSynth = atoi(argv[++i]);
+			if(i2cSynth < 1 || i2cSynth > 255) usage();
+			HostSim::i2cEepromPresent = true;
+		}else if(!strncmp(a, "--lev", 5) && a[5] >= '1' && a[5] <= '3' && !a[6] && hasVal){
+			HostSim::analog[a[5] - '0'] = atoi(argv[++i]);
+		}else if(!strcmp(a, "--adc-noise") && hasVal){
+			HostSim::analogNoise = atoi(argv[++i]);
+		}else if(!strcmp(a, "--ir") && hasVal){
+			HostSim::pushIR(strtoul(argv[++i], 0, 16));
+		}else if(!strcmp(a, "--serial") && hasVal){
+			HostSim::pushSerial(argv[++i]);
+		}else if(!strcmp(a, "--report-serial") && hasVal){
+			reportSerial = argv[++i];
+		}else if(!strcmp(a, "--quiet")){
+			HostSim::serialOut = 0;
+		}else if(!strcmp(a, "--telemetry") && hasVal){
+			const char* path = argv[++i];
+			HostSim::telemetryOut = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+			if(!HostSim::telemetryOut){
+				fprintf(stderr, "cannot write %s\n", path);
+				return 1;
+			}
+		}else if(!strcmp(a, "--ground") && hasVal){
+			int pin = atoi(argv[++i]);
+			if(pin < 0 || pin >= NUM_DIGITAL_PINS) usage();
+			HostSim::groundedPins |= 1UL << pin;
+			HostSim::pinLevel[pin] = LOW;
+		}else if(!strcmp(a, "--node")){
+			node = true;
+			HostSim::serialOut = 0;
+		}else{
+			usage();
+		}
+	}
+
+	if(synth && !synthPrograms(HostSim::eeprom, HOST_EEPROM_SIZE, sbc.getNumLeds(), 1)){
+		fprintf(stderr, "--synth-program: %u LEDs do not fit in EEPROM\n", sbc.getNumLeds());
+		return 1;
+	}
+	if(i2cSynth && !synthPrograms(HostSim::i2cEeprom, HOST_I2C_EEPROM_SIZE, sbc.getNumLeds(), i2cSynth)){
+		fprintf(stderr, "--i2c-synth: %d programs for %u LEDs do not fit in the I2C EEPROM\n", i2cSynth, sbc.getNumLeds());
+		return 1;
+	}
+	HostSim::setClockMode(mode);
+	if(node){
+		HostSim::setClockMode(HostSim::FAST);
+		return runNode(loopMicros);
+	}
+	uint64_t endMicros = (uint64_t)(seconds * 1e6);
+	uint64_t wallStart = HostSim::wallNanos();
+
+	setup();
+
+	unsigned long loops = 0;
+	uint64_t tickNanos = 0, maxTickNanos = 0, idleNanos = 0;
+	for(;;){
+		uint32_t ticksBefore = sbc.getTickCount();
+		uint64_t t0 = HostSim::wallNanos();
+		loop();
+		uint64_t dt = HostSim::wallNanos() - t0;
+		loops++;
+		if(sbc.getTickCount() != ticksBefore){
+			tickNanos += dt;
+			if(dt > maxTickNanos) maxTickNanos = dt;
+		}else{
+			idleNanos += dt;
+		}
+		HostSim::advance(loopMicros);
+		if(maxTicks ? (sbc.getTickCount() >= maxTicks) : (HostSim::nowMicros() >= endMicros)) break;
+	}
+
+	double wall = (HostSim::wallNanos() - wallStart) / 1e9;
+	double simSecs = HostSim::nowMicros() / 1e6;
+	uint32_t ticks = sbc.getTickCount();
+	fprintf(stderr, "time         %.3f s %s, %.3f s wall (x%.0f)\n", simSecs, mode == HostSim::FAST ? "simulated" : "real",
+		wall, wall > 0 ? simSecs / wall : 0.0);
+	fprintf(stderr, "ticks        %lu (%.2f /s sketch time, %.0f /s wall)\n", (unsigned long)ticks,
+		simSecs > 0 ? ticks / simSecs : 0.0, wall > 0 ? ticks / wall : 0.0);
+	fprintf(stderr, "loop passes  %lu\n", loops);
+	fprintf(stderr, "tick loop()  mean %.0f ns, max %.0f ns\n", ticks ? (double)tickNanos / ticks : 0.0, (double)maxTickNanos);
+	fprintf(stderr, "idle loop()  mean %.0f ns\n", loops > ticks ? (double)idleNanos / (loops - ticks) : 0.0);
+	fprintf(stderr, "scheduler    %lu ticks, %u missed, %u overruns, jitter mean %lu us, max %lu us\n", ticker.getTicks(),
+		ticker.getMissed(), ticker.getOverruns(), ticker.getMeanJitter(), ticker.getMaxJitter());
+	if(HostSim::i2cEepromPresent){
+		fprintf(stderr, "i2c eeprom   %s, %u line fetches (%u failed), %lu bus transactions\n", progStore.isI2C() ? "in use" : "not used",
+			progStore.getFetches(), progStore.getErrors(), HostSim::i2cTransactions);
+	}
+
+	unsigned long eepromWrites = 0, maxWrites = 0;
+	for(uint32_t a = 0; a < HOST_EEPROM_SIZE; a++){
+		eepromWrites += HostSim::eepromWrites[a];
+		if(HostSim::eepromWrites[a] > maxWrites) maxWrites = HostSim::eepromWrites[a];
+	}
+	fprintf(stderr, "eeprom       %u journal records, %lu byte writes, at most %lu to one byte\n", journal.getWrites(), eepromWrites,
+		maxWrites);
+	#ifdef TELEMETRY
+	fprintf(stderr, "telemetry    %u records dropped\n", telemetry.getDropped());
+	#endif
+	if(eepromOut && !HostSim::saveIntelHex(eepromOut, HostSim::eeprom, HOST_EEPROM_SIZE)) return 1;
+	if(HostSim::telemetryOut && (HostSim::telemetryOut != stdout)){
+		fclose(HostSim::telemetryOut);
+		HostSim::telemetryOut = 0;
+	}
+
+	if(reportSerial){
+		fflush(stderr);
+		HostSim::serialOut = stdout;
+		HostSim::pushSerial(reportSerial);
+		loop();
+	}
+	return 0;
+}
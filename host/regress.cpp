@@ -0,0 +1,210 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Golden-frame regression and throughput check for one EEPROM image (the UnitTest_Bank images; see "make test").
+ * The sketch is run in simulated time with fixed inputs. Program cycling is stopped (IR PROG, PLAY) and then each program is
+ * selected in turn with IR PROG, digits, OK and run for REGRESS_TICKS ticks. Every tick's controller inputs (rate, scale,
+ * trigger/gate) and modelled brightness for each LED are recorded and compared with the golden trace.
+ * The wall-clock cost of each tick is also measured, per program, with the share of LED parameter updates that were skipped
+ * because their source had not changed.
+ *
+ * Usage: regress [--update] [--i2c [--i2c-lose N]] [--brief] image.hex golden.trace
+ *	--update   write the golden trace instead of comparing with it
+ *	--i2c      load the image into the simulated I2C EEPROM rather than the internal EEPROM
+ *	--i2c-lose N   lose every Nth read from the I2C EEPROM, as to another master on the bus; the frames must not change
+ *	--brief    omit the tick cost report
+ * Exit status 0 if the trace matches (or was written), 1 if it differs.
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "ShapedBrightnessController.h"
+#include "IrQueue.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+extern ShapedBrightnessController sbc;
+extern IrQueue irQueue;
+extern uint16_t patchSkipped;
+extern uint8_t currentProgram;
+extern uint8_t programCount;
+
+//ticks recorded per program
+#define REGRESS_TICKS 48
+//simulated time per pass of loop()
+#define REGRESS_LOOP_US 250
+
+#define IR_PROG 0xFF906F
+#define IR_PLAY 0xFFC23D
+#define IR_OK 0xFFB04F
+static const unsigned long irDigits[10] = {0xFF6897, 0xFF30CF, 0xFF18E7, 0xFF7A85, 0xFF10EF, 0xFF38C7, 0xFF5AA5, 0xFF42BD, 0xFF4AB5, 0xFF52AD};
+
+struct ProgramCost{
+	unsigned long ticks;
+	uint64_t sumNanos;
+	uint64_t maxNanos;
+	unsigned long skipped;
+};
+
+int main(int argc, char** argv){
+	bool update = false;
+	bool i2c = false;
+	bool brief = false;
+	int arg = 1;
+	for(; arg < argc && argv[arg][0] == '-'; arg++){
+		if(!strcmp(argv[arg], "--update")) update = true;
+		else if(!strcmp(argv[arg], "--i2c")) i2c = true;
+		else if(!strcmp(argv[arg], "--i2c-lose") && arg + 1 < argc) HostSim::i2cLoseEvery = atoi(argv[++arg]);
+		else if(!strcmp(argv[arg], "--brief")) brief = true;
+		else break;
+	}
+	if(argc - arg != 2){
+		fprintf(stderr, "usage: regress [--update] [--i2c [--i2c-lose N]] [--brief] image.hex golden.trace\n");
+		return 2;
+	}
+	const char* image = argv[arg];
+	const char* goldenPath = argv[arg + 1];
+	const char* name = image;
+
+	HostSim::serialOut = 0;
+	HostSim::analog[0] = 0;
+	HostSim::analog[1] = 300;
+	HostSim::analog[2] = 600;
+	HostSim::analog[3] = 900;
+	if(i2c){
+		if(!HostSim::loadIntelHex(image, HostSim::i2cEeprom, HOST_I2C_EEPROM_SIZE)) return 1;
+		HostSim::i2cEepromPresent = true;
+	}else if(!HostSim::loadIntelHex(image)){
+		return 1;
+	}
+	HostSim::setClockMode(HostSim::FAST);
+	setup();
+	if(programCount == 0){
+		fprintf(stderr, "%s: no programs for this number of LEDs\n", name);
+		return 1;
+	}
+
+	//stop program cycling, so that only the selected program runs.
+	//The codes are sent one per tick, as a remote would: the sketch acts on all it has received at each tick
+	std::deque<unsigned long> irScript;
+	irScript.push_back(IR_PROG);
+	irScript.push_back(IR_PLAY);
+	bool irSent = false;
+	uint32_t irSentTick = 0;
+
+	std::vector<std::string> trace;
+	std::vector<ProgramCost> costs(programCount + 1);
+	char line[32 + 16 * SBC_MAX_LEDS];
+	uint64_t wallStart = HostSim::wallNanos();
+	unsigned long totalTicks = 0;
+	for(uint8_t p = 1; p <= programCount; p++){
+		irScript.push_back(IR_PROG);
+		irScript.push_back(irDigits[p / 10]);
+		irScript.push_back(irDigits[p % 10]);
+		irScript.push_back(IR_OK);
+		//record from the tick after OK
+		uint32_t start = 0;
+		bool loaded = false;
+		ProgramCost& cost = costs[p];
+		cost.ticks = 0;
+		cost.sumNanos = 0;
+		cost.maxNanos = 0;
+		cost.skipped = 0;
+		while(!loaded || (sbc.getTickCount() - start < REGRESS_TICKS)){
+			uint32_t before = sbc.getTickCount();
+			if(!irScript.empty() && !(irSent && irSentTick == before) && !HostSim::irPending() && !irQueue.count()){
+				HostSim::pushIR(irScript.front());
+				irScript.pop_front();
+				irSent = true;
+				irSentTick = before;
+			}
+			uint64_t t0 = HostSim::wallNanos();
+			loop();
+			uint64_t dt = HostSim::wallNanos() - t0;
+			HostSim::advance(REGRESS_LOOP_US);
+			if(sbc.getTickCount() == before) continue;
+			if(!loaded){
+				if(!irScript.empty() || HostSim::irPending() || irQueue.count()) continue;
+				loaded = true;
+				start = sbc.getTickCount();
+				continue;
+			}
+			cost.ticks++;
+			cost.sumNanos += dt;
+			if(dt > cost.maxNanos) cost.maxNanos = dt;
+			cost.skipped += patchSkipped;
+			int n = snprintf(line, sizeof(line), "%u %u", currentProgram, sbc.getTickCount() - start);
+			for(uint8_t led = 0; led < sbc.getNumLeds(); led++){
+				n += snprintf(line + n, sizeof(line) - n, " %02X:%04X:%04X:%04X", sbc.getBrightness(led), sbc.getRate(led),
+					sbc.getScale(led), sbc.getTriggerIP(led));
+			}
+			trace.push_back(line);
+		}
+		totalTicks += cost.ticks;
+	}
+	double wall = (HostSim::wallNanos() - wallStart) / 1e9;
+
+	int status = 0;
+	if(update){
+		FILE* f = fopen(goldenPath, "w");
+		if(!f){
+			fprintf(stderr, "cannot write %s\n", goldenPath);
+			return 1;
+		}
+		fprintf(f, "# golden trace for %s: %d ticks per program, VR1..3 = 300/600/900\n", strrchr(name, '/') ? strrchr(name, '/') + 1 : name,
+			REGRESS_TICKS);
+		fprintf(f, "# program tick, then per LED brightness:rate:scale:trigger (hex)\n");
+		for(size_t i = 0; i < trace.size(); i++) fprintf(f, "%s\n", trace[i].c_str());
+		fclose(f);
+		printf("%s: wrote %zu frames to %s\n", name, trace.size(), goldenPath);
+	}else{
+		FILE* f = fopen(goldenPath, "r");
+		if(!f){
+			fprintf(stderr, "cannot open %s (make golden creates it)\n", goldenPath);
+			return 1;
+		}
+		std::vector<std::string> golden;
+		while(fgets(line, sizeof(line), f)){
+			if(line[0] == '#') continue;
+			line[strcspn(line, "\r\n")] = 0;
+			golden.push_back(line);
+		}
+		fclose(f);
+		size_t diffs = 0;
+		for(size_t i = 0; i < trace.size() || i < golden.size(); i++){
+			const char* got = i < trace.size() ? trace[i].c_str() : "(none)";
+			const char* want = i < golden.size() ? golden[i].c_str() : "(none)";
+			if(strcmp(got, want)){
+				if(diffs == 0) fprintf(stderr, "%s: first difference at frame %zu\n  golden: %s\n  got:    %s\n", name, i, want, got);
+				diffs++;
+			}
+		}
+		if(diffs){
+			printf("%s%s: FAIL, %zu of %zu frames differ\n", name, !i2c ? "" : HostSim::i2cLoseEvery ? " (I2C EEPROM, reads lost)" : " (I2C EEPROM)", diffs, golden.size());
+			status = 1;
+		}else{
+			printf("%s%s: ok, %zu frames identical\n", name, !i2c ? "" : HostSim::i2cLoseEvery ? " (I2C EEPROM, reads lost)" : " (I2C EEPROM)", trace.size());
+		}
+	}
+
+	if(brief) return status;
+	printf("  %-8s %8s %12s %12s %10s\n", "program", "ticks", "mean ns", "max ns", "skipped");
+	for(uint8_t p = 1; p <= programCount; p++){
+		double params = 3.0 * sbc.getNumLeds() * costs[p].ticks;
+		printf("  %-8u %8lu %12.0f %12llu %9.1f%%\n", p, costs[p].ticks, costs[p].ticks ? (double)costs[p].sumNanos / costs[p].ticks : 0.0,
+			(unsigned long long)costs[p].maxNanos, params > 0 ? 100 * costs[p].skipped / params : 0.0);
+	}
+	printf("  throughput %.0f ticks/s (wall, including the passes of loop() between ticks)\n", wall > 0 ? totalTicks / wall : 0.0);
+	return status;
+}
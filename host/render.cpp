@@ -0,0 +1,335 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Headless renderer: runs the sketch on an EEPROM image in simulated time, driven by a script of input changes, and writes the
+ * brightness of every LED on every tick as CSV and/or a timeline picture. Use it to preview a program image, or a whole evening of
+ * auto-cycling, before flashing it.
+ *
+ * Usage: xmas-render [options] image.hex
+ *	--i2c             load the image into the simulated I2C EEPROM instead of the internal EEPROM
+ *	--duration T      simulated time to run, default 10m (T is seconds, or numbers with units s, m, h, e.g. 1h30m)
+ *	--script FILE     input changes (see below)
+ *	--csv FILE        one row per tick: tick, ms, program, then the brightness of each LED
+ *	--every N         write every Nth tick to the CSV (default 1)
+ *	--ppm FILE        timeline picture (binary PPM): time runs left to right, one band per LED, coloured R, G or B by its
+ *	                  place in the RGB triple. Columns are the mean of --ppm-ticks ticks. A white mark along the top shows a program change
+ *	--ppm-ticks N     ticks per column, default chosen to give about 2000 columns
+ *	--loop-us N       simulated time consumed by each pass of loop(), default 250
+ *	--lev1/2/3 N      initial ADC reading for VR1..VR3, default 512
+ *
+ * Script lines are "TIME ACTION [VALUE]", with # for comments. TIME is as for --duration. Actions:
+ *	lev1 N, lev2 N, lev3 N, audio N   set the ADC reading for that input (0-1023)
+ *	sw1 L, sw2 L, sw3 L               set the switch input level (0 = pressed, 1 = released)
+ *	press1, press2, press3            press and release the switch (100ms)
+ *	ir CODE                           an IR code: hex (e.g. FF02FD), a button name (NEXT, PREV, PROG, OK, PLAY, CANCEL, PLUS,
+ *	                                  MINUS, CH, CH+, CH-) or a digit 0-9
+ *	prog N                            select program N: PROG, the digits, OK
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "ShapedBrightnessController.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+extern ShapedBrightnessController sbc;
+extern uint8_t currentProgram;
+
+//switch pins, as PIN_SW1..3 in sketch.cpp
+static const uint8_t switchPins[3] = {2, 3, 4};
+
+struct IrName{
+	const char* name;
+	unsigned long code;
+};
+
+//as the IR_* codes in sketch.cpp
+static const IrName irNames[] = {
+	{"0", 0xFF6897}, {"1", 0xFF30CF}, {"2", 0xFF18E7}, {"3", 0xFF7A85}, {"4", 0xFF10EF},
+	{"5", 0xFF38C7}, {"6", 0xFF5AA5}, {"7", 0xFF42BD}, {"8", 0xFF4AB5}, {"9", 0xFF52AD},
+	{"CH+", 0xFFE21D}, {"CH-", 0xFFA25D}, {"CH", 0xFF629D}, {"NEXT", 0xFF02FD}, {"PREV", 0xFF22DD},
+	{"PLUS", 0xFFA857}, {"MINUS", 0xFFE01F}, {"PLAY", 0xFFC23D}, {"PROG", 0xFF906F}, {"CANCEL", 0xFF9867},
+	{"OK", 0xFFB04F}
+};
+
+struct Event{
+	uint64_t us;
+	int kind;//EV_*
+	int channel;
+	unsigned long value;
+	bool operator<(const Event& o) const{ return us < o.us; }
+};
+enum {EV_ADC, EV_PIN, EV_IR};
+
+static std::vector<Event> events;
+
+//seconds, or a sequence of numbers with s/m/h units (e.g. 1h30m); returns false if malformed
+static bool parseTime(const char* s, uint64_t* us){
+	double total = 0;
+	do{
+		char* end;
+		double v = strtod(s, &end);
+		if(end == s || v < 0) return false;
+		if(*end == 'm') v *= 60;
+		else if(*end == 'h') v *= 3600;
+		else if(*end != 's' && *end != 0) return false;
+		total += v;
+		s = *end ? end + 1 : end;
+	}while(*s);
+	*us = (uint64_t)(total * 1e6);
+	return true;
+}
+
+static bool irCode(const char* s, unsigned long* code){
+	for(size_t i = 0; i < sizeof(irNames) / sizeof(irNames[0]); i++){
+		if(!strcasecmp(s, irNames[i].name)){
+			*code = irNames[i].code;
+			return true;
+		}
+	}
+	char* end;
+	*code = strtoul(s, &end, 16);
+	return *s && !*end && *code > 9;
+}
+
+static void addEvent(uint64_t us, int kind, int channel, unsigned long value){
+	Event e = {us, kind, channel, value};
+	events.push_back(e);
+}
+
+//IR codes are spaced out, as a person pressing buttons would, so that each is seen by a separate tick
+#define IR_GAP_US 200000
+
+static bool loadScript(const char* path){
+	FILE* f = fopen(path, "r");
+	if(!f){
+		fprintf(stderr, "cannot open %s\n", path);
+		return false;
+	}
+	char line[256];
+	int lineNum = 0;
+	while(fgets(line, sizeof(line), f)){
+		lineNum++;
+		char* hash = strchr(line, '#');
+		if(hash) *hash = 0;
+		char t[64], action[64], value[64];
+		int n = sscanf(line, "%63s %63s %63s", t, action, value);
+		if(n <= 0) continue;
+		uint64_t us;
+		bool ok = (n >= 2) && parseTime(t, &us);
+		if(ok){
+			std::string a(action);
+			if(n == 3 && (a == "lev1" || a == "lev2" || a == "lev3")){
+				addEvent(us, EV_ADC, a[3] - '0', atoi(value));
+			}else if(n == 3 && a == "audio"){
+				addEvent(us, EV_ADC, 0, atoi(value));
+			}else if(n == 3 && a.size() == 3 && a.compare(0, 2, "sw") == 0 && a[2] >= '1' && a[2] <= '3'){
+				addEvent(us, EV_PIN, switchPins[a[2] - '1'], atoi(value) ? HIGH : LOW);
+			}else if(n == 2 && a.size() == 6 && a.compare(0, 5, "press") == 0 && a[5] >= '1' && a[5] <= '3'){
+				addEvent(us, EV_PIN, switchPins[a[5] - '1'], LOW);
+				addEvent(us + 100000, EV_PIN, switchPins[a[5] - '1'], HIGH);
+			}else if(n == 3 && a == "ir"){
+				unsigned long code;
+				ok = irCode(value, &code);
+				if(ok) addEvent(us, EV_IR, 0, code);
+			}else if(n == 3 && a == "prog"){
+				int p = atoi(value);
+				ok = (p >= 1 && p <= 99);
+				if(ok){
+					const char* keys[4] = {"PROG", irNames[p / 10].name, irNames[p % 10].name, "OK"};
+					for(int k = 0; k < 4; k++){
+						unsigned long code;
+						irCode(keys[k], &code);
+						addEvent(us + k * IR_GAP_US, EV_IR, 0, code);
+					}
+				}
+			}else{
+				ok = false;
+			}
+		}
+		if(!ok){
+			fprintf(stderr, "%s:%d: cannot understand \"%s\"\n", path, lineNum, line);
+			fclose(f);
+			return false;
+		}
+	}
+	fclose(f);
+	std::stable_sort(events.begin(), events.end());
+	return true;
+}
+
+//output state, updated from the frame hook
+static FILE* csv = 0;
+static unsigned long csvEvery = 1;
+static uint32_t ppmTicks = 0;
+static std::vector<uint8_t> ppmColumns;//numLeds brightness values, then a program change flag, per column
+static uint32_t sum[SBC_MAX_LEDS];
+static uint32_t columnTicks = 0;
+static bool programChanged = false;
+static uint8_t lastProgram = 0;
+static unsigned long programChanges = 0;
+
+static void onFrame(uint32_t tickNum, uint8_t numLeds, const uint8_t* brightness){
+	if(currentProgram != lastProgram){
+		lastProgram = currentProgram;
+		programChanged = true;
+		programChanges++;
+	}
+	if(csv && (tickNum % csvEvery == 0)){
+		fprintf(csv, "%lu,%llu,%u", (unsigned long)tickNum, (unsigned long long)(HostSim::nowMicros() / 1000), currentProgram);
+		for(uint8_t i = 0; i < numLeds; i++) fprintf(csv, ",%u", brightness[i]);
+		fputc('\n', csv);
+	}
+	if(ppmTicks){
+		for(uint8_t i = 0; i < numLeds; i++) sum[i] += brightness[i];
+		if(++columnTicks == ppmTicks){
+			for(uint8_t i = 0; i < numLeds; i++){
+				ppmColumns.push_back((uint8_t)(sum[i] / ppmTicks));
+				sum[i] = 0;
+			}
+			ppmColumns.push_back(programChanged);
+			programChanged = false;
+			columnTicks = 0;
+		}
+	}
+}
+
+#define PPM_BAND 8 //pixel rows per LED
+#define PPM_MARK 4 //rows of the program change strip
+
+static bool writePpm(const char* path, uint8_t numLeds){
+	FILE* f = fopen(path, "wb");
+	if(!f){
+		fprintf(stderr, "cannot write %s\n", path);
+		return false;
+	}
+	size_t stride = numLeds + 1;
+	size_t width = ppmColumns.size() / stride;
+	size_t height = PPM_MARK + numLeds * PPM_BAND;
+	fprintf(f, "P6\n%zu %zu\n255\n", width, height);
+	for(size_t y = 0; y < height; y++){
+		for(size_t x = 0; x < width; x++){
+			const uint8_t* col = &ppmColumns[x * stride];
+			uint8_t rgb[3] = {0, 0, 0};
+			if(y < PPM_MARK){
+				if(col[numLeds]) rgb[0] = rgb[1] = rgb[2] = 255;
+			}else if((y - PPM_MARK) % PPM_BAND != PPM_BAND - 1){//leave a dark line between bands
+				uint8_t led = (y - PPM_MARK) / PPM_BAND;
+				rgb[led % 3] = col[led];
+			}
+			fwrite(rgb, 1, 3, f);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+static void usage(){
+	fprintf(stderr, "usage: xmas-render [--i2c] [--duration T] [--script FILE] [--csv FILE] [--every N] [--ppm FILE] [--ppm-ticks N]\n"
+		"                   [--loop-us N] [--lev1 N] [--lev2 N] [--lev3 N] image.hex\n");
+	exit(2);
+}
+
+int main(int argc, char** argv){
+	uint64_t duration = 600000000ULL;
+	uint32_t loopMicros = 250;
+	const char* image = 0;
+	const char* scriptPath = 0;
+	const char* csvPath = 0;
+	const char* ppmPath = 0;
+	bool i2c = false;
+	for(int i = 0; i < 8; i++) HostSim::analog[i] = 512;
+	HostSim::analog[0] = 0;
+
+	for(int i = 1; i < argc; i++){
+		const char* a = argv[i];
+		bool hasVal = (i + 1 < argc);
+		if(!strcmp(a, "--i2c")){
+			i2c = true;
+		}else if(!strcmp(a, "--duration") && hasVal){
+			if(!parseTime(argv[++i], &duration)) usage();
+		}else if(!strcmp(a, "--script") && hasVal){
+			scriptPath = argv[++i];
+		}else if(!strcmp(a, "--csv") && hasVal){
+			csvPath = argv[++i];
+		}else if(!strcmp(a, "--every") && hasVal){
+			csvEvery = strtoul(argv[++i], 0, 10);
+			if(csvEvery == 0) usage();
+		}else if(!strcmp(a, "--ppm") && hasVal){
+			ppmPath = argv[++i];
+		}else if(!strcmp(a, "--ppm-ticks") && hasVal){
+			ppmTicks = strtoul(argv[++i], 0, 10);
+			if(ppmTicks == 0) usage();
+		}else if(!strcmp(a, "--loop-us") && hasVal){
+			loopMicros = strtoul(argv[++i], 0, 10);
+		}else if(!strncmp(a, "--lev", 5) && a[5] >= '1' && a[5] <= '3' && !a[6] && hasVal){
+			HostSim::analog[a[5] - '0'] = atoi(argv[++i]);
+		}else if(a[0] != '-' && !image){
+			image = a;
+		}else{
+			usage();
+		}
+	}
+	if(!image) usage();
+	if(i2c){
+		if(!HostSim::loadIntelHex(image, HostSim::i2cEeprom, HOST_I2C_EEPROM_SIZE)) return 1;
+		HostSim::i2cEepromPresent = true;
+	}else if(!HostSim::loadIntelHex(image)){
+		return 1;
+	}
+	if(scriptPath && !loadScript(scriptPath)) return 1;
+	if(csvPath){
+		csv = fopen(csvPath, "w");
+		if(!csv){
+			fprintf(stderr, "cannot write %s\n", csvPath);
+			return 1;
+		}
+		fprintf(csv, "tick,ms,program");
+		for(uint8_t i = 0; i < sbc.getNumLeds(); i++) fprintf(csv, ",led%u", i);
+		fputc('\n', csv);
+	}
+	if(ppmPath && !ppmTicks){
+		//16 ticks per second
+		ppmTicks = (uint32_t)(duration / 62500 / 2000);
+		if(ppmTicks == 0) ppmTicks = 1;
+	}
+	if(!ppmPath) ppmTicks = 0;
+
+	HostSim::serialOut = 0;
+	HostSim::onFrame = onFrame;
+	HostSim::setClockMode(HostSim::FAST);
+	uint64_t wallStart = HostSim::wallNanos();
+
+	setup();
+	size_t next = 0;
+	while(HostSim::nowMicros() < duration){
+		uint64_t now = HostSim::nowMicros();
+		for(; next < events.size() && events[next].us <= now; next++){
+			const Event& e = events[next];
+			if(e.kind == EV_ADC) HostSim::analog[e.channel] = e.value > 1023 ? 1023 : e.value;
+			else if(e.kind == EV_PIN) HostSim::pinLevel[e.channel] = e.value;
+			else HostSim::pushIR(e.value);
+		}
+		loop();
+		HostSim::advance(loopMicros);
+	}
+
+	double wall = (HostSim::wallNanos() - wallStart) / 1e9;
+	double simSecs = HostSim::nowMicros() / 1e6;
+	if(csv) fclose(csv);
+	if(ppmPath && !writePpm(ppmPath, sbc.getNumLeds())) return 1;
+	fprintf(stderr, "%s: %.0f s simulated in %.2f s (x%.0f), %lu ticks, %lu program changes\n", image, simSecs, wall,
+		wall > 0 ? simSecs / wall : 0.0, (unsigned long)sbc.getTickCount(), programChanges > 0 ? programChanges - 1 : 0);
+	return 0;
+}
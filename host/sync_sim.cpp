@@ -0,0 +1,270 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Several boards on one I2C bus, kept in step by SyncLink (../SyncLink.h). Each board is an xmas-host process built with
+ * SYNC_I2C and run with --node (one process per board, since the sketch's globals are only initialised once): a master,
+ * and followers with PIN_SYNC_FOLLOW grounded. Each board has its own clock, running fast or slow by some ppm, as a ceramic
+ * resonator does, and the followers are powered up after the master. The boards are run in lockstep, a slice of (true) time at a
+ * time; the master runs first, and the frames it sends in the slice are passed to the followers to be received at the times the
+ * frames ended, converted to each follower's clock.
+ *
+ * Each follower is then compared with the master, after SETTLE seconds:
+ *	frames    the brightness of every LED, and the program, against the follower's frame nearest in time to each of the
+ *	          master's; i.e. whether the display looks the same
+ *	offset    (true) time from the master's tick to the follower's tick of the same count, mean and largest. Ticks run on the
+ *	          1024us beat of Timer0 on each board, so up to about 1ms is expected
+ * With --no-sync the frames are not passed on, for comparison; otherwise the exit status is 1 unless every follower holds
+ * 99% of frames the same as the master's and its ticks within 2.5ms.
+ *
+ * Usage: sync-sim [--seconds N] [--settle N] [--ppm P,...] [--no-sync] [--host PATH] [-- xmas-host options...]
+ *	--seconds N   simulated (true) time, default 120
+ *	--settle N    seconds after which the boards are compared, default 20
+ *	--ppm P,...   the followers' clock errors, one per follower, default 3000,-2000,5000 (the master's clock is exact)
+ *	--host PATH   the SYNC_I2C xmas-host, default build/sync/xmas-host
+ *	after --       options for every board, e.g. --eeprom FILE
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+#define SLICE_US 10000
+#define FOLLOW_PIN "7" //PIN_SYNC_FOLLOW in ../sketch.cpp
+#define START_STAGGER_US 370000 //follower n is powered up n times this after the master
+
+struct Frame{
+	double t;//true time, us
+	unsigned long tick;
+	unsigned program;
+	std::string brightness;
+};
+
+struct Node{
+	double ppm;
+	double start;//true time of power up, us
+	pid_t pid;
+	FILE* in;//commands to the board
+	FILE* out;//its output
+	std::vector<Frame> frames;
+	unsigned long frameCount;//general calls sent (master) or received
+	//true time to the board's clock and back
+	unsigned long long local(double t){
+		return (unsigned long long)llround((t - start) * (1 + ppm * 1e-6));
+	}
+	double trueTime(unsigned long long l){
+		return start + l / (1 + ppm * 1e-6);
+	}
+};
+
+static bool spawn(Node* n, const char* host, bool follower, const std::vector<const char*>& extra){
+	int toChild[2], fromChild[2];
+	if(pipe(toChild) || pipe(fromChild)) return false;
+	//so that no other board holds these open, and each sees the end of its commands
+	fcntl(toChild[1], F_SETFD, FD_CLOEXEC);
+	fcntl(fromChild[0], F_SETFD, FD_CLOEXEC);
+	n->pid = fork();
+	if(n->pid < 0) return false;
+	if(n->pid == 0){
+		dup2(toChild[0], 0);
+		dup2(fromChild[1], 1);
+		close(toChild[0]); close(toChild[1]); close(fromChild[0]); close(fromChild[1]);
+		std::vector<const char*> args;
+		args.push_back(host);
+		args.push_back("--quiet");
+		args.push_back("--node");
+		if(follower){
+			args.push_back("--ground");
+			args.push_back(FOLLOW_PIN);
+		}
+		args.insert(args.end(), extra.begin(), extra.end());
+		args.push_back(0);
+		execv(host, (char* const*)&args[0]);
+		fprintf(stderr, "cannot run %s\n", host);
+		_exit(1);
+	}
+	close(toChild[0]);
+	close(fromChild[1]);
+	n->in = fdopen(toChild[1], "w");
+	n->out = fdopen(fromChild[0], "r");
+	return n->in && n->out;
+}
+
+struct Broadcast{
+	double t;
+	std::string hex;
+};
+
+//runs a board to true time t, collecting its frames and, if sent is not NULL, its general calls
+static bool run(Node* n, double t, std::vector<Broadcast>* sent){
+	fprintf(n->in, "R %llu\n", n->local(t));
+	fflush(n->in);
+	char line[1024];
+	while(fgets(line, sizeof(line), n->out)){
+		unsigned long long at;
+		char hex[512];
+		if(line[0] == 'D') return true;
+		if(line[0] == 'F'){
+			Frame f;
+			unsigned long tick;
+			unsigned program;
+			if(sscanf(line, "F %llu %lu %u %511s", &at, &tick, &program, hex) != 4) continue;
+			f.t = n->trueTime(at);
+			f.tick = tick;
+			f.program = program;
+			f.brightness = hex;
+			n->frames.push_back(f);
+		}else if(line[0] == 'B' && sscanf(line, "B %llu %511s", &at, hex) == 2){
+			n->frameCount++;
+			if(sent){
+				Broadcast b;
+				b.t = n->trueTime(at);
+				b.hex = hex;
+				sent->push_back(b);
+			}
+		}
+	}
+	fprintf(stderr, "a board stopped\n");
+	return false;
+}
+
+struct Result{
+	unsigned long compared;
+	unsigned long sameFrames;
+	unsigned long samePrograms;
+	unsigned long sameTicks;//ticks of the master's with a follower tick of the same count
+	double sumOffset;
+	double maxOffset;
+};
+
+static Result compare(const Node& master, const Node& f, double settle){
+	Result r;
+	memset(&r, 0, sizeof(r));
+	size_t near = 0, same = 0;
+	for(size_t i = 0; i < master.frames.size(); i++){
+		const Frame& m = master.frames[i];
+		if(m.t < settle) continue;
+		//the follower's frame nearest in time
+		while(near + 1 < f.frames.size() && fabs(f.frames[near + 1].t - m.t) <= fabs(f.frames[near].t - m.t)) near++;
+		if(near >= f.frames.size()) break;
+		r.compared++;
+		if(f.frames[near].brightness == m.brightness) r.sameFrames++;
+		if(f.frames[near].program == m.program) r.samePrograms++;
+		//the follower's tick of the same count, if any. Counts only go backwards when a follower takes up the master's count
+		while(same + 1 < f.frames.size() && f.frames[same].tick < m.tick) same++;
+		if(same < f.frames.size() && f.frames[same].tick == m.tick){
+			double off = fabs(f.frames[same].t - m.t);
+			r.sameTicks++;
+			r.sumOffset += off;
+			if(off > r.maxOffset) r.maxOffset = off;
+		}
+	}
+	return r;
+}
+
+static void usage(){
+	fprintf(stderr, "usage: sync-sim [--seconds N] [--settle N] [--ppm P,...] [--no-sync] [--host PATH] [-- xmas-host options...]\n");
+	exit(2);
+}
+
+int main(int argc, char** argv){
+	double seconds = 120;
+	double settle = 20;
+	bool sync = true;
+	const char* host = "build/sync/xmas-host";
+	std::vector<double> ppms;
+	std::vector<const char*> extra;
+	for(int i = 1; i < argc; i++){
+		const char* a = argv[i];
+		bool hasVal = (i + 1 < argc);
+		if(!strcmp(a, "--seconds") && hasVal){
+			seconds = atof(argv[++i]);
+		}else if(!strcmp(a, "--settle") && hasVal){
+			settle = atof(argv[++i]);
+		}else if(!strcmp(a, "--ppm") && hasVal){
+			for(char* p = argv[++i]; *p; ){
+				char* end;
+				ppms.push_back(strtod(p, &end));
+				if(end == p) usage();
+				p = (*end == ',') ? end + 1 : end;
+			}
+		}else if(!strcmp(a, "--no-sync")){
+			sync = false;
+		}else if(!strcmp(a, "--host") && hasVal){
+			host = argv[++i];
+		}else if(!strcmp(a, "--")){
+			extra.assign(argv + i + 1, argv + argc);
+			break;
+		}else{
+			usage();
+		}
+	}
+	if(ppms.empty()){
+		double def[] = {3000, -2000, 5000};
+		ppms.assign(def, def + 3);
+	}
+	if(settle >= seconds) usage();
+
+	std::vector<Node> nodes(1 + ppms.size());
+	for(size_t i = 0; i < nodes.size(); i++){
+		nodes[i].ppm = i ? ppms[i - 1] : 0;
+		nodes[i].start = i * (double)START_STAGGER_US;
+		nodes[i].frameCount = 0;
+		if(!spawn(&nodes[i], host, i > 0, extra)){
+			fprintf(stderr, "cannot start %s\n", host);
+			return 1;
+		}
+	}
+
+	bool ok = true;
+	for(double t = SLICE_US; ok && t <= seconds * 1e6; t += SLICE_US){
+		std::vector<Broadcast> sent;
+		ok = run(&nodes[0], t, &sent);
+		for(size_t i = 1; ok && i < nodes.size(); i++){
+			Node& n = nodes[i];
+			if(t <= n.start) continue;//not powered up yet
+			for(size_t b = 0; sync && b < sent.size(); b++){
+				if(sent[b].t <= n.start) continue;
+				fprintf(n.in, "B %llu %s\n", n.local(sent[b].t), sent[b].hex.c_str());
+				n.frameCount++;
+			}
+			ok = run(&n, t, 0);
+		}
+	}
+	for(size_t i = 0; i < nodes.size(); i++){
+		fclose(nodes[i].in);
+		fclose(nodes[i].out);
+		waitpid(nodes[i].pid, 0, 0);
+	}
+	if(!ok) return 1;
+
+	printf("%s, %.0f s, compared after %.0f s. Master: %lu ticks, %lu sync frames sent\n", sync ? "synchronised" : "not synchronised",
+		seconds, settle, (unsigned long)nodes[0].frames.size(), nodes[0].frameCount);
+	printf("%-9s %7s %8s %9s %9s %9s %11s %11s\n", "follower", "ppm", "start s", "frames", "programs", "ticks", "offset mean",
+		"offset max");
+	int status = 0;
+	for(size_t i = 1; i < nodes.size(); i++){
+		Result r = compare(nodes[0], nodes[i], settle * 1e6);
+		double frames = r.compared ? 100.0 * r.sameFrames / r.compared : 0;
+		printf("%-9u %+7.0f %8.2f %8.2f%% %8.2f%% %8.2f%% %9.2fms %9.2fms\n", (unsigned)i, nodes[i].ppm, nodes[i].start / 1e6, frames,
+			r.compared ? 100.0 * r.samePrograms / r.compared : 0, r.compared ? 100.0 * r.sameTicks / r.compared : 0,
+			r.sameTicks ? r.sumOffset / r.sameTicks / 1000 : 0, r.maxOffset / 1000);
+		if(sync && (frames < 99 || r.sameTicks < r.compared || r.maxOffset > 2500)) status = 1;
+	}
+	if(status) printf("FAIL: a follower is not in step with the master\n");
+	return status;
+}
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Decoder for the binary telemetry stream (../Telemetry.h), as captured from the UART or written by xmas-host --telemetry.
+ * Prints one line per record, prefixed with the count of the last tick seen, and then a summary. A record with a bad checksum
+ * (e.g. from a capture started mid-record) is skipped by searching for the next sync byte.
+ *
+ * Usage: tel-decode [--summary] [FILE]
+ *	--summary  only print the summary
+ *	FILE       the captured stream; stdin if omitted or "-"
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "Telemetry.h"
+
+static const char* typeName(uint8_t type){
+	switch(type){
+		case TEL_START: return "START";
+		case TEL_DROPPED: return "DROPPED";
+		case TEL_TEXT: return "TEXT";
+		case TEL_PROG_LOAD: return "PROG";
+		case TEL_PROG_LED: return "LED";
+		case TEL_IR: return "IR";
+		case TEL_SOURCES: return "SRC";
+		case TEL_TICK: return "TICK";
+		case TEL_SNAPSHOT: return "SNAP";
+		case TEL_SCHED: return "SCHED";
+		case TEL_VALUE: return "VALUE";
+		case TEL_UPLOAD: return "UPLOAD";
+		case TEL_MEMORY: return "MEMORY";
+	}
+	return 0;
+}
+
+static uint16_t get16(const uint8_t* p){
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* p){
+	return get16(p) | ((uint32_t)get16(p + 2) << 16);
+}
+
+struct Stats{
+	unsigned long records[256];
+	unsigned long badChecksums;
+	unsigned long skippedBytes;
+	unsigned dropped;
+	unsigned long ticks;
+	unsigned long lostTicks;//gaps in the tick count, e.g. from dropped records
+	uint64_t sumDuration;
+	unsigned maxDuration;
+	unsigned maxLateness;
+	unsigned long skippedTicks;//ticks that reported skipped parameters (version 2)
+	uint64_t sumSkipped;
+};
+
+int main(int argc, char** argv){
+	bool summaryOnly = false;
+	const char* path = 0;
+	for(int i = 1; i < argc; i++){
+		if(!strcmp(argv[i], "--summary")) summaryOnly = true;
+		else if(!path && (argv[i][0] != '-' || !strcmp(argv[i], "-"))) path = argv[i];
+		else{
+			fprintf(stderr, "usage: tel-decode [--summary] [FILE]\n");
+			return 2;
+		}
+	}
+	FILE* f = stdin;
+	if(path && strcmp(path, "-")){
+		f = fopen(path, "rb");
+		if(!f){
+			fprintf(stderr, "cannot open %s\n", path);
+			return 1;
+		}
+	}
+
+	Stats st;
+	memset(&st, 0, sizeof(st));
+	const char* unit = "us";
+	long tick = -1;
+	bool haveTick = false;
+	uint16_t lastTick = 0;
+	std::vector<uint8_t> data;
+	int c;
+	while((c = fgetc(f)) != EOF) data.push_back(c);
+	if(f != stdin) fclose(f);
+
+	size_t pos = 0;
+	while(pos < data.size()){
+		if(data[pos] != TEL_SYNC){
+			st.skippedBytes++;
+			pos++;
+			continue;
+		}
+		//sync, type, len, payload, checksum
+		if(pos + 3 > data.size() || pos + 4 + data[pos + 2] > data.size()){
+			st.skippedBytes += data.size() - pos;//a record cut off at the end of the capture
+			break;
+		}
+		const uint8_t* rec = &data[pos];
+		uint8_t sum = 0;
+		for(int i = 1; i < 4 + rec[2]; i++) sum += rec[i];
+		if(sum != 0){
+			//not a record after all; look for the next sync byte
+			st.badChecksums++;
+			st.skippedBytes++;
+			pos++;
+			continue;
+		}
+		pos += 4 + rec[2];
+		uint8_t type = rec[1];
+		uint8_t len = rec[2];
+		const uint8_t* p = rec + 3;
+		st.records[type]++;
+
+		if(type == TEL_TICK && len >= 6){
+			uint16_t t = get16(p);
+			if(haveTick && (uint16_t)(t - lastTick) > 1) st.lostTicks += (uint16_t)(t - lastTick) - 1;
+			haveTick = true;
+			lastTick = t;
+			tick = t;
+			st.ticks++;
+			st.sumDuration += get16(p + 2);
+			if(get16(p + 2) > st.maxDuration) st.maxDuration = get16(p + 2);
+			if(get16(p + 4) > st.maxLateness) st.maxLateness = get16(p + 4);
+			if(len >= 8){
+				st.skippedTicks++;
+				st.sumSkipped += get16(p + 6);
+			}
+		}else if(type == TEL_START && len >= 5){
+			unit = p[4] ? "ns" : "us";
+			haveTick = false;
+			tick = -1;
+		}else if(type == TEL_DROPPED && len >= 2){
+			st.dropped = get16(p);
+		}
+		if(summaryOnly) continue;
+
+		if(tick >= 0) printf("%6ld ", tick);
+		else printf("%6s ", "-");
+		const char* name = typeName(type);
+		if(name) printf("%-6s", name);
+		else printf("?%02X   ", type);
+		switch(type){
+			case TEL_START:
+				if(len < 5) break;
+				printf(" version %u, %u LEDs, tick %u us, durations in %s", p[0], p[1], get16(p + 2), unit);
+				break;
+			case TEL_DROPPED:
+				if(len < 2) break;
+				printf(" %u records dropped since start", get16(p));
+				break;
+			case TEL_TEXT:
+				printf(" %.*s", len, (const char*)p);
+				break;
+			case TEL_PROG_LOAD:
+				if(len < 3) break;
+				printf(" %u (%s)%s", p[0], p[1] ? "compact" : "legacy", p[2] ? " decode error" : "");
+				break;
+			case TEL_PROG_LED:
+				if(len < 9) break;
+				//as the DEBUG listing: pattern bytes, then patch
+				printf(" %u: %02X%02X %02X%02X  %02X%02X %02X%02X", p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], p[8]);
+				break;
+			case TEL_IR:
+				if(len < 4) break;
+				printf(" %06X", (unsigned)get32(p));
+				break;
+			case TEL_SOURCES:
+				if(len < 1) break;
+				printf(" [%u]", p[0]);
+				for(int i = 1; i + 1 < len; i += 2) printf(" %u", get16(p + i));
+				break;
+			case TEL_TICK:
+				if(len < 6) break;
+				printf(" %u %s, %u us late", get16(p + 2), unit, get16(p + 4));
+				if(len >= 8) printf(", %u skipped", get16(p + 6));
+				break;
+			case TEL_SNAPSHOT:
+				if(len < 3) break;
+				printf(" tick %u:", get16(p));
+				for(int i = 3, led = p[2]; i + 6 <= len; i += 6, led++){
+					printf(" %d=%04X:%04X:%04X", led, get16(p + i), get16(p + i + 2), get16(p + i + 4));
+				}
+				break;
+			case TEL_SCHED:
+				if(len < 14) break;
+				printf(" %u ticks, %u missed, %u overruns | jitter %u %u %u us", (unsigned)get32(p), get16(p + 4), get16(p + 6),
+					get16(p + 8), get16(p + 10), get16(p + 12));
+				break;
+			case TEL_VALUE:
+				if(len < 3) break;
+				printf(" src %u = %u", p[0], get16(p + 1));
+				break;
+			case TEL_UPLOAD:
+				if(len < 4) break;
+				printf(" command %02X status %u address %u", p[0], p[1], get16(p + 2));
+				break;
+			case TEL_MEMORY:
+				if(len < 8) break;
+				//all 0 from a build with no AVR memory map, e.g. xmas-host
+				if(!get16(p) && !get16(p + 2) && !get16(p + 4) && !get16(p + 6)) printf(" not measured");
+				else printf(" static %u, heap %u, free %u, least free %u bytes", get16(p), get16(p + 2), get16(p + 4), get16(p + 6));
+				break;
+			default:
+				printf(" %u bytes", len);
+		}
+		printf("\n");
+	}
+
+	printf("records     ");
+	unsigned long total = 0;
+	for(int t = 0; t < 256; t++){
+		if(!st.records[t]) continue;
+		total += st.records[t];
+		const char* name = typeName(t);
+		if(name) printf(" %s %lu", name, st.records[t]);
+		else printf(" ?%02X %lu", t, st.records[t]);
+	}
+	printf(" (%lu total)\n", total);
+	printf("stream       %lu bad checksums, %lu bytes skipped, %u records dropped at source\n", st.badChecksums, st.skippedBytes,
+		st.dropped);
+	if(st.ticks){
+		printf("ticks        %lu seen, %lu missing, work mean %.0f %s, max %u %s, max lateness %u us\n", st.ticks, st.lostTicks,
+			(double)st.sumDuration / st.ticks, unit, st.maxDuration, unit, st.maxLateness);
+	}
+	if(st.skippedTicks){
+		printf("patches      mean %.1f LED parameters skipped per tick (source unchanged)\n", (double)st.sumSkipped / st.skippedTicks);
+	}
+	return 0;
+}
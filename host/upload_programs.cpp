@@ -0,0 +1,456 @@
+/*
+ * Copyright 2012 Adam Cooper
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/* Uploader for ProgramUpload (../ProgramUpload.h): writes an EEPROM image, as in "EEPROM Programs/" or from encode-programs,
+ * into a running board over its UART, then commits it so that the board takes up the new programs without a reset.
+ *
+ * The image's header and programs are written (its extent is worked out from the header), from address 3 on, in UPL_CHUNK
+ * blocks that do not cross a PSTORE_PAGE_BYTES boundary. Each command waits for its reply and is sent again, up to RETRIES
+ * times, if none comes or the write failed. The commit then writes the program count and cycling rate source, and the upload
+ * has worked once the board reports loading the program without a decode error. Exits 1 otherwise.
+ * The board's TEL_TICK records are counted meanwhile: ticks missing from the sequence, and the largest lateness, show whether
+ * the animation kept going during the upload.
+ *
+ * With --stall N the uploader stops after N chunks, as one that has gone away, and waits out the session timeout: the board
+ * must then hold no programs (the count is cleared by the first write) and load none, rather than play a mix of old and new.
+ *
+ * Usage: upload-programs [--load N] [--stall N] (--port DEV | --sim [--host PATH] [-- xmas-host options...]) IMAGE.hex
+ *	--load N      the program to load on commit, default the one playing (or 1 if there are fewer programs)
+ *	--stall N     stop after N chunks, and check that the board gives up the programs
+ *	--port DEV    a board on a serial port, e.g. /dev/ttyUSB0, at TEL_BAUD
+ *	--sim         a simulated board: xmas-host --node (see host_main.cpp), run in lockstep in 1ms steps
+ *	--host PATH   the xmas-host for --sim, default build/xmas-host
+ *	after --       options for the simulated board, e.g. --eeprom FILE for what it plays before the upload
+ */
+
+#include "Arduino.h"
+#include "HostSim.h"
+#include "ProgramDecoder.h"
+#include "ProgramUpload.h"
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+
+void setup(){}
+void loop(){}
+
+#define RETRIES 10
+#define REPLY_MS 300 //longest wait for a reply; a 16 byte chunk of the internal EEPROM takes 54ms to write
+#define LOAD_MS 2000 //longest wait, after the commit, for the program to be loaded
+#define STEP_US 1000 //--sim: the simulated board is run this long at a time
+
+static uint8_t image[HOST_I2C_EEPROM_SIZE];
+
+//the bytes of an image that matter: the header, then the programs, or 0 if the header makes no sense
+static unsigned long imageExtent(){
+	uint8_t numLeds = image[0];
+	uint8_t count = image[1];
+	unsigned long end;
+	if(image[3] == PROG_FORMAT_LEGACY){
+		end = 8 + (unsigned long)count * (8 + 8 * numLeds);
+	}else if(image[3] == PROG_FORMAT_COMPACT){
+		end = 8 + 4 * (unsigned long)image[4];
+		for(uint8_t p = 0; p < count && end + 2 <= sizeof(image); p++){
+			end += 2 + ((image[end] << 8) | image[end + 1]);
+		}
+	}else{
+		return 0;
+	}
+	return (end <= sizeof(image)) ? end : 0;
+}
+
+//a connection to the board: commands out, telemetry in
+class Link{
+	public:
+		virtual ~Link(){}
+		virtual bool send(const std::vector<uint8_t>& data) = 0;
+		//waits up to about ms for telemetry, appending it to in. Returns false if the board has gone away
+		virtual bool receive(std::vector<uint8_t>* in, unsigned ms) = 0;
+		//the board's clock (--sim) or the wall clock, us
+		virtual uint64_t now() = 0;
+};
+
+class PortLink : public Link{
+	public:
+		PortLink(){
+			fd = -1;
+		}
+		~PortLink(){
+			if(fd >= 0) close(fd);
+		}
+		bool open(const char* path){
+			fd = ::open(path, O_RDWR | O_NOCTTY);
+			if(fd < 0) return false;
+			struct termios t;
+			if(tcgetattr(fd, &t)) return false;
+			cfmakeraw(&t);
+			cfsetispeed(&t, B500000);
+			cfsetospeed(&t, B500000);
+			t.c_cc[VMIN] = 0;
+			t.c_cc[VTIME] = 1;
+			return tcsetattr(fd, TCSANOW, &t) == 0;
+		}
+		bool send(const std::vector<uint8_t>& data){
+			return write(fd, &data[0], data.size()) == (ssize_t)data.size();
+		}
+		bool receive(std::vector<uint8_t>* in, unsigned ms){
+			uint64_t end = now() + ms * 1000ULL;
+			do{
+				uint8_t buf[256];
+				ssize_t n = read(fd, buf, sizeof(buf));
+				if(n < 0) return false;
+				in->insert(in->end(), buf, buf + n);
+				if(n > 0) return true;
+			}while(now() < end);
+			return true;
+		}
+		uint64_t now(){
+			return HostSim::wallNanos() / 1000;
+		}
+	private:
+		int fd;
+};
+
+class SimLink : public Link{
+	public:
+		SimLink(){
+			pid = -1;
+			in = 0;
+			out = 0;
+			t = 0;
+		}
+		~SimLink(){
+			if(in) fclose(in);
+			if(out) fclose(out);
+			if(pid > 0) waitpid(pid, 0, 0);
+		}
+		bool start(const char* host, const std::vector<const char*>& extra){
+			int toChild[2], fromChild[2];
+			if(pipe(toChild) || pipe(fromChild)) return false;
+			pid = fork();
+			if(pid < 0) return false;
+			if(pid == 0){
+				dup2(toChild[0], 0);
+				dup2(fromChild[1], 1);
+				close(toChild[0]); close(toChild[1]); close(fromChild[0]); close(fromChild[1]);
+				std::vector<const char*> args;
+				args.push_back(host);
+				args.push_back("--quiet");
+				args.push_back("--node");
+				args.insert(args.end(), extra.begin(), extra.end());
+				args.push_back(0);
+				execv(host, (char* const*)&args[0]);
+				fprintf(stderr, "cannot run %s\n", host);
+				_exit(1);
+			}
+			close(toChild[0]);
+			close(fromChild[1]);
+			in = fdopen(toChild[1], "w");
+			out = fdopen(fromChild[0], "r");
+			return in && out;
+		}
+		bool send(const std::vector<uint8_t>& data){
+			fprintf(in, "S ");
+			for(size_t i = 0; i < data.size(); i++) fprintf(in, "%02X", data[i]);
+			fprintf(in, "\n");
+			return true;
+		}
+		bool receive(std::vector<uint8_t>* rx, unsigned ms){
+			//one step at a time, returning as soon as there is telemetry, as a port would
+			for(unsigned long steps = (ms * 1000UL + STEP_US - 1) / STEP_US; steps > 0; steps--){
+				t += STEP_US;
+				fprintf(in, "R %llu\n", (unsigned long long)t);
+				fflush(in);
+				size_t before = rx->size();
+				char line[4096];
+				for(;;){
+					if(!fgets(line, sizeof(line), out)) return false;
+					if(line[0] == 'D') break;
+					if(line[0] != 'T' || line[1] != ' ') continue;
+					unsigned b;
+					int n;
+					for(const char* p = line + 2; sscanf(p, "%2x%n", &b, &n) == 1; p += n) rx->push_back(b);
+				}
+				if(rx->size() > before) return true;
+			}
+			return true;
+		}
+		uint64_t now(){
+			return t;
+		}
+	private:
+		pid_t pid;
+		FILE* in;
+		FILE* out;
+		uint64_t t;
+};
+
+//the board's telemetry, as far as the uploader cares
+struct Board{
+	std::vector<uint8_t> rx;
+	//TEL_TICK
+	unsigned long ticks;
+	unsigned long missed;//gaps in the tick count
+	bool haveTick;
+	uint16_t lastTick;
+	unsigned maxLateness;
+	//the last TEL_UPLOAD and TEL_PROG_LOAD records
+	bool haveReply;
+	std::vector<uint8_t> reply;
+	bool haveLoad;
+	uint8_t loadProgram;
+	bool loadError;
+};
+
+//takes the whole records out of b->rx
+static void parse(Board* b){
+	size_t pos = 0;
+	std::vector<uint8_t>& d = b->rx;
+	while(pos < d.size()){
+		if(d[pos] != TEL_SYNC){
+			pos++;
+			continue;
+		}
+		if(pos + 3 > d.size() || pos + 4 + d[pos + 2] > d.size()) break;//the rest has not arrived yet
+		uint8_t sum = 0;
+		for(int i = 1; i < 4 + d[pos + 2]; i++) sum += d[pos + i];
+		if(sum != 0){
+			pos++;
+			continue;
+		}
+		uint8_t type = d[pos + 1];
+		uint8_t len = d[pos + 2];
+		const uint8_t* p = &d[pos + 3];
+		if(type == TEL_TICK && len >= 6){
+			uint16_t t = p[0] | (p[1] << 8);
+			if(b->haveTick && (uint16_t)(t - b->lastTick) > 1) b->missed += (uint16_t)(t - b->lastTick) - 1;
+			b->haveTick = true;
+			b->lastTick = t;
+			b->ticks++;
+			unsigned late = p[4] | (p[5] << 8);
+			if(late > b->maxLateness) b->maxLateness = late;
+		}else if(type == TEL_UPLOAD && len >= 4){
+			b->haveReply = true;
+			b->reply.assign(p, p + len);
+		}else if(type == TEL_PROG_LOAD && len >= 3){
+			b->haveLoad = true;
+			b->loadProgram = p[0];
+			b->loadError = p[2] != 0;
+		}else if(type == TEL_START){
+			b->haveTick = false;
+		}
+		pos += 4 + len;
+	}
+	d.erase(d.begin(), d.begin() + pos);
+}
+
+static std::vector<uint8_t> frame(uint8_t type, const uint8_t* payload, uint8_t len){
+	std::vector<uint8_t> f;
+	f.push_back(TEL_SYNC);
+	f.push_back(type);
+	f.push_back(len);
+	uint8_t sum = type + len;
+	for(uint8_t i = 0; i < len; i++){
+		f.push_back(payload[i]);
+		sum += payload[i];
+	}
+	f.push_back(-sum);
+	return f;
+}
+
+static unsigned long retries = 0;
+
+//sends a command until it is answered, for the address given. Returns the reply's status, or -1 if there was none
+static int command(Link* link, Board* b, uint8_t type, const uint8_t* payload, uint8_t len, word address){
+	for(int attempt = 0; attempt <= RETRIES; attempt++){
+		if(attempt) retries++;
+		b->haveReply = false;
+		if(!link->send(frame(type, payload, len))) return -1;
+		uint64_t end = link->now() + REPLY_MS * 1000ULL;
+		int status = -1;
+		while(link->now() < end){
+			if(!link->receive(&b->rx, 10)) return -1;
+			parse(b);
+			if(b->haveReply && b->reply[0] == type && (b->reply[2] | (b->reply[3] << 8)) == address){
+				status = b->reply[1];
+				break;
+			}
+		}
+		if(status == UPL_OK || status == UPL_BAD_COMMAND || status == UPL_BAD_ADDRESS) return status;
+		//no reply, or the write failed: try again
+	}
+	return -1;
+}
+
+static void usage(){
+	fprintf(stderr, "usage: upload-programs [--load N] [--stall N] (--port DEV | --sim [--host PATH] [-- xmas-host options...]) IMAGE.hex\n");
+	exit(2);
+}
+
+int main(int argc, char** argv){
+	int load = 0;
+	long stall = -1;
+	const char* port = 0;
+	bool sim = false;
+	const char* host = "build/xmas-host";
+	const char* path = 0;
+	std::vector<const char*> extra;
+	for(int i = 1; i < argc; i++){
+		const char* a = argv[i];
+		bool hasVal = (i + 1 < argc);
+		if(!strcmp(a, "--load") && hasVal){
+			load = atoi(argv[++i]);
+			if(load < 1 || load > 255) usage();
+		}else if(!strcmp(a, "--stall") && hasVal){
+			stall = atol(argv[++i]);
+			if(stall < 1) usage();
+		}else if(!strcmp(a, "--port") && hasVal){
+			port = argv[++i];
+		}else if(!strcmp(a, "--sim")){
+			sim = true;
+		}else if(!strcmp(a, "--host") && hasVal){
+			host = argv[++i];
+		}else if(!strcmp(a, "--")){
+			extra.assign(argv + i + 1, argv + argc);
+			break;
+		}else if(!path && a[0] != '-'){
+			path = a;
+		}else{
+			usage();
+		}
+	}
+	if(!path || (sim == (port != 0))) usage();
+
+	memset(image, 0xFF, sizeof(image));
+	if(!HostSim::loadIntelHex(path, image, sizeof(image))) return 1;
+	unsigned long extent = imageExtent();
+	if(extent == 0){
+		fprintf(stderr, "%s: not a program image\n", path);
+		return 1;
+	}
+
+	PortLink portLink;
+	SimLink simLink;
+	Link* link;
+	if(sim){
+		if(!simLink.start(host, extra)){
+			fprintf(stderr, "cannot start %s\n", host);
+			return 1;
+		}
+		link = &simLink;
+	}else{
+		if(!portLink.open(port)){
+			fprintf(stderr, "cannot open %s\n", port);
+			return 1;
+		}
+		link = &portLink;
+	}
+	Board b;
+	b.ticks = 0;
+	b.missed = 0;
+	b.haveTick = false;
+	b.lastTick = 0;
+	b.maxLateness = 0;
+	b.haveReply = false;
+	b.haveLoad = false;
+	b.loadProgram = 0;
+	b.loadError = false;
+
+	if(command(link, &b, UPL_HELLO, 0, 0, 0) != UPL_OK || b.reply.size() < 13){
+		fprintf(stderr, "no answer from the board (a build with TELEMETRY?)\n");
+		return 1;
+	}
+	const uint8_t* hello = &b.reply[4];
+	unsigned long capacity = (hello[2] | (hello[3] << 8)) * 16UL;
+	printf("board        %u LEDs, %s EEPROM of %lu bytes holding %u programs (format %u)\n", hello[0], hello[1] ? "I2C" : "internal",
+		capacity, hello[5], hello[7]);
+	if(image[0] != hello[0]){
+		fprintf(stderr, "%s is for %u LEDs, the board has %u\n", path, image[0], hello[0]);
+		return 1;
+	}
+	if(extent > capacity){
+		fprintf(stderr, "%s needs %lu bytes, the board has %lu\n", path, extent, capacity);
+		return 1;
+	}
+
+	uint64_t start = link->now();
+	unsigned long ticks0 = b.ticks, missed0 = b.missed;
+	b.maxLateness = 0;
+	unsigned long chunks = 0;
+	b.haveLoad = false;
+	for(unsigned long a = UPL_FIRST_ADDRESS; a < extent; ){
+		if(chunks == (unsigned long)stall) break;
+		uint8_t n = UPL_CHUNK - (a % UPL_CHUNK);
+		if(a + n > extent) n = extent - a;
+		uint8_t payload[2 + UPL_CHUNK];
+		payload[0] = a & 0xFF;
+		payload[1] = a >> 8;
+		memcpy(payload + 2, image + a, n);
+		int status = command(link, &b, UPL_WRITE, payload, 2 + n, a);
+		if(status != UPL_OK){
+			fprintf(stderr, "write of %u bytes at %lu failed (status %d)\n", n, a, status);
+			return 1;
+		}
+		chunks++;
+		a += n;
+	}
+	if(stall >= 0){
+		//wait out the session, then ask what the board holds
+		uint64_t end = link->now() + (UPL_TIMEOUT_MS + 1000) * 1000ULL;
+		while(link->now() < end){
+			if(!link->receive(&b.rx, 10)) break;
+			parse(&b);
+		}
+		if(command(link, &b, UPL_HELLO, 0, 0, 0) != UPL_OK || b.reply.size() < 13){
+			fprintf(stderr, "no answer from the board after the stall\n");
+			return 1;
+		}
+		printf("stalled      after %lu chunks; %u programs and %s loaded %.1f s later, %lu ticks missing\n", chunks, b.reply[9],
+			b.haveLoad ? "a program" : "none", (link->now() - start) / 1e6, b.missed - missed0);
+		if(b.reply[9] != 0 || b.haveLoad){
+			printf("FAIL: the board kept programs from a part written EEPROM\n");
+			return 1;
+		}
+		return 0;
+	}
+	uint8_t commit[3] = {image[1], image[2], (uint8_t)load};
+	b.haveLoad = false;
+	if(command(link, &b, UPL_COMMIT, commit, 3, 0) != UPL_OK){
+		fprintf(stderr, "commit failed\n");
+		return 1;
+	}
+	uint64_t end = link->now() + LOAD_MS * 1000ULL;
+	while(!b.haveLoad && link->now() < end){
+		if(!link->receive(&b.rx, 10)) break;
+		parse(&b);
+	}
+	double secs = (link->now() - start) / 1e6;
+	printf("uploaded     %lu bytes in %lu chunks, %lu retries, %.2f s %s (%.0f bytes/s)\n", extent - UPL_FIRST_ADDRESS, chunks,
+		retries, secs, sim ? "simulated" : "", secs > 0 ? (extent - UPL_FIRST_ADDRESS) / secs : 0.0);
+	printf("ticks        %lu during the upload, %lu missing, max lateness %u us\n", b.ticks - ticks0, b.missed - missed0,
+		b.maxLateness);
+	if(!b.haveLoad || b.loadError){
+		printf("FAIL: %s\n", b.haveLoad ? "the program loaded with a decode error" : "no program was loaded after the commit");
+		return 1;
+	}
+	printf("loaded       program %u of %u\n", b.loadProgram, image[1]);
+	if(load && b.loadProgram != load){
+		printf("FAIL: program %u was loaded, not %d\n", b.loadProgram, load);
+		return 1;
+	}
+	return 0;
+}
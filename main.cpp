@@ -46,6 +46,7 @@
 #pragma GCC diagnostic ignored "-Wuninitialized"
 
 #include <Arduino.h>
+#include "XmasConfig.h"
 extern "C"{
 	#include <pins_arduino.h>
 }
@@ -56,7 +57,10 @@ extern "C"{
 */
 
 // Standard Arduino source files for serial:
+// (not with TELEMETRY, which has its own UART interrupt; see Telemetry.cpp)
+#ifndef TELEMETRY
 #include <HardwareSerial.cpp>
+#endif
 
 // Other source files, depends on your program which you need
 #include <Print.cpp>
@@ -87,7 +91,9 @@ int main(void)
 	
 	for (;;) {
 		loop();
+#ifndef TELEMETRY
 		if (serialEventRun) serialEventRun();
+#endif
 	}
 	return 0;
 }
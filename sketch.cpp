@@ -26,21 +26,68 @@
 #include <Wire.cpp>
 #include <twi.c>
 
+//after the libraries, so that DEBUG and PROFILE do not switch on their own debug code (IRremote has a DEBUG of its own)
+#include "XmasConfig.h"
+
 #include "ShapedBrightnessController.cpp"
+#include "ActivityLED.cpp"
+#include "TickScheduler.cpp"
+#include "AdcScanner.cpp"
+#include "AudioEnvelope.cpp"
+#include "LedBits.h"
+#include "PatchTable.h"
+#include "TgmSequencer.h"
+#include "ModMatrix.cpp"
+#include "OscBank.cpp"
+#include "ProgramStore.cpp"
+#include "StateJournal.cpp"
+#include "ProgramDecoder.cpp"
+#include "IrQueue.cpp"
+#include "MemoryMonitor.cpp"
+#ifdef TELEMETRY
+#include "Telemetry.cpp"
+#include "ProgramUpload.cpp"
+#endif
+#ifdef SYNC_I2C
+#include "SyncLink.cpp"
+#endif
 
 // Function prototypes go here (telling the compiler these functions exist).
 void readSourceValues();
 void updateTGM();
+void loadTGM();
 void programTriple(uint8_t rgb, uint8_t shape, int phase, uint8_t rateSrc, uint8_t scaleSrc, uint8_t tgSrc);
 void programAll(uint8_t shape, uint8_t rateSrc, uint8_t scaleSrc, uint8_t tgSrc);
 		
 		void printPatch(uint8_t led);
 		void printPatternBytes(uint8_t led);
-		void loadProgram(uint8_t programNumber);
-		uint8_t decodeNumIR(unsigned long irCode);
+		void printHex2(uint8_t v);
+		boolean loadProgram(uint8_t programNumber);
+		void startStaging(uint8_t programNumber);
+		void pollStaging();
+		boolean stagingComplete();
+		void applyStagedProgram();
+		void printProgramStep();
+		void sendProgramStep();
+		void sendSnapshotStep();
+		void sendSourcesStep();
+		void takeUpload();
+		void sendMemoryStep();
+		void saveState(uint8_t* state);
+		void restoreState(const uint8_t* state);
+		unsigned long programsEnd(ProgramStore* store);
+		void pollIR();
+		void handleIR(unsigned long code);
+		uint8_t irAction(unsigned long code);
+		void syncFollow(unsigned long tickDue);
+		void syncLead(unsigned long tickDue);
 
 uint16_t getSrcVal(uint8_t src);
+void setSrcVal(uint8_t src, uint16_t value);
+boolean srcChanged(uint8_t src);
+void compilePatches();
 void stepButton(uint8_t src);
+void audioSample(uint16_t value);
 
 
 /*
@@ -49,15 +96,25 @@ void stepButton(uint8_t src);
  * 2: might have to change the #include to the .cpp rather than .h (check which one includes the other. Arduino IDE seems able to work it out!)
  */
 
-//comment out to suppress debug messages to Serial and to exclude unit tests from compilation
-//unit test mode is toggled with IR_TEST
-#define DEBUG
+//DEBUG, PROFILE and TELEMETRY are set in XmasConfig.h
+#include "TickProfiler.cpp"
 
-//number of LEDS in use. ShapedBrightnessController has a compilation #define max value = 9
+//number of LEDS in use. May be overridden from the compiler command line (e.g. -DNUM_LEDS=48).
+//NB: ShapedBrightnessController has a compilation #define max value (SBC_MAX_LEDS, = 9 in the library as shipped)
+#ifndef NUM_LEDS
 #define NUM_LEDS 3
-//number of LEDs determins EEPROM program size, which in turn determines the number of programs available
+#endif
+#ifdef SBC_OUTPUT_BCM
+//after NUM_LEDS, which sizes its plane buffer
+#include "BcmOutput.cpp"
+#if NUM_LEDS > BCM_MAX_CHANNELS
+#error BCM_MAX_CHANNELS is less than NUM_LEDS
+#endif
+#endif
+//number of LEDs determins the (decoded) program size and, for PROG_FORMAT_LEGACY EEPROM images, the number of programs available.
+//PROG_FORMAT_COMPACT images are usually much smaller (see ProgramDecoder.h)
 #define PROG_BYTES (8+NUM_LEDS*8)
-#define MAX_PROG_NUM (int)(2040/PROG_BYTES) //assumes 2k EEPROM with 8 bytes of space at the start (byte 0 stores num LEDs)
+#define MAX_PROG_NUM (int)(2040/PROG_BYTES) //legacy format; assumes 2k EEPROM with 8 bytes of space at the start (byte 0 stores num LEDs)
 
 // Input wiring details. Which pin is connected to which logical input
 #define PIN_AUDIO A0 //audio level (ADC0)
@@ -70,15 +127,32 @@ void stepButton(uint8_t src);
 #define PIN_IR 10 //IR receiver
 #define PIN_PROG 9 //switch to put into programming mode
 #define PIN_ACT 5 //"active" LED output
+#define PIN_SYNC_FOLLOW 7 //grounded to make the board a sync follower (SYNC_I2C only)
+
+//brightness update "tick" rate, 16..200Hz. May be overridden from the compiler command line (e.g. -DTICK_HZ=100).
+//Programs were written for 16Hz (TICK_BASE_HZ) and play at the same speed at any rate, in smaller steps
+#ifndef TICK_HZ
+#define TICK_HZ 16
+#endif
+#if (TICK_HZ < 16) || (TICK_HZ > 200)
+#error TICK_HZ must be 16..200
+#endif
+#define TICK_BASE_HZ 16
+#define TICK_PERIOD_US (1000000UL / TICK_HZ) //62500us at 16Hz
+//The oscillators (program cycling, LFO, trigger/gate mask and the general ones; see OscBank.h) advance by OSC_STEP per unit of
+//rate each tick: 1/2048 cycle at 16Hz, scaled by TICK_BASE_HZ/TICK_HZ to keep the speed (exact at 16Hz, to under 1ppm otherwise).
+//(Ticks come on Timer0's 1024us beat, so at high rates they are up to 1ms early or late, though never drift)
+//the controller's rate is also per tick: it is scaled by TICK_BASE_HZ/TICK_HZ as a 16 bit fraction, carrying the remainder
+//from tick to tick so that no speed is lost to rounding
+#define TICK_RATE_MUL ((TICK_BASE_HZ * 65536UL + TICK_HZ / 2) / TICK_HZ)
 
 // array to hold source values, e.g. ADC readings, and the indeces of each source.
 //Most are re-populated periodically (but not necessarily on each loop) or on an event
 // Va;lues are always in the range 0-1023
-uint16_t srcVals[16+NUM_LEDS]={0,1023,512,0,0,0,0,0,0,0,512,512,512,512};
 #define SRC_OFF 0 //permanently OFF, i.e. value = 0
 #define SRC_ON 1 //always ON, i.e. value =1023
 #define SRC_HALF 2 //always value = 512
-#define SRC_AUDIO 3 //audio level (ADC0)
+#define SRC_AUDIO 3 //audio level (ADC0) - envelope follower, see AudioEnvelope.h
 #define SRC_LEV1 4 //VR1 (ADC1)
 #define SRC_LEV2 5 //VR2 or thermister (ADC2)
 #define SRC_LEV3 6 //VR3 or LDR (ADC3)
@@ -94,22 +168,47 @@ uint16_t srcVals[16+NUM_LEDS]={0,1023,512,0,0,0,0,0,0,0,512,512,512,512};
 #define SRC_RND_10S 0xF //Random number in range 0-1023, changing every 10 seconds
 #define SRC_TG_MASK_BASE 0x10 //srcVals index at which the trigger/gate mask values reside (there are NUM_LEDS of them).
 //NB TG_MASK is, in principle, available for rate and scale patches, but is NOT intended for use that way
+//"extended" sources follow the trigger/gate mask values, so their indeces depend on NUM_LEDS (as do programs in EEPROM)
+#define SRC_EXT_BASE (SRC_TG_MASK_BASE+NUM_LEDS)
+#define SRC_BEAT SRC_EXT_BASE //audio beat trigger: 1023 for ~100ms after each detected onset, otherwise 0
+#define SRC_MOD_BASE (SRC_EXT_BASE+1) //srcVals index of the first mod bus output (there are MOD_BUSES of them, see ModMatrix.h)
+#define SRC_OSC_BASE (SRC_MOD_BASE+MOD_BUSES) //srcVals index of the first general oscillator (there are OSC_COUNT, see OscBank.h)
+#define SRC_COUNT (SRC_OSC_BASE+OSC_COUNT) //size of srcVals
+#if (SRC_MOD_BASE != PROG_SRC_MOD_BASE(NUM_LEDS)) || (SRC_OSC_BASE != PROG_SRC_OSC_BASE(NUM_LEDS))
+#error SRC_MOD_BASE or SRC_OSC_BASE does not match the program decoder
+#endif
+#if SRC_COUNT > 0x80
+#error NUM_LEDS too large: source indeces must be < SRC_CONST
+#endif
 #define SRC_CONST 0x80 //effectively a bit indicator that the (lowest 7 bits <<3) is a "constant value source". #defined here mostly as documentation
+uint16_t srcVals[SRC_COUNT]={0,1023,512,0,0,0,0,0,0,0,512,512,512,512};
+//the srcVals that have changed since the last tick; set by setSrcVal(), which is how srcVals must be written
+LedBits<SRC_COUNT> srcDirty;
 
 // array to hold the patches - i.e. the mapping from the values in srcVals to parameters passed to the ShapedBrightnessController
 // each LED has 3 parameters, with the precise details of how they affect the brightness over time being determined by the pattern
 //	setting in force for the LED (which may change over time if a sequence has been programmed)
-uint8_t patches[NUM_LEDS][3];//the value in each cell is an index into srcVals
-//the second index of patches:
+//held as one array per parameter (struct-of-arrays), so that the per-LED loops walk contiguous memory
+uint8_t patches[3][NUM_LEDS];//the value in each cell is an index into srcVals
+//the first index of patches:
 #define PAR_RATE 0 // - see ShapedBrightnessController.setRate()
 #define PAR_SCALE 1 //  - see ShapedBrightnessController.setScale()
 #define PAR_TG_IP 2 //trigger or gate input - see ShapedBrightnessController.setTriggerIP()
-// multiplier for patches[][PAR_RATE], +2 means bit shift the srcVal two places to the MSB, -2 means shift 2 places towards LSB
+// multiplier for patches[PAR_RATE][], +2 means bit shift the srcVal two places to the MSB, -2 means shift 2 places towards LSB
 signed char rateFactor[NUM_LEDS];
+// patches and rateFactor resolved to srcVals indices and folded constants (6 bytes per LED), for the tick. Rebuild with compilePatches() after any change
+PatchTable<NUM_LEDS> patchTable;
+//the mod buses of the current program, compiled from the staged image when it is applied (applyStagedProgram()); the compiled
+//routes are the matrix's own copy, so staging the next program does not touch them
+ModMatrix modMatrix;
+boolean patchesChanged = true;//every LED parameter is pushed at the next tick, e.g. after compilePatches()
+uint16_t patchSkipped;//LED parameters that the last tick did not need to push, because their source had not changed
 
 //IR class and data
 IRrecv irrecv(PIN_IR);
 decode_results results;
+//codes are read from irrecv on every loop() pass and queued for the next tick (see pollIR())
+IrQueue irQueue;
 //next 4 to store received commands
 unsigned long irLast;//used to read in the last received value
 unsigned long irCommand;//used to store the active command (i.e. the command that started a sequence of key presses)
@@ -130,7 +229,7 @@ uint8_t irUnits;//ditto units
 #define IR_N9 0xFF52AD //9
 #define IR_CH_PLUS 0xFFE21D //CH+
 #define IR_CH_MINUS 0xFFA25D //CH-
-#define IR_CH 0xFF629D //CH
+#define IR_CH 0xFF629D //CH (prints the profiler and/or tick statistics when PROFILE and/or DEBUG are defined; sends the tick statistics with TELEMETRY; either way the tick statistics then start again)
 #define IR_NEXT 0xFF02FD //NEXT
 #define IR_PREV 0xFF22DD //PREV
 #define IR_PLUS  0xFFA857 //VOL+
@@ -139,47 +238,170 @@ uint8_t irUnits;//ditto units
 #define IR_PROG 0xFF906F //EQ
 #define IR_CANCEL 0xFF9867 //100+
 #define IR_OK 0xFFB04F //200+
+//what each button does (see irKeys, irAction())
+#define IR_ACT_DIGIT 0 //0..9 are the digits
+#define IR_ACT_CH_PLUS 10
+#define IR_ACT_CH_MINUS 11
+#define IR_ACT_CH 12
+#define IR_ACT_NEXT 13
+#define IR_ACT_PREV 14
+#define IR_ACT_PLUS 15
+#define IR_ACT_MINUS 16
+#define IR_ACT_PLAY 17
+#define IR_ACT_PROG 18
+#define IR_ACT_CANCEL 19
+#define IR_ACT_OK 20
+#define IR_ACT_NONE 255 //not a button of this remote
+struct IrKey{
+	uint32_t code;
+	uint8_t action;
+};
+const IrKey irKeys[] PROGMEM = {
+	{IR_N0, IR_ACT_DIGIT+0}, {IR_N1, IR_ACT_DIGIT+1}, {IR_N2, IR_ACT_DIGIT+2}, {IR_N3, IR_ACT_DIGIT+3}, {IR_N4, IR_ACT_DIGIT+4},
+	{IR_N5, IR_ACT_DIGIT+5}, {IR_N6, IR_ACT_DIGIT+6}, {IR_N7, IR_ACT_DIGIT+7}, {IR_N8, IR_ACT_DIGIT+8}, {IR_N9, IR_ACT_DIGIT+9},
+	{IR_CH_PLUS, IR_ACT_CH_PLUS}, {IR_CH_MINUS, IR_ACT_CH_MINUS}, {IR_CH, IR_ACT_CH}, {IR_NEXT, IR_ACT_NEXT}, {IR_PREV, IR_ACT_PREV},
+	{IR_PLUS, IR_ACT_PLUS}, {IR_MINUS, IR_ACT_MINUS}, {IR_PLAY, IR_ACT_PLAY}, {IR_PROG, IR_ACT_PROG}, {IR_CANCEL, IR_ACT_CANCEL},
+	{IR_OK, IR_ACT_OK}
+};
+#define IR_KEY_COUNT (sizeof(irKeys)/sizeof(irKeys[0]))
 
 //Reading/writing programs from EEPROM
+//a 24LCxx I2C EEPROM at this address (A0..A2 low) is used instead of the internal EEPROM if it holds programs for NUM_LEDS
+#define I2C_EEPROM_ADDR 0x50
+//and its size: 0x10000 for a 24LC512, 0x8000 for a 24LC256, 0x4000 for a 24LC128. Uploads are kept within it, since a smaller part
+//wraps addresses round onto the header
+#ifndef I2C_EEPROM_BYTES
+#define I2C_EEPROM_BYTES 0x10000UL
+#endif
+ProgramStore progStore;
 uint8_t programCount;//number of programs in EEPROM
 uint8_t currentProgram;//the index of the currently-loaded program.
+uint8_t progFormat;//EEPROM address 0x03, PROG_FORMAT_*
+uint8_t progDictCount;//EEPROM address 0x04 (compact format only): number of 4-byte patch dictionary entries, from address 8
+
+//State that survives a power cycle: the program, whether cycling, and the IR-tuned sources (see saveState()). It is journalled in
+//the top of the internal EEPROM, whichever EEPROM holds the programs
+ProgramStore journalStore;
+StateJournal journal;
 
 //Program cycling. The program changes at intervals, indicated by pcRateSrc
 //cycling uses currentProgram, which is fixed in the range 1..programCount
-uint8_t pcRateSrc;//the contents of EEPROM address 0x02, which is a value from SRC_*
-uint16_t pcCounter=0;////gets getSrcVal(pcRateSrc) added each tick. When exceeds 2048 the mask changes by one step and counter resets to 0
+uint8_t pcRateSrc;//the contents of EEPROM address 0x02, which is a value from SRC_*. Sets the rate of oscillator OSC_PC, which
+//changes the program each time it wraps
 boolean pcActive = true;//cycling active
 
+//Program staging. The program that will be loaded next is read from EEPROM into stageImage a block per loop() pass, outside the tick,
+//so that a program change in the tick only copies from RAM (see loadProgram())
+//a decoded program (this is also the layout of a program in a legacy EEPROM image): LFO block, TGM block, then a pattern block
+//and a patch block per LED
+struct ProgramImage{
+	uint8_t lfo[4];//rate src, -, -, -
+	uint8_t tgm[4];//rate src, pattern, -, -
+	uint8_t pattern[NUM_LEDS][4];//sbc prog bytes
+	uint8_t patch[NUM_LEDS][4];//rate src, rate factor, scale src, trigger/gate src
+	uint8_t mod[MOD_BUSES][MOD_BUS_BYTES];//mod bus definitions (decoded only; not in a legacy EEPROM image)
+	uint8_t osc[OSC_COUNT][2];//general oscillators: wave, rate src (decoded only)
+	uint8_t tgmCode[1 + TGS_CODE_BYTES];//length, mask program for TGM_CODE (decoded only)
+};
+#define STAGE_BLOCK 4 //bytes read per loop() pass
+ProgramImage stageImage;
+ProgramDecoder stageDecoder;
+uint8_t stageProgram = 0;//program number in (or being read into) stageImage. 0 = none
+word stageAddr;//next EEPROM address to read
+word stageRemaining;//bytes of the program still to be read
+//An I2C read that fails (e.g. arbitration lost to a SyncLink frame on the shared bus) reads as 0xFF bytes, so a program is read
+//again from the start if the store's error count changes while it is staged
+#define STAGE_RETRIES 3 //reads of one program that loadProgram() waits for before it gives up
+uint16_t stageErrors;//progStore.getErrors() when the read began
+uint8_t stageRetries;//reads of stageProgram begun again
+#if defined(DEBUG) || defined(TELEMETRY)
+uint8_t dumpLine = 2*NUM_LEDS;//next line of the program listing to print or send (see printProgramStep(), sendProgramStep())
+#endif
+
 //object for time-varying LED controllers
 ShapedBrightnessController sbc = ShapedBrightnessController(NUM_LEDS);
+#if TICK_HZ != TICK_BASE_HZ
+uint16_t rateCarry[NUM_LEDS];//fraction of the scaled rate carried to the next tick (see TICK_RATE_MUL)
+#endif
 
 //Random changes
 unsigned long lastRandChange1;
 unsigned long lastRandChange10;
 
-//A Low Frequency Osc (LFO) - triangle form - can be used as a SRC in a patch, but also has its freq controlled by SRC value via the special LFO patch
+//The oscillators. They are all advanced together each tick (see OscBank.h)
+OscBank oscBank;
+#define OSC_LFO 0 //the LFO - triangle form - can be used as a SRC in a patch, but also has its freq controlled by SRC value via the special LFO patch
+#define OSC_PC 1 //program cycling
+#define OSC_TGM 2 //trigger/gate mask steps
+//then OSC_GENERAL.. the general oscillators, set by the program (sources SRC_OSC_BASE..)
 uint8_t lfoRateSrc;
-uint16_t lfoCounter=0;
 
 //The "trigger/gate mask" provides an on/off time-varying pattern (e.g. moving dot, bar, etc) that feeds SRC_TG_MASK_BASE+led
 //and can be used as a patch source. Its rate can be set by other SRC inputs.
-uint16_t tgMask=1;//stores the bit mask
-uint8_t runLength = NUM_LEDS;
-uint16_t tgMaskMask=(1<<NUM_LEDS)-1; //tgMask is forced to = tgMask & tgMaskMask in some cases
-uint16_t tgmCounter=0;//gets tgmRate added each tick. When exceeds 2048 the mask changes by one step and counter resets to 0
-uint16_t tgmRateSrc=1;//source for rate of change. Any valid SRC including CONST
+//The mask is moved by a mask program (see TgmSequencer.h): one of the built-in patterns, or the program's own
+TgmSequencer<NUM_LEDS> tgmSeq;
+uint8_t runLength = NUM_LEDS;//the mask is repeated along the LEDs every runLength LEDs
+uint16_t tgmRateSrc=1;//source for rate of change (of oscillator OSC_TGM, which steps the mask each time it wraps). Any valid SRC including CONST
 uint8_t tgmPattern=0;// stores the active change pattern - see the following #defines. //NB: top nibble assumed to hold modifiers, low nibble to code for basic pattern
-bool tgmAB=true;//some patterns alternate. This keeps whether A or B motion is in force.
-//mask change patterns
+//mask change patterns: the built-in mask programs, numbered as in TgmSequencer.h, or the program's own
 #define TGM_DISABLED 0 //no not use trigger gate mask (this is not strictly necessary since, TGM only has effect if relevant elements in srcVals are patched to a LED controller
 #define TGM_SINGLE 1 //single bit on
 #define TGM_GROW 2 //bits progressively turn on to MSB then turn off from MSB
 #define TGM_PASS 3 //bits progressively turn on to MSB then turn off from LSB
 #define TGM_DOUBLE 4// like SINGLE 2 bits on
+#define TGM_CODE 5 //the mask program in the program image (PROG_OP_TGM)
 #define TGM_TRIPLIFY 128 //add this to treat the change pattern as an RGB pattern and replicate across all RGB triples
+#if (TGM_CODE != PROG_TGM_CODE) || (TGM_DOUBLE >= TGS_BUILTINS)
+#error TGM_CODE or the built-in patterns do not match the program decoder and mask sequencer
+#endif
+
+//non-blocking flash sequences on the activity LED, used to acknowledge IR input without stalling the tick
+ActivityLED actLed = ActivityLED(PIN_ACT);
+
+//oversampled, filtered analog inputs, converted in the background
+AdcScanner adc;
+//audio level and beat detection, fed with every audio sample from the ADC interrupt
+AudioEnvelope audio;
+
+//fixed-rate tick, driven from a timer interrupt
+TickScheduler ticker = TickScheduler(TICK_PERIOD_US);
+
+#ifdef SBC_OUTPUT_BCM
+//LED output, one channel per LED, updated from the controller's brightness each tick
+BcmOutput bcm;
+#endif
+
+#ifdef SYNC_I2C
+//several boards kept in step (see SyncLink.h). The master sends a frame every SYNC_FRAME_TICKS ticks (4 per second) and when
+//its program changes
+SyncLink syncLink;
+#define SYNC_FRAME_TICKS (TICK_HZ/4)
+unsigned long syncTick = 0;//the current tick: counted from start on the master, and taken from its frames on a follower
+uint8_t syncProgram = 0;//the program in the master's last frame
+#endif
+
+#ifdef TELEMETRY
+//binary telemetry on the UART. Every tick sends its cost; the rest is spread over the loop() passes between ticks
+Telemetry telemetry;
+#define TEL_SOURCES_TICKS TICK_HZ //srcVals are sent every this many ticks (1s)
+#define TEL_SOURCES_CHUNK 16 //srcVals per sources record. One record is sent per loop() pass
+#define TEL_SNAPSHOT_TICKS (TICK_HZ/4) //the controller inputs of every LED are sent every this many ticks (4 per second)
+#define TEL_SNAPSHOT_LEDS 8 //LEDs per snapshot record. One record is sent per loop() pass
+uint16_t telTick = 0;//ticks since start
+uint8_t telSnapLed = NUM_LEDS;//next LED of the snapshot being sent
+uint8_t telSrcNext = SRC_COUNT;//next srcVals index to send
+#define TEL_MEMORY_TICKS (10*TICK_HZ) //SRAM use is sent every this many ticks (10s)
+boolean telMemoryDue = true;
+//programs written over the UART. While an upload is under way the EEPROM is part written, so the program in RAM plays on
+//and no program is loaded; on commit, the new header is taken up and the program loaded in the tick (see takeUpload())
+ProgramUpload upload;
+uint8_t uploadLoad = 0;//program to load in the tick once staged. 0 = none
+#endif
 
 boolean lastButton[3];
-unsigned long lastTickMillis;
+
+//SRAM use and the stack's high-water mark (see MemoryMonitor.h)
+MemoryMonitor memMonitor;
 
 void setup(){
 	//pin modes
@@ -189,24 +411,72 @@ void setup(){
 	pinMode(PIN_PROG,INPUT_PULLUP);
 	pinMode(PIN_IR, INPUT);
 	
-	pinMode(PIN_ACT, OUTPUT);
+	adc.setSampleHook(PIN_AUDIO - A0, audioSample);
+	adc.begin();
+	
+	actLed.begin();
 	
 	#ifdef DEBUG
 	Serial.begin(9600);
-	Serial.println("Start");
+	Serial.println(F("Start"));
+	#elif defined(PROFILE)
+	Serial.begin(9600);
+	#elif defined(TELEMETRY)
+	telemetry.begin(NUM_LEDS, TICK_PERIOD_US);
 	#endif
 	
 	//initialise the pwm
 	sbc.initialise();
+	#ifdef SBC_OUTPUT_BCM
+	bcm.begin(NUM_LEDS);
+	#endif
 	
 	// Start the ir receiver
 	irrecv.enableIRIn();
 	
-	//check the EEPROM for programs
+	//the oscillators that run at the rate of the program cycling, LFO and mask step counters, as the counters they replace:
+	//rate>>5, >>4 and >>2 steps of 1/2048 per tick. Cycling and the mask act once per cycle, which starts over each time
+	oscBank.begin(srcVals, SRC_COUNT, OSC_STEP(TICK_HZ));
+	oscBank.setWave(OSC_LFO, OSC_TRIANGLE);
+	oscBank.setRestart(OSC_PC, true);
+	oscBank.setRestart(OSC_TGM, true);
+	oscBank.setRate(OSC_LFO, lfoRateSrc, 4, 0);
+	oscBank.setRate(OSC_TGM, tgmRateSrc, 2, 0);
+	
+	//check the EEPROM for programs: an I2C EEPROM if fitted and it has programs for NUM_LEDS, otherwise the internal EEPROM
+	if(!(progStore.beginI2C(I2C_EEPROM_ADDR, I2C_EEPROM_BYTES) && (progStore.read(0)==NUM_LEDS))){
+		progStore.beginInternal();
+	}
+	#ifdef DEBUG
+	if(progStore.isI2C()){
+		Serial.println(F("I2C EEPROM"));
+	}
+	#elif defined(TELEMETRY)
+	if(progStore.isI2C()){
+		telemetry.text(F("I2C EEPROM"));
+	}
+	upload.begin(&telemetry, &progStore, NUM_LEDS);
+	#endif
+	#ifdef SYNC_I2C
+	pinMode(PIN_SYNC_FOLLOW, INPUT_PULLUP);
+	if(digitalRead(PIN_SYNC_FOLLOW) == LOW){
+		syncLink.beginFollower(TICK_PERIOD_US);
+	}else{
+		syncLink.beginMaster();
+	}
+	#endif
 	//first byte is number of LEDs in the programs. Must match NUM_LEDS otherwise there are 0 programs available.
-	if(EEPROM.read(0)==NUM_LEDS){
-		programCount = EEPROM.read(1);
-		pcRateSrc = EEPROM.read(2);
+	//byte 3 is the format; an image written in a newer format is left alone but not used
+	if(progStore.read(0)==NUM_LEDS){
+		progFormat = progStore.read(3);
+		if(progFormat<=PROG_FORMAT_COMPACT){
+			programCount = progStore.read(1);
+			pcRateSrc = progStore.read(2);
+			progDictCount = (progFormat==PROG_FORMAT_COMPACT)?progStore.read(4):0;
+		}else{
+			programCount = 0;
+			pcActive=false;
+		}
 	}else{
 		//correct the error, and assert 0 programs
 		EEPROM.write(0,NUM_LEDS);
@@ -214,295 +484,285 @@ void setup(){
 		programCount =0;
 		pcActive=false;
 	}
+	oscBank.setRate(OSC_PC, pcRateSrc, 5, 0);
+	currentProgram=1;
+	
+	//restore the state from before the last power down, unless programs in the internal EEPROM run into the journal
+	journalStore.beginInternal();
+	if(programsEnd(&journalStore) <= JOURNAL_BASE){
+		uint8_t state[JOURNAL_PAYLOAD];
+		saveState(state);
+		if(journal.begin(&journalStore, state)){
+			restoreState(state);
+		}
+	}else{
+		#ifdef DEBUG
+		Serial.println(F("No state journal"));
+		#elif defined(TELEMETRY)
+		telemetry.text(F("no state journal"));
+		#endif
+	}
 	
-	//Load program 1 if available, otherwise a default program
+	//Load the program (1 unless restored) if available, otherwise a default program
 	if(programCount>0){
-		currentProgram=1;
-		loadProgram(1);
+		loadProgram(currentProgram);
 	}else{
 		sbc.setPattern(0, SBC_WAVESHAPE_SAW + SBC_WSMOD_INVERT, 0);//saw wave
-		patches[0][PAR_RATE] = SRC_LEV1;//VR1 controls rate
+		patches[PAR_RATE][0] = SRC_LEV1;//VR1 controls rate
 		rateFactor[0]=0;//rate is not shifted
-		patches[0][PAR_SCALE] = SRC_ON;// half scale brightness range
-		patches[0][PAR_TG_IP] =  SRC_ON;//the waveform change is un-gated
+		patches[PAR_SCALE][0] = SRC_ON;// half scale brightness range
+		patches[PAR_TG_IP][0] =  SRC_ON;//the waveform change is un-gated
 		//LED GREEN 1
 		sbc.setPattern(1, SBC_WAVESHAPE_OFF, 0);
-		patches[1][PAR_RATE] = SRC_OFF;
+		patches[PAR_RATE][1] = SRC_OFF;
 		rateFactor[1]=0;
-		patches[1][PAR_SCALE] = SRC_OFF;
-		patches[1][PAR_TG_IP] =  SRC_OFF;
+		patches[PAR_SCALE][1] = SRC_OFF;
+		patches[PAR_TG_IP][1] =  SRC_OFF;
 		//LED BLUE 1
 		sbc.setPattern(2, SBC_WAVESHAPE_OFF, 0);//phase shifted 240 deg
-		patches[2][PAR_RATE] = SRC_LEV3;
+		patches[PAR_RATE][2] = SRC_LEV3;
 		rateFactor[2]=0;
-		patches[2][PAR_SCALE] = SRC_OFF;
-		patches[2][PAR_TG_IP] =  SRC_OFF;
+		patches[PAR_SCALE][2] = SRC_OFF;
+		patches[PAR_TG_IP][2] =  SRC_OFF;
+		compilePatches();
 	}
 	
 	////LED RED 1
 	//sbc.setPattern(0, SBC_WAVESHAPE_SAW, 0);//saw wave
-	//patches[0][PAR_RATE] = SRC_LEV1;//VR1 controls rate
+	//patches[PAR_RATE][0] = SRC_LEV1;//VR1 controls rate
 	//rateFactor[0]=0;//rate is not shifted
-	//patches[0][PAR_SCALE] = SRC_ON;// full scale brightness range
-	//patches[0][PAR_TG_IP] =  SRC_ON;//the waveform change is un-gated
+	//patches[PAR_SCALE][0] = SRC_ON;// full scale brightness range
+	//patches[PAR_TG_IP][0] =  SRC_ON;//the waveform change is un-gated
 	////LED GREEN 1
 	//sbc.setPattern(1, SBC_WAVESHAPE_SAW, 683);//phase shifted 120 deg
-	//patches[1][PAR_RATE] = SRC_LEV2;
+	//patches[PAR_RATE][1] = SRC_LEV2;
 	//rateFactor[1]=0;//rate is not shifted
-	//patches[1][PAR_SCALE] = SRC_ON;// full scale brightness range
-	//patches[1][PAR_TG_IP] =  SRC_ON;//the waveform change is un-gated
+	//patches[PAR_SCALE][1] = SRC_ON;// full scale brightness range
+	//patches[PAR_TG_IP][1] =  SRC_ON;//the waveform change is un-gated
 	////LED BLUE 1
 	//sbc.setPattern(2, SBC_WAVESHAPE_SAW, 1365);//phase shifted 240 deg
-	//patches[2][PAR_RATE] = SRC_LEV3;
+	//patches[PAR_RATE][2] = SRC_LEV3;
 	//rateFactor[2]=0;//rate is not shifted
-	//patches[2][PAR_SCALE] = SRC_ON;// full scale brightness range
-	//patches[2][PAR_TG_IP] =  SRC_ON;//the waveform change is un-gated	
+	//patches[PAR_SCALE][2] = SRC_ON;// full scale brightness range
+	//patches[PAR_TG_IP][2] =  SRC_ON;//the waveform change is un-gated	
 	
 	//flash activity pin to show we are alive
-	digitalWrite(PIN_ACT, HIGH);
-	delay(700);
-	digitalWrite(PIN_ACT, LOW);
+	actLed.queue(HIGH, 700);
 	
-	lastTickMillis = millis();
+	ticker.begin();
 
 }
 
 void loop(){
+	actLed.update();
+	PROF_START();
 	readSourceValues();
+	PROF_MARK(PROF_SOURCES);
+	//background work that must stay out of the tick
+	pollIR();
+	PROF_MARK(PROF_IR_POLL);
+	pollStaging();
+	PROF_MARK(PROF_STAGING);
+	uint8_t state[JOURNAL_PAYLOAD];
+	saveState(state);
+	journal.update(state);
+	journal.poll();
+	PROF_MARK(PROF_JOURNAL);
+	#ifdef DEBUG
+	printProgramStep();
+	#elif defined(TELEMETRY)
+	if(upload.poll()){
+		takeUpload();
+	}
+	sendProgramStep();
+	sendSnapshotStep();
+	sendSourcesStep();
+	sendMemoryStep();
+	#endif
+	PROF_MARK(PROF_OUTPUT);
 	
-	//pass the latest source values AND trigger a brightness update "tick" at around 16Hz
+	#ifdef PROFILE
+	if(Serial.available() && (Serial.read() == 'p')){
+		profiler.dump();
+		#ifdef DEBUG
+		ticker.dump();
+		#endif
+		memMonitor.dump();
+	}
+	#endif
+	
+	//pass the latest source values AND trigger a brightness update "tick" every TICK_PERIOD_US
 	// note that it is NOT necessary to pass the source values each tick; the previous vals remain in force until changed
-	uint16_t rate;
-	if((millis()-lastTickMillis) > 62){
+	if(ticker.due()){
+		PROF_TICK_START();
+		#ifdef TELEMETRY
+		unsigned long telStart = TEL_CLOCK();
+		#endif
+		#ifdef SYNC_I2C
+		unsigned long tickDue = micros() - ticker.getLastJitter();
+		syncTick++;
+		if(syncLink.isFollower()){
+			syncFollow(tickDue);
+		}
+		//the random sources change on tick counts rather than the clock, so every board draws the same numbers
+		if(syncTick % TICK_HZ == 0){
+			setSrcVal(SRC_RND_1S, random(1024));
+		}
+		if(syncTick % (10*TICK_HZ) == 0){
+			setSrcVal(SRC_RND_10S, random(1024));
+		}
+		#endif
 		
-		//if not waiting for program load commands, and program cycling is active then process the program cycling rules
-		if(pcActive && (irCommand == 0)){
-			pcCounter+=(getSrcVal(pcRateSrc)>>5);
-			if(pcCounter>=2048){
-				currentProgram++;
-				if(currentProgram>programCount){
-					currentProgram = 1;
-				}
-				loadProgram(currentProgram);
-				pcCounter = 0;
-			}
+		//act on the IR codes received since the last tick
+		unsigned long irCode;
+		while(irQueue.pop(&irCode)){
+			handleIR(irCode);
 		}
+		PROF_MARK(PROF_IR);
 		
-		//check IR receiver.
-		if (irrecv.decode(&results)) {
-			irLast = results.value;
-			irrecv.resume(); // Receive the next value
-			//only proceed if it was not a "repeat last value" code
-			if(irLast!=0xFFFFFFFF){
-				#ifdef DEBUG
-				Serial.println(irLast, HEX);//value is an unsigned long
-				#endif
-				boolean loadOK=false;//gets set to true if prog is to be loaded (several routes to this situation)
-				//if current command is PROG then need up to two numbers terminated by OK (or cancel to finish)
-				if(irCommand == IR_PROG){
-					if(irLast == IR_OK){//go and load a program from EEPROM if a valid prog number was entered
-						uint8_t progNum=irTens*10 + irUnits;
-						if(progNum>0 && progNum<=programCount){
-							loadOK=true;
-							currentProgram=progNum;
-						}
-						irCommand=0;//also cancel the active command
-					}else if(irLast == IR_NEXT){
-						currentProgram++;
-						if(currentProgram>programCount){
-							currentProgram=1;
-						}
-						loadOK = true;
-					}else if (irLast == IR_PREV){
-						currentProgram--;
-						if(currentProgram==0){
-							currentProgram=programCount;
-						}				
-						loadOK = true;		
-					}else if(irLast == IR_CANCEL){
-						irCommand = 0;
-					}else if(irLast == IR_PLAY){
-						pcActive = !pcActive;
-						irCommand = 0;
-					}else{
-						uint8_t irNumber = decodeNumIR(irLast);//gets the decimal number for the last key. returns 255 if not a number
-						#ifdef DEBUG
-						Serial.println(irNumber, DEC);
-						#endif
-						if(irNumber!=255){
-							irTens = irUnits;
-							irUnits=irNumber;
-							//blink off to ack the number
-							digitalWrite(PIN_ACT, LOW);
-							delay(200);
-							digitalWrite(PIN_ACT, HIGH);
-						}
-					}
-					//
-					if(loadOK){						
-						loadProgram(currentProgram);
-						irCommand=0;//also cancel the active command
-					}
-				}
-				
-				//does the last value start a PROG sequence? Only do it if there are programs.
-				if(irLast == IR_PROG){
-					if(programCount>0){
-						irCommand = IR_PROG;
-						irTens = 0;
-						irUnits = 0;
-					}
-				}else if(irLast == IR_CH_MINUS){
-					irSrc--;
-					if(irSrc<SRC_STEP1)irSrc = SRC_IR_INT3;
-				}else if(irLast == IR_CH_PLUS){
-					irSrc++;
-					if(irSrc>SRC_IR_INT3)irSrc = SRC_STEP1;
-				} else if((irLast == IR_MINUS) || (irLast == IR_PLUS)){
-					//change STEP or IR_INT srcVals
-					int step=(irSrc<SRC_IR_INT1)?255:32;
-					int val = (int)srcVals[irSrc];
-					if(irLast == IR_MINUS){
-						val-=step;
-						if(val<0) val = 0;
-					}else{
-						val+=step;
-						if(val>=1024) val = 1023;
-					}
-					srcVals[irSrc] = (uint16_t)val;
-						//flash activity pin to ack
-						digitalWrite(PIN_ACT, HIGH);
-						delay(100);
-						digitalWrite(PIN_ACT, LOW);
-					#ifdef DEBUG
-					Serial.println(val);
-					#endif
-				}
-				
-				//some flashing when IR srcValue pointer changes (this does not count as a command sequence... see below)
-				if((irLast == IR_CH_MINUS) || (irLast == IR_CH_PLUS)){
-					int flashLength = (irSrc>SRC_STEP3?250:100);
-					for(uint8_t ii=0;ii<1+(irSrc - SRC_STEP1)%3;ii++){
-						digitalWrite(PIN_ACT, HIGH);
-						delay(flashLength);			
-						digitalWrite(PIN_ACT, LOW);
-						delay(flashLength);
-					}
-				}
-				
-				//turn the activity LED on while a sequence is expected and off when not
-				if(irCommand == 0){
-					digitalWrite(PIN_ACT, LOW);
-				}else{
-					digitalWrite(PIN_ACT, HIGH);
-				}
-			}
+		//advance all the oscillators. Program cycling only runs when active and not waiting for program load commands
+		#ifdef TELEMETRY
+		oscBank.setHold(OSC_PC, !(pcActive && (irCommand == 0) && !upload.active()));
+		#else
+		oscBank.setHold(OSC_PC, !(pcActive && (irCommand == 0)));
+		#endif
+		oscBank.setHold(OSC_TGM, tgmPattern==TGM_DISABLED);
+		uint16_t wrapped = oscBank.update();
+		setSrcVal(SRC_LFO, oscBank.value(OSC_LFO));
+		for(uint8_t i = 0; i < OSC_COUNT; i++){
+			setSrcVal(SRC_OSC_BASE + i, oscBank.value(OSC_GENERAL + i));
 		}
-
-		lastTickMillis=millis();
+		PROF_MARK(PROF_OSC);
 		
-		//update the LFO value
-		lfoCounter+=(getSrcVal(lfoRateSrc)>>4);
-		if(lfoCounter>=2048) lfoCounter -=2048;
-		if(lfoCounter<1024){
-			srcVals[SRC_LFO]=lfoCounter;
-		}else{
-			srcVals[SRC_LFO]=2048 - lfoCounter;
+		//program cycling: the next program each time OSC_PC wraps
+		if(wrapped & (1 << OSC_PC)){
+			uint8_t next = currentProgram + 1;
+			if(next>programCount){
+				next = 1;
+			}
+			loadProgram(next);
+		}
+		#ifdef TELEMETRY
+		//an uploaded program, once staged
+		if((uploadLoad != 0) && (uploadLoad == stageProgram) && stagingComplete()){
+			currentProgram = uploadLoad;
+			applyStagedProgram();
 		}
+		#endif
+		PROF_MARK(PROF_PROG_CYCLE);
 		
-		//update the trigger/gate mask
-		if(!(tgmPattern==TGM_DISABLED)){
+		//step the trigger/gate mask each time OSC_TGM wraps
+		if(wrapped & (1 << OSC_TGM)){
 			updateTGM();
 		}
+		PROF_MARK(PROF_TGM);
+		
+		//update the mod buses whose sources have changed. A bus may use the output of a lower numbered bus in the same tick
+		for(uint8_t bus = 0; bus < MOD_BUSES; bus++){
+			boolean stale = patchesChanged;
+			for(uint8_t i = 0; i < modMatrix.terms(bus) && !stale; i++){
+				stale = srcChanged(modMatrix.source(bus, i));
+			}
+			if(stale){
+				setSrcVal(SRC_MOD_BASE + bus, modMatrix.evaluate(bus));
+			}
+		}
+		PROF_MARK(PROF_MOD);
 		
-		//use the patches to set the LED change rate, brightness scale, or trigger/gate input
+		//use the (compiled) patches to set the LED change rate, brightness scale, or trigger/gate input
+		//rateFactor scales the rate by factors of two, saturating rather than overflowing
+		//Only the parameters whose source has changed are pushed (all of them after the patches change)
+		uint16_t skipped = 0;
 		for(uint8_t led = 0; led< NUM_LEDS; led++){
-			rate = getSrcVal(patches[led][PAR_RATE]);
-			signed char rf=rateFactor[led];
-			if(rf>0){//rateFactor scales the rate by factors of two
-				rate = rate << rf;
-			}else if(rf<0){
-				rate = rate >> -rf;
+			#if TICK_HZ == TICK_BASE_HZ
+			if(patchesChanged || srcChanged(patchTable.source(PAR_RATE, led))){
+				sbc.setRate(led, patchTable.rate(led));
+			}else{
+				skipped++;
+			}
+			#else
+			//the scaled rate carries a fraction from tick to tick, so is pushed every tick
+			uint32_t r = (uint32_t)patchTable.rate(led) * TICK_RATE_MUL + rateCarry[led];
+			rateCarry[led] = (uint16_t)r;
+			sbc.setRate(led, r >> 16);
+			#endif
+			if(patchesChanged || srcChanged(patchTable.source(PAR_SCALE, led))){
+				sbc.setScale(led, patchTable.scale(led));
+			}else{
+				skipped++;
+			}
+			if(patchesChanged || srcChanged(patchTable.source(PAR_TG_IP, led))){
+				sbc.setTriggerIP(led, patchTable.triggerIP(led));
+			}else{
+				skipped++;
 			}
-			sbc.setRate(led, rate);
-			sbc.setScale(led, getSrcVal(patches[led][PAR_SCALE]));
-			sbc.setTriggerIP(led, getSrcVal(patches[led][PAR_TG_IP]));
 		}
+		srcDirty.clear();
+		patchesChanged = false;
+		patchSkipped = skipped;
+		PROF_MARK(PROF_PATCH);
 		sbc.tick();
+		#ifdef SBC_OUTPUT_BCM
+		for(uint8_t led = 0; led < NUM_LEDS; led++){
+			bcm.set(led, (uint16_t)sbc.getBrightness(led) << (BCM_BITS - 8));
+		}
+		#endif
+		PROF_MARK(PROF_SBC);
+		#ifdef SYNC_I2C
+		if(!syncLink.isFollower()){
+			syncLead(tickDue);
+		}
+		#endif
+		PROF_TICK_END();
+		ticker.endTick();
+		#ifdef TELEMETRY
+		telemetry.tick(telTick, TEL_CLOCK() - telStart, ticker.getLastJitter(), patchSkipped);
+		if(telTick % TEL_SOURCES_TICKS == 0){
+			telSrcNext = 0;
+		}
+		if(telTick % TEL_SNAPSHOT_TICKS == 0){
+			telSnapLed = 0;
+		}
+		if(telTick % TEL_MEMORY_TICKS == 0){
+			telMemoryDue = true;
+		}
+		telTick++;
+		#endif
 	}
 }
 
-//updates the trigger gate mask. This should be called each "tick" to update the mask internal counter,
-// and to set srcVals accordingly. i.e. it should be called before the patches are processed.
+//steps the trigger gate mask, and sets srcVals accordingly. This should be called in the "tick" each time OSC_TGM wraps,
+// i.e. it should be called before the patches are processed.
 void updateTGM(){
-	uint8_t tgmPattern2 = tgmPattern & 0xF;
-	//gets tgmRate added each tick. When exceeds 2048 the mask changes by one step and counter resets to 0
-	 tgmCounter+=(getSrcVal(tgmRateSrc)>>2);
-	 if(tgmCounter>=2048){
-		 //change mask
-		 switch (tgmPattern2){
-			 case TGM_SINGLE:
-				tgMask = tgMask<<1;
-				if(tgMask==(uint16_t)(1<<runLength)){//top reset
-					tgMask=1;
-				}
-				break;
-			case TGM_GROW:
-				if(tgmAB){
-					tgMask = tgMaskMask & (1 + (tgMask<<1));
-					if(tgMask==((uint16_t)(1<<runLength)-1)){//top bounce
-						tgmAB = !tgmAB;
-					}
-				}else{
-					tgMask = tgMask>>1;
-					if(tgMask==1){//bottom bounce
-						tgmAB = !tgmAB;
-					}
-				}
-				break;
-			case TGM_PASS:
-				if(tgmAB){
-					tgMask = tgMaskMask & (1 + (tgMask<<1));
-					if(tgMask==((uint16_t)(1<<runLength)-1)){//top bounce
-						tgmAB = !tgmAB;
-					}
-					}else{
-						tgMask = (tgMask<<1) & tgMaskMask;
-						if(tgMask==(uint16_t)(1<<(runLength-1))){//bottom bounce
-							tgmAB = !tgmAB;
-						}
-					}
-				break;			
-			case TGM_DOUBLE:
-				tgMask = tgMask<<1;
-				if(tgMask==2){//fudge in bit0 if only bit1 set
-					tgMask=3;
-				}
-				tgMask = tgMaskMask & tgMask;
-				if(tgMask==0){//top reset (0 because tgMaskMask has already kicked in)
-					tgMask=1;
-				}
-				break;
-		 }
-		 
-		 //transfer mask to srcVals
-		 for(uint8_t i=0; i<NUM_LEDS; i++){
-			 uint8_t ii = i%runLength;
-			srcVals[SRC_TG_MASK_BASE+i]=(tgMask&(1<<ii))?1023:0;		 
-		 }
-		 //reset counter
-		 tgmCounter = 0;
-	 }
-}
-
-//reads ADCs, check button events etc and updates the values in srcVals.
+	tgmSeq.step();
+	
+	//transfer mask to srcVals. The run repeats along the LEDs if it is shorter (i.e. TRIPLIFY)
+	uint8_t ii = 0;
+	for(uint8_t i=0; i<NUM_LEDS; i++){
+		setSrcVal(SRC_TG_MASK_BASE+i, tgmSeq.test(ii)?1023:0);
+		if(++ii == runLength) ii = 0;
+	}
+}
+
+//loads the mask program for tgmPattern from the staged program, which restarts the mask at bit 0
+void loadTGM(){
+	runLength = (tgmPattern&TGM_TRIPLIFY)?3:NUM_LEDS;
+	if((tgmPattern & 0xF) == TGM_CODE){
+		tgmSeq.load(stageImage.tgmCode + 1, stageImage.tgmCode[0], runLength);
+	}else{
+		tgmSeq.loadBuiltin(tgmPattern & 0xF, runLength);
+	}
+}
+
+//collects the latest (background) ADC readings, checks button events etc and updates the values in srcVals.
 //does not include IR control
 //excludes the trigger/gate mask
 void readSourceValues(){
-	srcVals[SRC_AUDIO] = 0; //TO DO	
-	srcVals[SRC_LEV1] = analogRead(PIN_LEV1);
-	srcVals[SRC_LEV2] = analogRead(PIN_LEV2);
-	srcVals[SRC_LEV3] = analogRead(PIN_LEV3);
+	setSrcVal(SRC_AUDIO, audio.level());
+	setSrcVal(SRC_BEAT, audio.beat()?1023:0);
+	setSrcVal(SRC_LEV1, adc.read(PIN_LEV1 - A0));
+	setSrcVal(SRC_LEV2, adc.read(PIN_LEV2 - A0));
+	setSrcVal(SRC_LEV3, adc.read(PIN_LEV3 - A0));
 	boolean b = digitalRead(PIN_SW1);
 	if(b^lastButton[0]){
 		 lastButton[0] = b;
@@ -519,23 +779,120 @@ void readSourceValues(){
 		stepButton(SRC_STEP3);
 	}
 	
-	//random changes at 1 and 10 seconds intervals
+	//random changes at 1 and 10 seconds intervals (in the tick with SYNC_I2C)
+	#ifndef SYNC_I2C
 	unsigned long t = millis();
 	if((t-lastRandChange1)>1000){
-		srcVals[SRC_RND_1S] = random(1024);//srcVals is uint16_t, random returns long - should auto-cast
+		setSrcVal(SRC_RND_1S, random(1024));//srcVals is uint16_t, random returns long - should auto-cast
 		lastRandChange1=t;
 	}
 	if((t-lastRandChange10)>10000){
-		srcVals[SRC_RND_10S] = random(1024);
+		setSrcVal(SRC_RND_10S, random(1024));
 		lastRandChange10=t;
-	}	
+	}
+	#endif
+}
+
+#ifdef SYNC_I2C
+//master, at the end of a tick: sends a frame every SYNC_FRAME_TICKS ticks or if the program has changed. Both ends then reseed
+//random() with the frame's seed, so that the followers draw the same numbers from the next tick on
+void syncLead(unsigned long tickDue){
+	if((syncTick % SYNC_FRAME_TICKS != 0) && (currentProgram == syncProgram)) return;
+	SyncState s;
+	s.tick = syncTick;
+	s.program = currentProgram;
+	for(uint8_t i = 0; i < SYNC_PHASES; i++){
+		s.phase[i] = oscBank.getPhase(OSC_LFO + i);
+	}
+	s.seed = random(1, 65536);
+	unsigned long age = micros() - tickDue;
+	s.age = age > 0xFFFF ? 0xFFFF : age;
+	syncLink.send(s);
+	randomSeed(s.seed);
+	syncProgram = currentProgram;
+}
+
+//follower, at the start of a tick: takes up the master's last frame, if it has not been, and moves the tick schedule towards the
+//master's. The program is loaded if it differs; the mask sequence (TgmSequencer) is not carried, so realigns at the next load
+void syncFollow(unsigned long tickDue){
+	SyncState s;
+	uint8_t ticksSince;
+	long correction;
+	if(!syncLink.receive(tickDue, &s, &ticksSince, &correction)) return;
+	ticker.shift(correction);
+	syncTick = s.tick + ticksSince;
+	if(s.program != currentProgram){
+		loadProgram(s.program);
+	}
+	for(uint8_t i = 0; i < SYNC_PHASES; i++){
+		oscBank.setPhase(OSC_LFO + i, s.phase[i]);
+	}
+	randomSeed(s.seed);
+}
+#endif
+
+//called from the ADC interrupt for each audio sample
+void audioSample(uint16_t value){
+	audio.sample(value);
 }
 
 void stepButton(uint8_t src){
 	uint16_t oldVal=srcVals[src];
 	oldVal+=255;
 	if(oldVal>1024) oldVal = 0;
-	srcVals[src] = oldVal;
+	setSrcVal(src, oldVal);
+}
+
+//the state kept by the journal: program, flags (bit 0 cycling, bits 4-7 irSrc - SRC_STEP1), then srcVals SRC_STEP1..SRC_IR_INT3
+//(2 bytes each, LSB first)
+void saveState(uint8_t* state){
+	state[0] = currentProgram;
+	state[1] = (pcActive?1:0) | ((irSrc - SRC_STEP1) << 4);
+	for(uint8_t i=0; i<=SRC_IR_INT3-SRC_STEP1; i++){
+		state[2+2*i] = srcVals[SRC_STEP1+i] & 0xFF;
+		state[3+2*i] = srcVals[SRC_STEP1+i] >> 8;
+	}
+}
+
+//takes up a state recovered by the journal, as far as it makes sense with the programs now in EEPROM
+void restoreState(const uint8_t* state){
+	if(state[0]>=1 && state[0]<=programCount){
+		currentProgram = state[0];
+	}
+	pcActive = (state[1] & 1) && (programCount>0);
+	if((state[1] >> 4) <= SRC_IR_INT3-SRC_STEP1){
+		irSrc = SRC_STEP1 + (state[1] >> 4);
+	}
+	for(uint8_t i=0; i<=SRC_IR_INT3-SRC_STEP1; i++){
+		uint16_t val = state[2+2*i] | (state[3+2*i] << 8);
+		if(val<=1023){
+			setSrcVal(SRC_STEP1+i, val);
+		}
+	}
+	//the buttons step their sources on a change, which the first readSourceValues() would otherwise see
+	lastButton[0] = digitalRead(PIN_SW1);
+	lastButton[1] = digitalRead(PIN_SW2);
+	lastButton[2] = digitalRead(PIN_SW3);
+}
+
+//the address after the last program in a store, or 0 if it holds none for NUM_LEDS. Stops early once past the journal
+unsigned long programsEnd(ProgramStore* store){
+	if(store->read(0)!=NUM_LEDS) return 0;
+	uint8_t count = store->read(1);
+	uint8_t format = store->read(3);
+	if(format==PROG_FORMAT_LEGACY){
+		return 8 + (unsigned long)PROG_BYTES*count;
+	}
+	if(format!=PROG_FORMAT_COMPACT){
+		return E2END + 1;//not known, so take it all
+	}
+	word addr = 8 + 4*store->read(4);
+	for(uint8_t i=0; i<count && addr<=JOURNAL_BASE; i++){
+		word len = store->readWord(&addr);
+		if(len > JOURNAL_BASE) return E2END + 1;
+		addr += len;
+	}
+	return addr;
 }
 
 //gets the actual value that currently pertains for a given source.
@@ -548,6 +905,25 @@ uint16_t getSrcVal(uint8_t src){
 	}
 }
 
+//sets a srcVals entry, marking it changed if it has, so that the next tick pushes the LED parameters patched to it
+void setSrcVal(uint8_t src, uint16_t value){
+	if(srcVals[src] != value){
+		srcVals[src] = value;
+		srcDirty.set(src);
+	}
+}
+
+//has a source changed since the last tick? src is a PatchTable::source()
+boolean srcChanged(uint8_t src){
+	return src != PATCH_NO_SRC && srcDirty.test(src);
+}
+
+//rebuilds patchTable from patches and rateFactor. Must be called after either changes. The mod buses are re-evaluated too
+void compilePatches(){
+	patchTable.compile(patches, rateFactor, srcVals, SRC_COUNT);
+	patchesChanged = true;
+}
+
 // - ----------- programming helpers ------------
 // replicate a specified program to all LEDs
 // NB: if using the TG mask generator as a patch source, then use SRC_TG_MASK_BASE as a pseudo-source (the appropriate actual src that maps to the LED will be used)
@@ -556,136 +932,434 @@ void programAll(uint8_t shape, uint8_t rateSrc, uint8_t scaleSrc, uint8_t tgSrc)
 		//main shape
 		sbc.setPattern(led, shape, 0);
 		//patches
-		patches[led][PAR_RATE] = rateSrc;
-		patches[led][PAR_SCALE] = scaleSrc;
+		patches[PAR_RATE][led] = rateSrc;
+		patches[PAR_SCALE][led] = scaleSrc;
 		if(tgSrc == SRC_TG_MASK_BASE){
-			patches[led][PAR_TG_IP] = SRC_TG_MASK_BASE+led;
+			patches[PAR_TG_IP][led] = SRC_TG_MASK_BASE+led;
 		}else{
-			patches[led][PAR_TG_IP] = tgSrc;
+			patches[PAR_TG_IP][led] = tgSrc;
 		}
 	}
+	compilePatches();
 }
 
 // replicate a specified program to all 3 LEDS in a RGB triple, with specified relative phase shift
 // NB: if using the TG mask generator as a patch source, then use SRC_TG_MASK_BASE as a pseudo-source (the appropriate actual src that maps to the LED will be used)
 void programTriple(uint8_t rgb, uint8_t shape, int phase, uint8_t rateSrc, uint8_t scaleSrc, uint8_t tgSrc){
 	uint8_t led = rgb*3;
-	for(int i=0; i<3; led++){
+	for(int i=0; i<3; i++){
 		//main shape
 		sbc.setPattern(led, shape, phase*i);
 		//patches
-		patches[led][PAR_RATE] = rateSrc;
-		patches[led][PAR_SCALE] = scaleSrc;
+		patches[PAR_RATE][led] = rateSrc;
+		patches[PAR_SCALE][led] = scaleSrc;
 		if(tgSrc == SRC_TG_MASK_BASE){
-			patches[led][PAR_TG_IP] = SRC_TG_MASK_BASE+led;
+			patches[PAR_TG_IP][led] = SRC_TG_MASK_BASE+led;
 			}else{
-			patches[led][PAR_TG_IP] = tgSrc;
+			patches[PAR_TG_IP][led] = tgSrc;
 		}
 		led++;
 	}
+	compilePatches();
+}
+
+#ifdef DEBUG
+//two hex digits, as "%02X" but without sprintf() and its format strings in RAM
+void printHex2(uint8_t v){
+	if(v<0x10){
+		Serial.print('0');
+	}
+	Serial.print(v, HEX);
 }
 
 void printPatch(uint8_t led){
-	char outStr[5];
-	sprintf(outStr, "%02X", patches[led][PAR_RATE]); 
-	Serial.print(outStr);
-	sprintf(outStr, "%02X", rateFactor[led]);
-	Serial.print(outStr);
-	Serial.print(" ");
-	sprintf(outStr, "%02X", patches[led][PAR_SCALE]);
-	Serial.print(outStr);
-	sprintf(outStr, "%02X", patches[led][PAR_TG_IP]);
-	Serial.println(outStr);
+	printHex2(patches[PAR_RATE][led]);
+	printHex2((uint8_t)rateFactor[led]);
+	Serial.print(' ');
+	printHex2(patches[PAR_SCALE][led]);
+	printHex2(patches[PAR_TG_IP][led]);
+	Serial.println();
 }
 
 void printPatternBytes(uint8_t led){
 	uint8_t buff[4];
 	sbc.getPatternProgBytes(led,buff);
-			
-	char outStr[5];
-	sprintf(outStr, "%02X", buff[0]);
-	Serial.print(outStr);
-	sprintf(outStr, "%02X", buff[1]);
-	Serial.print(outStr);
-	Serial.print(" ");
-	sprintf(outStr, "%02X", buff[2]);
-	Serial.print(outStr);
-	sprintf(outStr, "%02X", buff[3]);
-	Serial.println(outStr);
-}
-
-void loadProgram(uint8_t programNumber){
-	#ifdef DEBUG
-	Serial.print("Load Prog:");
-	Serial.println(programNumber);
+	printHex2(buff[0]);
+	printHex2(buff[1]);
+	Serial.print(' ');
+	printHex2(buff[2]);
+	printHex2(buff[3]);
+	Serial.println();
+}
+#endif
+
+//loads a program and makes it currentProgram, using the staged image if it is the one that was staged ahead (the usual case
+//when cycling or on IR NEXT). Otherwise the program is read from EEPROM now.
+//Returns false, with nothing changed, if there is no such program, an upload is rewriting the EEPROM or the I2C EEPROM could
+//not be read STAGE_RETRIES times over
+boolean loadProgram(uint8_t programNumber){
+	if(programNumber==0 || programNumber>programCount) return false;
+	#ifdef TELEMETRY
+	if(upload.active()) return false;//the EEPROM is part written
+	#endif
+	if((stageProgram != programNumber) || (stageRetries > STAGE_RETRIES)){
+		startStaging(programNumber);
+	}
+	while(!stagingComplete()){
+		if(stageRetries > STAGE_RETRIES) return false;//staging carries on in the background
+		pollStaging();
+	}
+	currentProgram = programNumber;
+	applyStagedProgram();
+	return true;
+}
+
+//begins reading a program into stageImage. The bytes are read and decoded by pollStaging(), a block at a time
+void startStaging(uint8_t programNumber){
+	stageProgram = programNumber;
+	stageErrors = progStore.getErrors();
+	stageRetries = 0;
+	if(progFormat==PROG_FORMAT_COMPACT){
+		//programs are variable length, so walk along the length prefixes
+		stageAddr = 8 + 4*progDictCount;
+		for(uint8_t i=1; i<programNumber; i++){
+			word len = progStore.readWord(&stageAddr);
+			stageAddr += len;
+		}
+		stageRemaining = progStore.readWord(&stageAddr);
+	}else{
+		stageAddr = 8 + PROG_BYTES*(programNumber-1);
+		stageRemaining = PROG_BYTES;
+	}
+	stageDecoder.begin(progFormat, (uint8_t*)&stageImage, NUM_LEDS, &progStore, 8, progDictCount);
+}
+
+//reads and decodes the next block of the program being staged, if any. Called once per loop() pass, outside the tick
+void pollStaging(){
+	if(stageProgram==0 || stageRemaining==0) return;
+	#ifdef TELEMETRY
+	if(upload.active()) return;
 	#endif
+	uint8_t buff[STAGE_BLOCK];
+	uint8_t count = (stageRemaining<STAGE_BLOCK)?stageRemaining:STAGE_BLOCK;
+	progStore.readBytes(&stageAddr, buff, count);
+	for(uint8_t i=0; i<count; i++){
+		stageDecoder.feed(buff[i]);
+	}
+	stageRemaining -= count;
+	if(progStore.getErrors() != stageErrors){
+		//the block, the walk to the program or a dictionary look-up was not read: start again
+		uint8_t retries = (stageRetries < 255) ? stageRetries + 1 : 255;
+		startStaging(stageProgram);
+		stageRetries = retries;
+	}
+}
+
+boolean stagingComplete(){
+	return (stageProgram!=0) && (stageRemaining==0);
+}
+
+//makes the (complete) staged program the live one. No EEPROM access and no Serial output, so this is safe in the tick.
+//Staging of the program that follows it then starts, ready for cycling or IR NEXT
+void applyStagedProgram(){
+	lfoRateSrc = (uint16_t)stageImage.lfo[0];
+	tgmRateSrc = (uint16_t)stageImage.tgm[0];
+	tgmPattern = stageImage.tgm[1];
+	oscBank.setRate(OSC_LFO, lfoRateSrc, 4, 0);
+	oscBank.setRate(OSC_TGM, tgmRateSrc, 2, 0);
+	for(uint8_t i=0; i<OSC_COUNT; i++){
+		oscBank.setWave(OSC_GENERAL+i, stageImage.osc[i][0]);
+		oscBank.setRate(OSC_GENERAL+i, stageImage.osc[i][1], 0, 4);
+	}
+	loadTGM();
 	
-	//program start address
-	word eAddr = 8 + PROG_BYTES*(programNumber-1);
-	//block buffer
-	uint8_t buff[4];
+	for(uint8_t led=0; led<NUM_LEDS; led++){
+		sbc.setPatternFromProgBytes(led, stageImage.pattern[led]);
+		patches[PAR_RATE][led] = stageImage.patch[led][0];
+		rateFactor[led] = stageImage.patch[led][1];
+		patches[PAR_SCALE][led] = stageImage.patch[led][2];
+		patches[PAR_TG_IP][led] = stageImage.patch[led][3];
+	}
+	modMatrix.compile(stageImage.mod, srcVals, SRC_COUNT);
+	compilePatches();
 	
-	//read in LFO and Trigger/gate mask settings
-	EEPROMUtils::loadBytes(&eAddr, buff, 4);
-	lfoRateSrc = (uint16_t)buff[0];
-	EEPROMUtils::loadBytes(&eAddr, buff, 4);
-	tgmRateSrc = (uint16_t)buff[0];
-	tgmPattern = buff[1];
-	tgMask = 1;
-	runLength = (tgmPattern&TGM_TRIPLIFY)?3:NUM_LEDS;
-	tgMaskMask=(1<<runLength)-1;
+	#ifdef DEBUG
+	Serial.print(F("Load Prog:"));
+	Serial.println(stageProgram);
+	if(stageDecoder.error()){
+		Serial.println(F("Decode error"));
+	}
+	dumpLine = 0;
+	#elif defined(TELEMETRY)
+	telemetry.programLoad(stageProgram, progFormat, stageDecoder.error());
+	dumpLine = 0;
+	uploadLoad = 0;
+	#endif
 	
-	//loop over LEDS for shape data
-	for(uint8_t led=0; led<NUM_LEDS; led++){		
-		EEPROMUtils::loadBytes(&eAddr, buff, 4);
-		sbc.setPatternFromProgBytes(led,buff);
-		#ifdef DEBUG
-		printPatternBytes(led);
-		#endif
-		
-		//EEPROMUtils::loadBytes(&eAddr, buff, 2);
-		//phase = EEPROMUtils::loadInt(&eAddr);
-		//sbc.setPattern(led, buff[0] , phase);
+	uint8_t next = stageProgram + 1;
+	if(next > programCount){
+		next = 1;
 	}
+	startStaging(next);
+}
 
-	//loop over LEDs for patches
-	for(uint8_t led=0; led<NUM_LEDS; led++){
-		EEPROMUtils::loadBytes(&eAddr, buff, 4);
-		patches[led][PAR_RATE] = buff[0];
-		rateFactor[led]=buff[1];
-		patches[led][PAR_SCALE] = buff[2];
-		patches[led][PAR_TG_IP] = buff[3];
-		#ifdef DEBUG
-		printPatch(led);
-		#endif
+#ifdef DEBUG
+//prints one line of the pattern/patch listing for the last program loaded, so that a 9600 baud listing does not hold up a tick.
+//Called once per loop() pass, outside the tick
+void printProgramStep(){
+	if(dumpLine >= 2*NUM_LEDS) return;
+	if(dumpLine < NUM_LEDS){
+		printPatternBytes(dumpLine);
+	}else{
+		printPatch(dumpLine - NUM_LEDS);
 	}
-	
+	dumpLine++;
+}
+#endif
+
+#ifdef TELEMETRY
+//sends the pattern and patch of one LED of the last program loaded. Called once per loop() pass, outside the tick
+void sendProgramStep(){
+	if(dumpLine >= NUM_LEDS) return;
+	uint8_t pattern[4];
+	sbc.getPatternProgBytes(dumpLine, pattern);
+	uint8_t patch[4];
+	patch[0] = patches[PAR_RATE][dumpLine];
+	patch[1] = (uint8_t)rateFactor[dumpLine];
+	patch[2] = patches[PAR_SCALE][dumpLine];
+	patch[3] = patches[PAR_TG_IP][dumpLine];
+	telemetry.programLed(dumpLine, pattern, patch);
+	dumpLine++;
+}
+
+//sends the next TEL_SNAPSHOT_LEDS LEDs of the current snapshot: the rate, scale and trigger/gate from the patches.
+//Called once per loop() pass, outside the tick
+void sendSnapshotStep(){
+	if(telSnapLed >= NUM_LEDS) return;
+	uint8_t n = NUM_LEDS - telSnapLed;
+	if(n > TEL_SNAPSHOT_LEDS) n = TEL_SNAPSHOT_LEDS;
+	if(telemetry.open(TEL_SNAPSHOT, 3 + 6*n)){
+		telemetry.put16(telTick - 1);//the tick that started the snapshot
+		telemetry.put8(telSnapLed);
+		for(uint8_t led = telSnapLed; led < telSnapLed + n; led++){
+			telemetry.put16(patchTable.rate(led));
+			telemetry.put16(patchTable.scale(led));
+			telemetry.put16(patchTable.triggerIP(led));
+		}
+		telemetry.close();
+	}
+	telSnapLed += n;
 }
 
-//convert an IR code into a decimal number, or return255 if code does not mean a number
-uint8_t decodeNumIR(unsigned long irCode){
-	switch (irCode){
-		case IR_N0:
-			return 0;
-		case IR_N1:
-			return 1;
-		case IR_N2:
-			return 2;
-		case IR_N3:
-			return 3;
-		case IR_N4:
-			return 4;
-		case IR_N5:
-			return 5;
-		case IR_N6:
-			return 6;
-		case IR_N7:
-			return 7;
-		case IR_N8:
-			return 8;
-		case IR_N9:
-			return 9;
-		default:
-			return 255;
+//sends the next TEL_SOURCES_CHUNK srcVals. Called once per loop() pass, outside the tick
+void sendSourcesStep(){
+	if(telSrcNext >= SRC_COUNT) return;
+	uint8_t n = SRC_COUNT - telSrcNext;
+	if(n > TEL_SOURCES_CHUNK) n = TEL_SOURCES_CHUNK;
+	telemetry.sources(telSrcNext, srcVals + telSrcNext, n);
+	telSrcNext += n;
+}
+
+//sends the SRAM figures when due. The high-water mark is a scan of the free RAM, so this is kept out of the tick
+void sendMemoryStep(){
+	if(!telMemoryDue) return;
+	telemetry.memory(memMonitor.staticBytes(), memMonitor.heapBytes(), memMonitor.freeBytes(), memMonitor.minFreeBytes());
+	telMemoryDue = false;
+}
+
+//takes up the header of an upload that has been committed, as setup() reads it, and stages the program to load. The tick loads
+//it once staged (uploadLoad). Called outside the tick
+void takeUpload(){
+	uint8_t count, rateSrc, program;
+	upload.getCommit(&count, &rateSrc, &program);
+	progFormat = progStore.read(3);
+	if(progFormat<=PROG_FORMAT_COMPACT){
+		progDictCount = (progFormat==PROG_FORMAT_COMPACT)?progStore.read(4):0;
+	}else{
+		count = 0;
+	}
+	if(count==0){
+		//nothing to load; the program in RAM plays on
+		pcActive = false;
+	}else if(programCount==0){
+		pcActive = true;
+	}
+	if(count!=programCount){
+		//a PROG sequence under way was for the old programs
+		irCommand = 0;
+		irTens = 0;
+		irUnits = 0;
 	}
+	programCount = count;
+	pcRateSrc = rateSrc;
+	oscBank.setRate(OSC_PC, pcRateSrc, 5, 0);
+	if(programCount==0){
+		stageProgram = 0;
+		uploadLoad = 0;
+		return;
+	}
+	if(program==0 || program>programCount){
+		program = currentProgram;
+	}
+	if(program==0 || program>programCount){
+		program = 1;
+	}
+	startStaging(program);
+	uploadLoad = program;
+}
+#endif
+
+//moves a code decoded by the IR receiver, if any, into irQueue. Called on every loop() pass, so that presses closer together
+//than a tick are all kept, to be acted on at the next tick
+void pollIR(){
+	if(irrecv.decode(&results)){
+		//"repeat last value" codes are not queued
+		if(results.value!=0xFFFFFFFF){
+			irQueue.push(results.value);
+		}
+		irrecv.resume(); // Receive the next value
+	}
+}
+
+//the action for an IR code, from irKeys, or IR_ACT_NONE
+uint8_t irAction(unsigned long code){
+	for(uint8_t i=0; i<IR_KEY_COUNT; i++){
+		if(pgm_read_dword(&irKeys[i].code) == code){
+			return pgm_read_byte(&irKeys[i].action);
+		}
+	}
+	return IR_ACT_NONE;
+}
+
+//acts on one IR code. Called from the tick
+void handleIR(unsigned long code){
+	irLast = code;
+	uint8_t action = irAction(code);
+	#ifdef DEBUG
+	Serial.println(irLast, HEX);//value is an unsigned long
+	#elif defined(TELEMETRY)
+	telemetry.ir(irLast);
+	#endif
+	uint8_t loadNum=0;//the program to load, if any (several routes to this situation); loadProgram() rejects a number out of range
+	//if current command is PROG then need up to two numbers terminated by OK (or cancel to finish)
+	if(irCommand == IR_PROG){
+		switch(action){
+			case IR_ACT_OK://go and load a program from EEPROM if a valid prog number was entered
+				loadNum=irTens*10 + irUnits;
+				irCommand=0;//also cancel the active command
+				break;
+			case IR_ACT_NEXT:
+				loadNum = currentProgram + 1;
+				if(loadNum>programCount){
+					loadNum=1;
+				}
+				break;
+			case IR_ACT_PREV:
+				loadNum = currentProgram - 1;
+				if(loadNum==0){
+					loadNum=programCount;
+				}
+				break;
+			case IR_ACT_CANCEL:
+				irCommand = 0;
+				break;
+			case IR_ACT_PLAY:
+				pcActive = !pcActive;
+				irCommand = 0;
+				break;
+			default:{
+				uint8_t irNumber = (action<=IR_ACT_DIGIT+9)?(action-IR_ACT_DIGIT):255;//the decimal number for the key, or 255 if not a number
+				#ifdef DEBUG
+				Serial.println(irNumber, DEC);
+				#endif
+				if(irNumber!=255){
+					irTens = irUnits;
+					irUnits=irNumber;
+					//blink off to ack the number
+					actLed.cancel();
+					actLed.queue(LOW, 200);
+				}
+			}
+		}
+		//
+		if(loadNum!=0){
+			loadProgram(loadNum);
+			irCommand=0;//also cancel the active command
+		}
+	}
+	
+	//does the last value start a PROG sequence? Only do it if there are programs.
+	switch(action){
+		case IR_ACT_PROG:
+			if(programCount>0){
+				irCommand = IR_PROG;
+				irTens = 0;
+				irUnits = 0;
+			}
+			break;
+		case IR_ACT_CH_MINUS:
+			irSrc--;
+			if(irSrc<SRC_STEP1)irSrc = SRC_IR_INT3;
+			break;
+		case IR_ACT_CH_PLUS:
+			irSrc++;
+			if(irSrc>SRC_IR_INT3)irSrc = SRC_STEP1;
+			break;
+		case IR_ACT_CH:
+			#ifdef PROFILE
+			profiler.dump();
+			#endif
+			#if defined(DEBUG) || defined(PROFILE)
+			memMonitor.dump();
+			#endif
+			#ifdef DEBUG
+			ticker.dump();
+			Serial.print(F("IR dropped "));
+			Serial.println(irQueue.getDropped());
+			#elif defined(TELEMETRY)
+			if(telemetry.open(TEL_SCHED, 14)){
+				telemetry.put32(ticker.getTicks());
+				telemetry.put16(ticker.getMissed());
+				telemetry.put16(ticker.getOverruns());
+				unsigned long jitter[3] = {ticker.getMinJitter(), ticker.getMeanJitter(), ticker.getMaxJitter()};
+				for(uint8_t i = 0; i < 3; i++) telemetry.put16(jitter[i] > 0xFFFF ? 0xFFFF : jitter[i]);
+				telemetry.close();
+			}
+			ticker.reset();//as ticker.dump() does
+			#endif
+			break;
+		case IR_ACT_MINUS:
+		case IR_ACT_PLUS:{
+			//change STEP or IR_INT srcVals
+			int step=(irSrc<SRC_IR_INT1)?255:32;
+			int val = (int)srcVals[irSrc];
+			if(action == IR_ACT_MINUS){
+				val-=step;
+				if(val<0) val = 0;
+			}else{
+				val+=step;
+				if(val>=1024) val = 1023;
+			}
+			setSrcVal(irSrc, (uint16_t)val);
+			//flash activity pin to ack
+			actLed.cancel();
+			actLed.queue(HIGH, 100);
+			#ifdef DEBUG
+			Serial.println(val);
+			#elif defined(TELEMETRY)
+			telemetry.value(irSrc, val);
+			#endif
+			break;
+		}
+	}
+	
+	//some flashing when IR srcValue pointer changes (this does not count as a command sequence... see below)
+	if((action == IR_ACT_CH_MINUS) || (action == IR_ACT_CH_PLUS)){
+		int flashLength = (irSrc>SRC_STEP3?250:100);
+		actLed.cancel();
+		actLed.blink(1+(irSrc - SRC_STEP1)%3, HIGH, flashLength);
+	}
+	
+	//turn the activity LED on while a sequence is expected and off when not (once any ack flashes are done)
+	actLed.setIdle((irCommand == 0)?LOW:HIGH);
 }